@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+#include "util/data_structure/data_types.h"
+
+
+// Small helpers shared by the micro benchmarks, intentionally header only
+
+// @brief Monotonic time in nanoseconds, used to time benchmark loops
+static inline u64 bench_now_ns() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+
+// @brief Prevents the compiler from optimizing away a computed value
+#define BENCH_DO_NOT_OPTIMIZE(value)            __asm__ volatile("" : : "g"(value) : "memory")
+
+
+// @brief Runs [body] [iterations] times, [repetitions] times in a row, and prints the best result in ns per iteration
+#define BENCH_RUN(name, repetitions, iterations, body)                                                  \
+    do {                                                                                                \
+        f64 best_ns = 1e30;                                                                             \
+        for (u32 bench_rep = 0; bench_rep < (repetitions); bench_rep++) {                               \
+            const u64 bench_start = bench_now_ns();                                                     \
+            for (u64 bench_i = 0; bench_i < (iterations); bench_i++) { body; }                          \
+            const f64 bench_ns = (f64)(bench_now_ns() - bench_start) / (f64)(iterations);               \
+            if (bench_ns < best_ns) best_ns = bench_ns;                                                 \
+        }                                                                                               \
+        printf("%-48s %10.2f ns/op\n", name, best_ns);                                                  \
+    } while (0)
@@ -0,0 +1,242 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util/data_structure/concurrent_map.h"
+#include "util/data_structure/unordered_map.h"
+
+#include "bench.h"
+
+
+// Lookup throughput of concurrent_map against an unordered_map behind a mutex and behind a rwlock, for 1 to [max_threads] reader
+// threads. "read only" has no writer, "with writer" runs one more thread that inserts and erases its own keys during the whole run.
+// Lock free reads should scale with the reader count as long as there are cores for them.
+// "churn" inserts and erases CHURN_PAIRS keys at a constant size, the pattern of the thread label and crash callback registries in a
+// long running process. Every replaced table has to be reclaimed, so the resident memory must not grow with the number of pairs:
+//
+//      bench_concurrent_map [lookups_per_thread] [max_threads]
+
+#define DEFAULT_LOOKUPS_PER_THREAD  2000000
+#define MAX_THREADS                 64
+#define KEY_COUNT                   4096                    // entries the readers look up, about the size of a registry
+#define WRITER_KEY_BASE             (1ULL << 40)            // the writer churns keys above this, readers never look them up
+#define CHURN_PAIRS                 1000000
+
+typedef enum {
+    MAP_CONCURRENT = 0,
+    MAP_MUTEX,
+    MAP_RWLOCK,
+    MAP_KIND_COUNT,
+} map_kind;
+
+static const char*                  c_map_names[MAP_KIND_COUNT] = { "concurrent_map", "u_map + mutex", "u_map + rwlock" };
+
+static concurrent_map               s_concurrent;
+static unordered_map                s_map;
+static pthread_mutex_t              s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t             s_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+static u64                          s_keys[KEY_COUNT];
+static u64                          s_writer_keys[KEY_COUNT];
+static pthread_barrier_t            s_start;
+static atomic_bool                  s_stop_writer;
+
+typedef struct {
+    pthread_t                       thread;
+    map_kind                        kind;
+    u32                             lookups;
+    u32                             seed;
+    u64                             found;
+} reader_data;
+
+
+static u64 lookup(const map_kind kind, u64* key) {
+
+    u64 value = 0;
+    void* found = NULL;
+    switch (kind) {
+        case MAP_CONCURRENT:
+            c_map_find(&s_concurrent, *key, &value);
+            return value;
+
+        case MAP_MUTEX:
+            pthread_mutex_lock(&s_mutex);
+            if (u_map_find(&s_map, key, &found) == AT_SUCCESS)
+                value = (u64)(uintptr_t)found;
+            pthread_mutex_unlock(&s_mutex);
+            return value;
+
+        default:
+            pthread_rwlock_rdlock(&s_rwlock);
+            if (u_map_find(&s_map, key, &found) == AT_SUCCESS)
+                value = (u64)(uintptr_t)found;
+            pthread_rwlock_unlock(&s_rwlock);
+            return value;
+    }
+}
+
+
+static void* reader(void* arg) {
+
+    reader_data* data = arg;
+    u32 state = data->seed;
+    pthread_barrier_wait(&s_start);
+
+    u64 found = 0;
+    for (u32 x = 0; x < data->lookups; x++) {
+        state = state * 1664525u + 1013904223u;
+        found += (lookup(data->kind, &s_keys[(state >> 8) % KEY_COUNT]) != 0);
+    }
+    data->found = found;
+    return NULL;
+}
+
+
+static void* writer(void* arg) {
+
+    const map_kind kind = *(const map_kind*)arg;
+    pthread_barrier_wait(&s_start);
+
+    for (u32 x = 0; !atomic_load_explicit(&s_stop_writer, memory_order_relaxed); x = (x + 1) % KEY_COUNT) {
+        u64* key = &s_writer_keys[x];
+        switch (kind) {
+            case MAP_CONCURRENT:
+                c_map_insert(&s_concurrent, *key, 1);
+                c_map_erase(&s_concurrent, *key);
+                break;
+
+            case MAP_MUTEX:
+                pthread_mutex_lock(&s_mutex);
+                u_map_insert(&s_map, key, (void*)1);
+                u_map_erase(&s_map, key);
+                pthread_mutex_unlock(&s_mutex);
+                break;
+
+            default:
+                pthread_rwlock_wrlock(&s_rwlock);
+                u_map_insert(&s_map, key, (void*)1);
+                u_map_erase(&s_map, key);
+                pthread_rwlock_unlock(&s_rwlock);
+                break;
+        }
+    }
+    return NULL;
+}
+
+
+// Returns the lookups per second of all readers together
+static f64 run(const map_kind kind, const u32 thread_count, const u32 lookups_per_thread, const b8 with_writer) {
+
+    reader_data readers[MAX_THREADS];
+    pthread_t writer_thread;
+    map_kind writer_kind = kind;
+
+    atomic_store(&s_stop_writer, false);
+    pthread_barrier_init(&s_start, NULL, thread_count + 1 + with_writer);
+    for (u32 x = 0; x < thread_count; x++) {
+        readers[x] = (reader_data){ .kind = kind, .lookups = lookups_per_thread, .seed = x * 7919 + 1 };
+        pthread_create(&readers[x].thread, NULL, reader, &readers[x]);
+    }
+    if (with_writer)
+        pthread_create(&writer_thread, NULL, writer, &writer_kind);
+
+    pthread_barrier_wait(&s_start);
+    const u64 start = bench_now_ns();
+    u64 found = 0;
+    for (u32 x = 0; x < thread_count; x++) {
+        pthread_join(readers[x].thread, NULL);
+        found += readers[x].found;
+    }
+    const u64 end = bench_now_ns();
+
+    atomic_store(&s_stop_writer, true);
+    if (with_writer)
+        pthread_join(writer_thread, NULL);
+    pthread_barrier_destroy(&s_start);
+
+    BENCH_DO_NOT_OPTIMIZE(found);
+    return (f64)thread_count * lookups_per_thread / ((f64)(end - start) / 1e9);
+}
+
+
+// Resident memory of the process in KiB, 0 if unknown
+static u64 resident_kib() {
+
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+
+    unsigned long pages = 0, resident = 0;
+    const int fields = fscanf(file, "%lu %lu", &pages, &resident);
+    fclose(file);
+    return (fields == 2) ? (u64)resident * (u64)sysconf(_SC_PAGESIZE) / 1024 : 0;
+}
+
+
+// Inserts and erases [pairs] keys while [size] (at most KEY_COUNT) other entries stay in the map, prints the time per pair and the growth of resident memory
+static void churn(const u32 pairs, const u32 size) {
+
+    concurrent_map map;
+    c_map_init(&map, 16);
+    for (u32 x = 0; x < size; x++)
+        c_map_insert(&map, s_keys[x], x + 1);
+
+    const u64 resident_start = resident_kib();
+    const u64 start = bench_now_ns();
+    for (u32 x = 0; x < pairs; x++) {
+        c_map_insert(&map, WRITER_KEY_BASE + x, 1);
+        c_map_erase(&map, WRITER_KEY_BASE + x);
+    }
+    const u64 end = bench_now_ns();
+    const u64 resident_end = resident_kib();
+
+    printf("    size %-11u %10.2f ns/pair   resident %+lld KiB\n", size, (f64)(end - start) / pairs, (long long)resident_end - (long long)resident_start);
+    c_map_free(&map);
+}
+
+
+int main(int argc, char** argv) {
+
+    const u32 lookups_per_thread = (argc > 1) ? (u32)strtoul(argv[1], NULL, 10) : DEFAULT_LOOKUPS_PER_THREAD;
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 max_threads = (argc > 2) ? (u32)strtoul(argv[2], NULL, 10) : (u32)((cores > 1) ? cores : 1);
+    max_threads = (max_threads > MAX_THREADS) ? MAX_THREADS : max_threads;
+    if (lookups_per_thread == 0 || max_threads == 0) {
+        fprintf(stderr, "usage: %s [lookups_per_thread] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    c_map_init(&s_concurrent, KEY_COUNT * 2);
+    u_map_init(&s_map, KEY_COUNT * 2, u64_hash, u64_compare);
+    for (u64 x = 0; x < KEY_COUNT; x++) {
+        s_keys[x] = x * 0x9E3779B97F4A7C15ULL + 1;
+        s_writer_keys[x] = WRITER_KEY_BASE + x;
+        c_map_insert(&s_concurrent, s_keys[x], x + 1);
+        u_map_insert(&s_map, &s_keys[x], (void*)(uintptr_t)(x + 1));
+    }
+
+    printf("%ld cores, %u lookups per reader, %u keys\n", cores, lookups_per_thread, KEY_COUNT);
+    for (u32 with_writer = 0; with_writer <= 1; with_writer++) {
+        printf("%s\n    %-16s", with_writer ? "with writer" : "read only", "readers");
+        for (u32 thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+            printf(" %10u", thread_count);
+        printf("   (M lookups/s, all readers)\n");
+
+        for (u32 kind = 0; kind < MAP_KIND_COUNT; kind++) {
+            printf("    %-16s", c_map_names[kind]);
+            for (u32 thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+                printf(" %10.2f", run(kind, thread_count, lookups_per_thread, with_writer) / 1e6);
+            printf("\n");
+        }
+    }
+
+    printf("churn (%u insert + erase pairs, concurrent_map)\n", CHURN_PAIRS);
+    churn(CHURN_PAIRS, 0);
+    churn(CHURN_PAIRS, 64);
+    churn(CHURN_PAIRS, KEY_COUNT);
+
+    c_map_free(&s_concurrent);
+    u_map_free(&s_map);
+    return 0;
+}
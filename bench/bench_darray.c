@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/data_structure/darray.h"
+#include "util/data_structure/darray_template.h"
+
+#include "bench.h"
+
+
+// Bulk operations of darray against the same work done one element at a time, for growing element counts. The one-at-a-time
+// versions move the tail once per element (O(n * k)), the bulk versions once per call (O(n + k)), so the gap grows with the count.
+// The typed rows use DEFINE_DARRAY with the same u64 elements.
+
+DEFINE_DARRAY(typed_array, u64)
+
+#define REPETITIONS             5
+
+
+// Best time of [repetitions] runs of [body], [setup] and [teardown] are not timed
+#define BENCH_OP(name, setup, body, teardown)                                                           \
+    do {                                                                                                \
+        f64 best_us = 1e30;                                                                             \
+        for (u32 bench_rep = 0; bench_rep < REPETITIONS; bench_rep++) {                                 \
+            setup;                                                                                      \
+            const u64 bench_start = bench_now_ns();                                                     \
+            body;                                                                                       \
+            const f64 bench_us = (f64)(bench_now_ns() - bench_start) / 1e3;                             \
+            if (bench_us < best_us) best_us = bench_us;                                                 \
+            teardown;                                                                                   \
+        }                                                                                               \
+        printf("    %-44s %12.2f us\n", name, best_us);                                                 \
+    } while (0)
+
+
+static b8 is_odd(const void* element, void* user_data) {
+
+    (void)user_data;
+    return (*(const u64*)element & 1) != 0;
+}
+
+
+static b8 typed_is_odd(const u64* element, void* user_data) {
+
+    (void)user_data;
+    return (*element & 1) != 0;
+}
+
+
+// Fills [d] with the values 0 .. [count]
+static void fill(darray* d, const u64* values, const size_t count) {
+
+    darray_init_with_capacity(d, sizeof(u64), count);
+    darray_append_n(d, values, count);
+}
+
+
+static void run(const size_t count) {
+
+    u64* values = malloc(count * sizeof(u64));
+    for (size_t i = 0; i < count; i++)
+        values[i] = i;
+
+    const size_t half = count / 2;
+    darray d = {0};
+    typed_array typed = {0};
+    u64 removed = 0;
+
+    printf("%zu u64 elements\n", count);
+
+    BENCH_OP("build          push_back loop", darray_init(&d, sizeof(u64)),
+        { for (size_t i = 0; i < count; i++) darray_push_back(&d, &values[i]); }, darray_free(&d));
+    BENCH_OP("build          darray_append_n", darray_init(&d, sizeof(u64)),
+        darray_append_n(&d, values, count), darray_free(&d));
+    BENCH_OP("build          typed push loop", typed_array_init(&typed, 0),
+        { for (size_t i = 0; i < count; i++) typed_array_push(&typed, values[i]); }, typed_array_free(&typed));
+    BENCH_OP("build          typed append_n", typed_array_init(&typed, 0),
+        typed_array_append_n(&typed, values, count), typed_array_free(&typed));
+
+    BENCH_OP("insert half    insert loop (at front)", fill(&d, values, count),
+        { for (size_t i = 0; i < half; i++) darray_insert(&d, i, &values[i]); }, darray_free(&d));
+    BENCH_OP("insert half    darray_insert_range", fill(&d, values, count),
+        darray_insert_range(&d, 0, values, half), darray_free(&d));
+
+    BENCH_OP("erase half     erase loop (middle)", fill(&d, values, count),
+        { for (size_t i = 0; i < half; i++) darray_erase(&d, count / 4); }, darray_free(&d));
+    BENCH_OP("erase half     darray_erase_range", fill(&d, values, count),
+        darray_erase_range(&d, count / 4, half), darray_free(&d));
+
+    BENCH_OP("erase odd      erase loop (from back)", fill(&d, values, count),
+        { for (size_t i = d.count; i-- > 0;) if (is_odd(&darray_at(&d, u64, i), NULL)) darray_erase(&d, i); }, darray_free(&d));
+    BENCH_OP("erase odd      darray_erase_if", fill(&d, values, count),
+        darray_erase_if(&d, is_odd, NULL, NULL), darray_free(&d));
+    BENCH_OP("erase odd      typed erase_if", { typed_array_init(&typed, count); typed_array_append_n(&typed, values, count); },
+        { removed = typed_array_erase_if(&typed, typed_is_odd, NULL); BENCH_DO_NOT_OPTIMIZE(removed); }, typed_array_free(&typed));
+
+    BENCH_OP("drain front    darray_erase(0) loop", fill(&d, values, count),
+        { while (d.count) darray_erase(&d, 0); }, darray_free(&d));
+    BENCH_OP("drain front    darray_swap_remove(0) loop", fill(&d, values, count),
+        { while (d.count) darray_swap_remove(&d, 0); }, darray_free(&d));
+
+    free(values);
+}
+
+
+int main() {
+
+    const size_t counts[] = { 1000, 8 * 1000, 64 * 1000 };
+    for (u32 x = 0; x < sizeof(counts) / sizeof(counts[0]); x++)
+        run(counts[x]);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util/io/logger.h"
+
+#include "bench.h"
+
+
+// Scaling of the LOG hot path with the number of logging threads. Every thread writes into its own staging buffer,
+// so the time per message of a single producer should stay flat while the thread count grows (up to the core count).
+
+#define MESSAGES_PER_THREAD     200000
+#define MAX_THREADS             32
+
+static pthread_barrier_t        s_start;
+
+
+static void* producer(void* arg) {
+    (void)arg;
+
+    LOGGER_REGISTER_THREAD_LABEL("bench producer")
+    pthread_barrier_wait(&s_start);
+    const u64 start = bench_now_ns();
+    for (u32 x = 0; x < MESSAGES_PER_THREAD; x++)
+        LOG(Info, "message %u value %f", x, (f64)x * 0.5)
+
+    const u64 elapsed = bench_now_ns() - start;
+    return (void*)(uintptr_t)elapsed;
+}
+
+
+int main() {
+
+    // BLOCK keeps every message, so the throughput includes the logger thread keeping up
+    logger_set_overflow_policy((logger_overflow_policy){ .mode = LOGGER_OVERFLOW_BLOCK });
+    logger_init("[$B$T$E] $F:$G $C", false, "logs", "bench_logger_threads", false);
+
+    printf("%-8s %16s %16s %16s\n", "threads", "producer ns/msg", "total msg/s", "drain ms");
+    for (u32 thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2) {
+
+        pthread_t threads[MAX_THREADS];
+        pthread_barrier_init(&s_start, NULL, thread_count + 1);
+        for (u32 x = 0; x < thread_count; x++)
+            pthread_create(&threads[x], NULL, producer, NULL);
+
+        pthread_barrier_wait(&s_start);
+        const u64 start = bench_now_ns();
+        u64 producer_ns = 0;
+        for (u32 x = 0; x < thread_count; x++) {
+            void* elapsed;
+            pthread_join(threads[x], &elapsed);
+            producer_ns += (u64)(uintptr_t)elapsed;
+        }
+        const u64 produced = bench_now_ns();
+        logger_flush();                                 // wait until the logger thread wrote everything
+        const u64 end = bench_now_ns();
+        pthread_barrier_destroy(&s_start);
+
+        const f64 messages = (f64)thread_count * MESSAGES_PER_THREAD;
+        printf("%-8u %16.2f %16.0f %16.2f\n", thread_count, (f64)producer_ns / messages, messages / ((f64)(end - start) / 1e9), (f64)(end - produced) / 1e6);
+    }
+
+    logger_shutdown();
+    return 0;
+}
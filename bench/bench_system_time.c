@@ -0,0 +1,53 @@
+
+#include <sys/time.h>
+#include <time.h>
+
+#include "util/system.h"
+
+#include "bench.h"
+
+
+// reference: what get_system_time() did for every log message before the cache
+static system_time get_system_time_uncached() {
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    time_t t = tv.tv_sec;
+    struct tm tm_local;
+    localtime_r(&t, &tm_local);
+
+    system_time out;
+    out.year = tm_local.tm_year + 1900;
+    out.month = tm_local.tm_mon + 1;
+    out.day = tm_local.tm_mday;
+    out.hour = tm_local.tm_hour;
+    out.minute = tm_local.tm_min;
+    out.second = tm_local.tm_sec;
+    out.millisec = (int)(tv.tv_usec / 1000);
+    return out;
+}
+
+
+int main() {
+
+    const u64 iterations = 1000000;
+
+    printf("timestamp per log message (best of 5 x %lu)\n", iterations);
+    BENCH_RUN("gettimeofday + localtime_r (uncached)", 5, iterations, {
+        system_time st = get_system_time_uncached();
+        BENCH_DO_NOT_OPTIMIZE(st);
+    });
+    BENCH_RUN("get_system_time_ns", 5, iterations, {
+        u64 ns = get_system_time_ns();
+        BENCH_DO_NOT_OPTIMIZE(ns);
+    });
+    BENCH_RUN("system_time_from_ns (cached)", 5, iterations, {
+        system_time st = system_time_from_ns(get_system_time_ns());
+        BENCH_DO_NOT_OPTIMIZE(st);
+    });
+    BENCH_RUN("get_system_time", 5, iterations, {
+        system_time st = get_system_time();
+        BENCH_DO_NOT_OPTIMIZE(st);
+    });
+    return 0;
+}
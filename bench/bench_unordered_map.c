@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/data_structure/unordered_map.h"
+#include "util/data_structure/hash_map_template.h"
+
+#include "bench.h"
+
+
+// unordered_map (open addressing, control byte groups) against the chained map it replaced, with u64 keys stored by pointer
+// (u64_hash / u64_compare) and keys that are the pointer itself (ptr_hash / ptr_compare). Lookups use a shuffled key order.
+// The typed rows use DEFINE_HASHMAP with the u64 key stored by value.
+
+DEFINE_HASHMAP(typed_map, u64, u64, hash_u64, HASH_EQ_VALUE)
+
+
+// ============================================================================================================================================
+// reference: the previous chained implementation (one malloc'ed node per entry, % per lookup, hash and compare through pointers)
+// ============================================================================================================================================
+
+typedef struct chained_node {
+    void*                   key;
+    void*                   value;
+    struct chained_node*    next;
+} chained_node;
+
+typedef struct {
+    chained_node**          buckets;
+    size_t                  size;
+    size_t                  cap;
+    hash_func               hash_fn;
+    key_compare_func        key_cmp_fn;
+} chained_map;
+
+
+static void chained_init(chained_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn) {
+
+    *map = (chained_map){ .buckets = calloc(capacity, sizeof(chained_node*)), .cap = capacity, .hash_fn = hash_fn, .key_cmp_fn = key_cmp_fn };
+}
+
+
+static void chained_free(chained_map* map) {
+
+    for (size_t i = 0; i < map->cap; i++) {
+        chained_node* current = map->buckets[i];
+        while (current) {
+            chained_node* next = current->next;
+            free(current);
+            current = next;
+        }
+    }
+    free(map->buckets);
+}
+
+
+static void chained_resize(chained_map* map) {
+
+    const size_t new_capacity = map->cap * 2;
+    chained_node** new_buckets = calloc(new_capacity, sizeof(chained_node*));
+    for (size_t i = 0; i < map->cap; i++) {
+        chained_node* current = map->buckets[i];
+        while (current) {
+            chained_node* next = current->next;
+            const size_t index = map->hash_fn(current->key) % new_capacity;
+            current->next = new_buckets[index];
+            new_buckets[index] = current;
+            current = next;
+        }
+    }
+    free(map->buckets);
+    map->buckets = new_buckets;
+    map->cap = new_capacity;
+}
+
+
+static void chained_insert(chained_map* map, void* key, void* value) {
+
+    if ((double)map->size / map->cap > 0.75)
+        chained_resize(map);
+
+    const size_t index = map->hash_fn(key) % map->cap;
+    for (chained_node* current = map->buckets[index]; current; current = current->next) {
+        if (map->key_cmp_fn(current->key, key) == 0) {
+            current->value = value;
+            return;
+        }
+    }
+    chained_node* node = malloc(sizeof(chained_node));
+    *node = (chained_node){ .key = key, .value = value, .next = map->buckets[index] };
+    map->buckets[index] = node;
+    map->size++;
+}
+
+
+static void* chained_find(const chained_map* map, const void* key) {
+
+    for (chained_node* current = map->buckets[map->hash_fn(key) % map->cap]; current; current = current->next)
+        if (map->key_cmp_fn(current->key, key) == 0)
+            return current->value;
+    return NULL;
+}
+
+
+static void chained_erase(chained_map* map, const void* key) {
+
+    chained_node** link = &map->buckets[map->hash_fn(key) % map->cap];
+    while (*link) {
+        if (map->key_cmp_fn((*link)->key, key) == 0) {
+            chained_node* node = *link;
+            *link = node->next;
+            free(node);
+            map->size--;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+
+// ============================================================================================================================================
+// benchmark
+// ============================================================================================================================================
+
+#define REPETITIONS             5
+
+// Best time per operation of [repetitions] runs of [body] over all [count] keys, [setup] and [teardown] are not timed
+#define BENCH_PASS(name, count, setup, body, teardown)                                                  \
+    do {                                                                                                \
+        f64 best_ns = 1e30;                                                                             \
+        for (u32 bench_rep = 0; bench_rep < REPETITIONS; bench_rep++) {                                 \
+            setup;                                                                                      \
+            const u64 bench_start = bench_now_ns();                                                     \
+            for (size_t i = 0; i < (count); i++) { body; }                                              \
+            const f64 bench_ns = (f64)(bench_now_ns() - bench_start) / (f64)(count);                    \
+            if (bench_ns < best_ns) best_ns = bench_ns;                                                 \
+            teardown;                                                                                   \
+        }                                                                                               \
+        printf("    %-44s %10.2f ns/op\n", name, best_ns);                                              \
+    } while (0)
+
+
+// Slowest single call of [body] over all [count] keys (lowest of [repetitions] runs, to filter out preemption), the growth of a map
+// shows up here
+#define BENCH_WORST(name, count, setup, body, teardown)                                                 \
+    do {                                                                                                \
+        u64 best_worst_ns = (u64)-1;                                                                    \
+        for (u32 bench_rep = 0; bench_rep < REPETITIONS; bench_rep++) {                                 \
+            u64 worst_ns = 0;                                                                           \
+            setup;                                                                                      \
+            for (size_t i = 0; i < (count); i++) {                                                      \
+                const u64 bench_start = bench_now_ns();                                                 \
+                body;                                                                                   \
+                const u64 bench_ns = bench_now_ns() - bench_start;                                      \
+                if (bench_ns > worst_ns) worst_ns = bench_ns;                                           \
+            }                                                                                           \
+            teardown;                                                                                   \
+            if (worst_ns < best_worst_ns) best_worst_ns = worst_ns;                                     \
+        }                                                                                               \
+        printf("    %-44s %10.2f us worst\n", name, (f64)best_worst_ns / 1e3);                          \
+    } while (0)
+
+
+static u64 s_random_state = 0x2545F4914F6CDD1DULL;
+
+static u64 next_random() {
+
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 7;
+    s_random_state ^= s_random_state << 17;
+    return s_random_state;
+}
+
+
+static void run(const size_t count, const b8 pointer_keys) {
+
+    hash_func hash_fn = pointer_keys ? ptr_hash : u64_hash;
+    key_compare_func key_cmp_fn = pointer_keys ? ptr_compare : u64_compare;
+
+    // [keys] are inserted, [missing] never are. Pointer keys are the (aligned) values themselves
+    u64* keys = malloc(count * sizeof(u64));
+    u64* missing = malloc(count * sizeof(u64));
+    void** key_ptrs = malloc(count * sizeof(void*));
+    void** missing_ptrs = malloc(count * sizeof(void*));
+    size_t* order = malloc(count * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = next_random() & ~7ULL;
+        missing[i] = next_random() | 1;
+        order[i] = i;
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        const size_t j = next_random() % (i + 1);
+        const size_t swap = order[i]; order[i] = order[j]; order[j] = swap;
+    }
+    for (size_t i = 0; i < count; i++) {
+        key_ptrs[i] = pointer_keys ? (void*)(uintptr_t)keys[i] : (void*)&keys[i];
+        missing_ptrs[i] = pointer_keys ? (void*)(uintptr_t)missing[i] : (void*)&missing[i];
+    }
+
+    printf("%zu entries, %s keys\n", count, pointer_keys ? "pointer" : "u64");
+
+    unordered_map map = {0};
+    chained_map chained = {0};
+    typed_map typed = {0};
+    void* value = NULL;
+    u64* typed_value = NULL;
+
+    BENCH_PASS("chained     insert (growing from 16)", count, chained_init(&chained, 16, hash_fn, key_cmp_fn),
+        chained_insert(&chained, key_ptrs[i], key_ptrs[i]), chained_free(&chained));
+    BENCH_PASS("open addr.  insert (growing from 16)", count, u_map_init(&map, 16, hash_fn, key_cmp_fn),
+        u_map_insert(&map, key_ptrs[i], key_ptrs[i]), u_map_free(&map));
+    BENCH_PASS("open addr.  insert (presized)", count, u_map_init(&map, count, hash_fn, key_cmp_fn),
+        u_map_insert(&map, key_ptrs[i], key_ptrs[i]), u_map_free(&map));
+    BENCH_PASS("typed       insert (growing from 16)", count, typed_map_init(&typed, 16),
+        typed_map_insert(&typed, keys[i], keys[i]), typed_map_free(&typed));
+    BENCH_WORST("chained     insert (growing from 16)", count, chained_init(&chained, 16, hash_fn, key_cmp_fn),
+        chained_insert(&chained, key_ptrs[i], key_ptrs[i]), chained_free(&chained));
+    BENCH_WORST("open addr.  insert (growing from 16)", count, u_map_init(&map, 16, hash_fn, key_cmp_fn),
+        u_map_insert(&map, key_ptrs[i], key_ptrs[i]), u_map_free(&map));
+    BENCH_WORST("open addr.  insert (u_map_reserve)", count, { u_map_init(&map, 16, hash_fn, key_cmp_fn); u_map_reserve(&map, count); },
+        u_map_insert(&map, key_ptrs[i], key_ptrs[i]), u_map_free(&map));
+
+    chained_init(&chained, 16, hash_fn, key_cmp_fn);
+    u_map_init(&map, 16, hash_fn, key_cmp_fn);
+    typed_map_init(&typed, 16);
+    for (size_t i = 0; i < count; i++) {
+        chained_insert(&chained, key_ptrs[i], key_ptrs[i]);
+        u_map_insert(&map, key_ptrs[i], key_ptrs[i]);
+        typed_map_insert(&typed, keys[i], keys[i]);
+    }
+
+    BENCH_PASS("chained     find (hit)", count, , { value = chained_find(&chained, key_ptrs[order[i]]); BENCH_DO_NOT_OPTIMIZE(value); }, );
+    BENCH_PASS("open addr.  find (hit)", count, , { u_map_find(&map, key_ptrs[order[i]], &value); BENCH_DO_NOT_OPTIMIZE(value); }, );
+    BENCH_PASS("typed       find (hit)", count, , { typed_value = typed_map_get(&typed, keys[order[i]]); BENCH_DO_NOT_OPTIMIZE(typed_value); }, );
+    BENCH_PASS("chained     find (miss)", count, , { value = chained_find(&chained, missing_ptrs[i]); BENCH_DO_NOT_OPTIMIZE(value); }, );
+    BENCH_PASS("open addr.  find (miss)", count, , { u_map_find(&map, missing_ptrs[i], &value); BENCH_DO_NOT_OPTIMIZE(value); }, );
+    BENCH_PASS("typed       find (miss)", count, , { typed_value = typed_map_get(&typed, missing[i]); BENCH_DO_NOT_OPTIMIZE(typed_value); }, );
+    chained_free(&chained);
+    u_map_free(&map);
+    typed_map_free(&typed);
+
+    BENCH_PASS("chained     erase", count,
+        { chained_init(&chained, 16, hash_fn, key_cmp_fn); for (size_t x = 0; x < count; x++) chained_insert(&chained, key_ptrs[x], key_ptrs[x]); },
+        chained_erase(&chained, key_ptrs[order[i]]), chained_free(&chained));
+    BENCH_PASS("open addr.  erase", count,
+        { u_map_init(&map, 16, hash_fn, key_cmp_fn); for (size_t x = 0; x < count; x++) u_map_insert(&map, key_ptrs[x], key_ptrs[x]); },
+        u_map_erase(&map, key_ptrs[order[i]]), u_map_free(&map));
+
+    free(keys);
+    free(missing);
+    free(key_ptrs);
+    free(missing_ptrs);
+    free(order);
+}
+
+
+// A map of [count] string keys built and discarded every frame. The caller either keeps every key alive itself (strdup / free) or the
+// map copies the keys into its pages and u_map_clear keeps table and pages for the next frame
+static void run_frames(const size_t count) {
+
+    char (*names)[24] = malloc(count * sizeof(*names));
+    for (size_t i = 0; i < count; i++)
+        snprintf(names[i], sizeof(names[i]), "entity_%zu_%llu", i, (unsigned long long)(next_random() % 1000));
+
+    printf("%zu string keys per frame\n", count);
+
+    unordered_map map = {0};
+    char** copies = malloc(count * sizeof(char*));
+    BENCH_PASS("strdup keys, init / free per frame", 1,
+        ,
+        {
+            u_map_init(&map, 16, string_hash, string_compare);
+            for (size_t x = 0; x < count; x++) {
+                copies[x] = strdup(names[x]);
+                u_map_insert(&map, copies[x], copies[x]);
+            }
+            u_map_free(&map);
+            for (size_t x = 0; x < count; x++)
+                free(copies[x]);
+        },
+        );
+
+    u_map_init(&map, 16, string_hash, string_compare);
+    BENCH_PASS("u_map_insert_copy, u_map_clear per frame", 1,
+        ,
+        {
+            for (size_t x = 0; x < count; x++)
+                u_map_insert_copy(&map, names[x], strlen(names[x]) + 1, names[x]);
+            u_map_clear(&map);
+        },
+        );
+    printf("    (%zu key pages after all frames)\n", map.keys.page_count);
+    u_map_free(&map);
+
+    free(copies);
+    free(names);
+}
+
+
+int main() {
+
+    const size_t counts[] = { 1000, 64 * 1000, 1000 * 1000 };
+    for (u32 x = 0; x < sizeof(counts) / sizeof(counts[0]); x++) {
+        run(counts[x], false);
+        run(counts[x], true);
+    }
+    run_frames(4096);
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/io/logger.h"
+#include "util/system.h"
+
+#include "bench.h"
+
+
+// Throughput and latency of the logger for a matrix of thread counts, message sizes, formats and console on/off.
+// Prints one CSV row per configuration to stdout, so results of different commits can be collected and compared:
+//
+//      logger_bench    [messages_per_thread] [max_threads] > mt.csv         USE_MULTI_THREADING 1
+//      logger_bench_st [messages_per_thread] [max_threads] > st.csv         USE_MULTI_THREADING 0 (same columns)
+//
+//  producer latency    time of a single LOG call on the logging thread (includes one clock read)
+//  consumer lag        time from the timestamp of a message until a callback sink sees it
+//  drain               time logger_flush() needs after the last producer finished
+//
+// The console sink writes to /dev/null (the CSV goes to a duplicate of stdout), so it measures formatting and writing but not a terminal.
+
+#ifndef USE_MULTI_THREADING
+    #define USE_MULTI_THREADING     1
+#endif
+
+#define DEFAULT_MESSAGES_PER_THREAD 50000
+#define DEFAULT_MAX_THREADS         8
+#define MAX_THREADS                 64
+
+static const u32                    c_message_sizes[] = { 16, 256, 2048 };
+static const struct {
+    const char*                     name;
+    const char*                     format;
+} c_formats[] = {
+    { "message",    "$C" },
+    { "default",    "[$B$T.$J $L$E][$B$Q $I $F:$G$E] $C" },
+    { "full",       "$N $T.$J $L [$Q] $A:$G $F: $C" },
+};
+
+
+typedef struct {
+    pthread_t                       thread;
+    u32                             message_count;
+    const char*                     payload;
+    u64*                            latencies;          // ns per LOG call
+} producer_data;
+
+static pthread_barrier_t            s_start;
+
+// written by the callback sink, on the logger thread or (USE_MULTI_THREADING 0) on the producers
+static u64*                         s_lag_samples;
+static u64                          s_lag_capacity;
+static atomic_ullong                s_lag_count;
+
+
+static void record_lag(const log_entry* entry, void* user_data) {
+    (void)user_data;
+
+    const u64 now = get_system_time_ns();
+    const u64 index = atomic_fetch_add_explicit(&s_lag_count, 1, memory_order_relaxed);
+    if (index < s_lag_capacity)
+        s_lag_samples[index] = (now > entry->timestamp_ns) ? now - entry->timestamp_ns : 0;
+}
+
+
+static void* producer(void* arg) {
+
+    producer_data* data = arg;
+    LOGGER_REGISTER_THREAD_LABEL("bench producer")
+    pthread_barrier_wait(&s_start);
+
+    for (u32 x = 0; x < data->message_count; x++) {
+        const u64 start = bench_now_ns();
+        LOG(Info, "bench %u %s", x, data->payload)
+        data->latencies[x] = bench_now_ns() - start;
+    }
+
+    logger_remove_thread_label_by_id(pthread_self());
+    return NULL;
+}
+
+
+static int compare_u64(const void* a, const void* b) {
+
+    const u64 left = *(const u64*)a;
+    const u64 right = *(const u64*)b;
+    return (left > right) - (left < right);
+}
+
+
+// Returns the value at [percent] (0 - 100) of already sorted samples
+static u64 percentile(const u64* sorted, const u64 count, const f64 percent) {
+
+    if (count == 0)
+        return 0;
+    const u64 index = (u64)((f64)count * percent / 100.0);
+    return sorted[(index < count) ? index : count - 1];
+}
+
+
+static u64 count_dropped() {
+
+    u64 counts[LOG_TYPE_FATAL + 1];
+    logger_get_dropped_messages(counts);
+    u64 total = 0;
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++)
+        total += counts[x];
+    return total;
+}
+
+
+static void run(FILE* csv, const u32 thread_count, const u32 messages_per_thread, const u32 message_size, const u32 format, const b8 console) {
+
+    logger_set_format(c_formats[format].format);
+    u32 console_sink = 0;
+    if (console)
+        logger_add_sink(&(log_sink_config){ .type = LOG_SINK_CONSOLE, .min_level = LOG_TYPE_TRACE, .use_colors = true }, &console_sink);
+
+    char* payload = malloc(message_size + 1);
+    memset(payload, 'x', message_size);
+    payload[message_size] = '\0';
+
+    const u64 total = (u64)thread_count * messages_per_thread;
+    u64* latencies = malloc(total * sizeof(u64));
+    s_lag_capacity = total;
+    atomic_store(&s_lag_count, 0);
+
+    producer_data producers[MAX_THREADS];
+    const u64 dropped_before = count_dropped();
+    pthread_barrier_init(&s_start, NULL, thread_count + 1);
+    for (u32 x = 0; x < thread_count; x++) {
+        producers[x] = (producer_data){ .message_count = messages_per_thread, .payload = payload, .latencies = latencies + (u64)x * messages_per_thread };
+        pthread_create(&producers[x].thread, NULL, producer, &producers[x]);
+    }
+
+    pthread_barrier_wait(&s_start);
+    const u64 start = bench_now_ns();
+    for (u32 x = 0; x < thread_count; x++)
+        pthread_join(producers[x].thread, NULL);
+    const u64 produced = bench_now_ns();
+    logger_flush();
+    const u64 end = bench_now_ns();
+    pthread_barrier_destroy(&s_start);
+
+    const u64 lag_count = (atomic_load(&s_lag_count) < total) ? atomic_load(&s_lag_count) : total;
+    qsort(latencies, total, sizeof(u64), compare_u64);
+    qsort(s_lag_samples, lag_count, sizeof(u64), compare_u64);
+
+    fprintf(csv, "%d,%u,%u,%s,%d,%llu,%.4f,%.0f,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f,%.1f,%.3f,%llu\n",
+        USE_MULTI_THREADING, thread_count, message_size, c_formats[format].name, console, (unsigned long long)total,
+        (f64)(end - start) / 1e9, (f64)total / ((f64)(end - start) / 1e9),
+        (unsigned long long)percentile(latencies, total, 50.0), (unsigned long long)percentile(latencies, total, 99.0),
+        (unsigned long long)percentile(latencies, total, 99.9), (unsigned long long)latencies[total - 1],
+        (f64)percentile(s_lag_samples, lag_count, 50.0) / 1e3, (f64)percentile(s_lag_samples, lag_count, 99.0) / 1e3,
+        (f64)percentile(s_lag_samples, lag_count, 99.9) / 1e3, lag_count ? (f64)s_lag_samples[lag_count - 1] / 1e3 : 0.0,
+        (f64)(end - produced) / 1e6, (unsigned long long)(count_dropped() - dropped_before));
+    fflush(csv);
+
+    if (console)
+        logger_remove_sink(console_sink);
+    free(latencies);
+    free(payload);
+}
+
+
+int main(int argc, char** argv) {
+
+    const u32 messages_per_thread = (argc > 1) ? (u32)strtoul(argv[1], NULL, 10) : DEFAULT_MESSAGES_PER_THREAD;
+    u32 max_threads = (argc > 2) ? (u32)strtoul(argv[2], NULL, 10) : DEFAULT_MAX_THREADS;
+    max_threads = (max_threads > MAX_THREADS) ? MAX_THREADS : max_threads;
+    if (messages_per_thread == 0 || max_threads == 0) {
+        fprintf(stderr, "usage: %s [messages_per_thread] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    // the CSV keeps the real stdout, the console sink writes to /dev/null
+    FILE* csv = fdopen(dup(STDOUT_FILENO), "w");
+    const int null_fd = open("/dev/null", O_WRONLY);
+    if (!csv || null_fd < 0)
+        return 1;
+    fflush(stdout);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    s_lag_samples = malloc((u64)max_threads * messages_per_thread * sizeof(u64));
+
+    // BLOCK keeps every message, so throughput and lag include the logger keeping up
+    logger_set_overflow_policy((logger_overflow_policy){ .mode = LOGGER_OVERFLOW_BLOCK });
+    logger_init(c_formats[0].format, false, "logs", "logger_bench", false);
+    logger_add_sink(&(log_sink_config){ .type = LOG_SINK_CALLBACK, .min_level = LOG_TYPE_TRACE, .callback = record_lag }, NULL);
+
+    fprintf(csv, "multi_threading,threads,message_bytes,format,console,messages,seconds,messages_per_s,"
+        "latency_p50_ns,latency_p99_ns,latency_p999_ns,latency_max_ns,lag_p50_us,lag_p99_us,lag_p999_us,lag_max_us,drain_ms,dropped\n");
+
+    for (u32 console = 0; console <= 1; console++)
+        for (u32 format = 0; format < sizeof(c_formats) / sizeof(c_formats[0]); format++)
+            for (u32 size = 0; size < sizeof(c_message_sizes) / sizeof(c_message_sizes[0]); size++)
+                for (u32 thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+                    run(csv, thread_count, messages_per_thread, c_message_sizes[size], format, console);
+
+    logger_shutdown();
+    free(s_lag_samples);
+    fclose(csv);
+    return 0;
+}
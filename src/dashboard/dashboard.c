@@ -7,18 +7,23 @@
 #include "util/io/logger.h"
 #include "imgui_config/imgui_config.h"
 #include "render/image.h"
+#include "util/UI/log_viewer.h"
 
 #include "dashboard.h"
 
 
 static bool showDemoWindow = true;
 static bool showAnotherWindow = false;
+static bool showLogViewer = true;
+static log_viewer s_log_viewer = {0};
 image_t test_image = {0};
 
 
 //
 b8 dashboard_init() {
 
+    VALIDATE(log_viewer_init(&s_log_viewer, NULL) == AT_SUCCESS, , "", "Failed to create the log viewer");
+
     char exe_path[1024] = {0};
     get_executable_path(exe_path, sizeof(exe_path));
     char image_path[2048] = {0};
@@ -33,6 +38,7 @@ b8 dashboard_init() {
 void dashboard_shutdown() {
 
     LOG_SHUTDOWN
+    log_viewer_shutdown(&s_log_viewer);
 }
 
 //
@@ -40,7 +46,10 @@ void dashboard_on_crash() { LOG(Debug, "User crash_callback")}
 
 
 //
-void dashboard_update(__attribute_maybe_unused__ const f32 delta_time) { }
+void dashboard_update(__attribute_maybe_unused__ const f32 delta_time) {
+
+    log_viewer_update(&s_log_viewer);
+}
 
 //
 void dashboard_draw(__attribute_maybe_unused__ const f32 delta_time) {
@@ -57,6 +66,7 @@ void dashboard_draw(__attribute_maybe_unused__ const f32 delta_time) {
         igText("This is some useful text");
         igCheckbox("Demo window", &showDemoWindow);
         igCheckbox("Another window", &showAnotherWindow);
+        igCheckbox("Log viewer", &showLogViewer);
 
         igSliderFloat("Float", &f, 0.0f, 1.0f, "%.3f", 0);
         igColorEdit3("clear color", (float *)imgui_config_get_clear_color_ptr(), 0);
@@ -78,6 +88,9 @@ void dashboard_draw(__attribute_maybe_unused__ const f32 delta_time) {
         igEnd();
     }
 
+    if (showLogViewer)
+        log_viewer_draw(&s_log_viewer, "Log", &showLogViewer);
+
     if (showAnotherWindow) {
         igBegin("imgui Another Window", &showAnotherWindow, 0);
         igText("Hello from imgui");
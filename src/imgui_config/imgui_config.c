@@ -9,7 +9,7 @@
 #include "util/io/logger.h"
 #include "util/core_config.h"
 #include "util/data_structure/data_types.h"
-#include "util/data_structure/unordered_map.h"
+#include "util/data_structure/hash_map_template.h"
 #include "util/system.h"
 #include "platform/window.h"
 
@@ -19,7 +19,9 @@
 
 static ImVec4 s_clear_color;
 
-static unordered_map s_font_map;
+DEFINE_HASHMAP(font_map, font_type, ImFont*, hash_u32, HASH_EQ_VALUE)
+
+static font_map s_font_map;
 f32 g_font_size = 15.f;
 f32 g_big_font_size = 18.f;
 f32 g_font_size_header_0 = 19.f;
@@ -31,11 +33,8 @@ static ImGuiContext* s_context_imgui = NULL;
 
 ImFont* imgui_config_get_font(const font_type type) {
     
-    void* value = NULL;
-    if (u_map_find(&s_font_map, (void*)(uintptr_t)type, &value) == AT_SUCCESS)
-        return value;
-
-    return NULL;
+    ImFont** font = font_map_get(&s_font_map, type);
+    return font ? *font : NULL;
 }
 
 char* format_path(const char* format, const char* path) {
@@ -59,8 +58,8 @@ void load_fonts() {
     ImFontAtlas_Clear(atlas);
     
     // Clear our font map
-    u_map_free(&s_font_map);                                // if not init it will just return a AT_NOT_INITIALIZED
-    u_map_init(&s_font_map, 16, ptr_hash, ptr_compare);
+    font_map_free(&s_font_map);                             // if not init it will just return a AT_NOT_INITIALIZED
+    font_map_init(&s_font_map, 16);
     
     // Get base path (implementation specific - you'll need to implement this)
     char base_path[PATH_MAX] = {0};
@@ -75,7 +74,7 @@ void load_fonts() {
     // Load fonts and store in map
     #define LOAD_FONT(path, font_path, size, type)                                                          \
         font = ImFontAtlas_AddFontFromFileTTF(atlas, format_path(path, font_path), size, NULL, NULL);       \
-        u_map_insert(&s_font_map, (void*)(uintptr_t)type, font);
+        font_map_insert(&s_font_map, type, font);
 
     // Regular fonts
     LOAD_FONT("%s/OpenSans-Regular.ttf", open_sans_path, g_font_size, FT_REGULAR)
@@ -100,9 +99,9 @@ void load_fonts() {
 #undef LOAD_FONT
 
     // Set default font
-    void* default_font;
-    if (u_map_find(&s_font_map, (void*)(uintptr_t)FT_REGULAR, &default_font) == AT_SUCCESS) {
-        io->FontDefault = (ImFont*)default_font;
+    ImFont* default_font;
+    if (font_map_find(&s_font_map, FT_REGULAR, &default_font) == AT_SUCCESS) {
+        io->FontDefault = default_font;
     }
     
 }
@@ -6,10 +6,11 @@
 
 int main(int argc, char *argv[]) {
 
+    logger_load_settings("config", "app_settings.yml");                                                        // rotation of the log file, keeps defaults if missing
     ASSERT_SS(logger_init("[$B$T.$J $L$E][$B$Q $I $F:$G$E] $C", true, "logs", "application", false))            // logger should be external to application
     LOGGER_REGISTER_THREAD_LABEL("main")
     ASSERT_SS(crash_handler_init())
-    crash_handler_subscribe_callback(logger_shutdown);
+    crash_handler_subscribe_callback(logger_on_crash);                                                         // signal-safe, keeps queued messages
 
     
     VALIDATE(application_init(argc, argv), logger_shutdown(); return 1, "", "Failed to init the application")
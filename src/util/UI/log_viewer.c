@@ -0,0 +1,530 @@
+#define _GNU_SOURCE                 // strcasestr
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <cimgui.h>
+
+#include "util/system.h"
+
+#include "log_viewer.h"
+
+
+#define SCAN_TIME_BUDGET            0.004           // seconds of filtering per frame, the rest continues on the next frame
+#define SCAN_CHECK_INTERVAL         1024            // lines tested between two looks at the clock
+#define COMPACT_THRESHOLD           4096            // dropped entries at the front of [matches] before they are removed
+#define INDEX_BLOCK_LINES           64              // lines summarized by one block of the search index
+#define INDEX_BLOCK_BITS_LOG2       13              // 8192 trigram bits (1 KiB) per block
+#define INDEX_BLOCK_WORDS           ((1 << INDEX_BLOCK_BITS_LOG2) / 64)
+
+static const char*                  c_level_names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+static const ImVec4                 c_level_colors[] = {
+    { 0.55f, 0.55f, 0.55f, 1.0f },                  // TRACE
+    { 0.45f, 0.65f, 1.00f, 1.0f },                  // DEBUG
+    { 0.85f, 0.85f, 0.85f, 1.0f },                  // INFO
+    { 1.00f, 0.80f, 0.30f, 1.0f },                  // WARN
+    { 1.00f, 0.40f, 0.35f, 1.0f },                  // ERROR
+    { 1.00f, 0.20f, 0.60f, 1.0f },                  // FATAL
+};
+
+
+// ============================================================================================================================================
+// storage
+// ============================================================================================================================================
+
+static inline log_viewer_line* get_line(const log_viewer* viewer, const u64 line) { return &viewer->lines[line % viewer->max_lines]; }
+
+static inline u64* get_index_block(const log_viewer* viewer, const u64 block) { return &viewer->search_index[(block % viewer->index_blocks) * INDEX_BLOCK_WORDS]; }
+
+// Adds the next character to a rolling key of the last three lowercase characters
+static inline u32 push_trigram_key(const u32 key, const char c) { return ((key << 8) | (u8)tolower((unsigned char)c)) & 0xFFFFFF; }
+
+static inline u32 get_trigram_bit(const u32 key) { return (key * 2654435761u) >> (32 - INDEX_BLOCK_BITS_LOG2); }
+
+
+// Records the trigrams of a new line in the block of the search index it belongs to, the first line of a block resets it.
+// The ring holds enough blocks that a block is only reused after all of its lines are dropped
+static void index_line(log_viewer* viewer, const u64 line_number, const char* text, const u32 length) {
+
+    u64* block = get_index_block(viewer, line_number / INDEX_BLOCK_LINES);
+    if (line_number % INDEX_BLOCK_LINES == 0)
+        memset(block, 0, INDEX_BLOCK_WORDS * sizeof(u64));
+
+    u32 key = 0;
+    for (u32 x = 0; x < length; x++) {
+        key = push_trigram_key(key, text[x]);
+        if (x >= 2) {
+            const u32 bit = get_trigram_bit(key);
+            block[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+}
+
+// Removes the entries of [matches] that refer to dropped lines once enough of them piled up at the front
+static void compact_matches(log_viewer* viewer) {
+
+    u64* matches = viewer->matches.data;
+    while (viewer->match_head < viewer->matches.count && matches[viewer->match_head] < viewer->first_line)
+        viewer->match_head++;
+
+    if (viewer->match_head < COMPACT_THRESHOLD || viewer->match_head < viewer->matches.count / 2)
+        return;
+
+    const size_t remaining = viewer->matches.count - viewer->match_head;
+    memmove(matches, matches + viewer->match_head, remaining * sizeof(u64));
+    viewer->matches.count = remaining;
+    viewer->match_head = 0;
+}
+
+
+static void drop_oldest_line(log_viewer* viewer) {
+
+    viewer->first_line++;
+    if (viewer->scan_line < viewer->first_line)
+        viewer->scan_line = viewer->first_line;
+}
+
+
+// @return The entry of the thread, LOG_VIEWER_UNKNOWN_THREAD if no new entry can be added
+static u16 find_thread(log_viewer* viewer, const pthread_t thread_id, const char* label) {
+
+    if (viewer->threads.count > 1 && pthread_equal(viewer->last_thread_id, thread_id))     // the cache is only set once a real thread was seen
+        return viewer->last_thread;
+
+    u16 index = LOG_VIEWER_UNKNOWN_THREAD + 1;
+    for (; index < viewer->threads.count; index++)
+        if (pthread_equal(darray_at(&viewer->threads, log_viewer_thread, index).thread_id, thread_id))
+            break;
+
+    if (index == viewer->threads.count) {
+        if (index >= LOG_VIEWER_MAX_THREADS)
+            index = LOG_VIEWER_UNKNOWN_THREAD;
+        else {
+            log_viewer_thread thread = { .thread_id = thread_id, .shown = true, .applied_shown = true };
+            if (label)
+                snprintf(thread.label, sizeof(thread.label), "%s", label);
+            else
+                snprintf(thread.label, sizeof(thread.label), "%llu", (unsigned long long)thread_id);
+            if (darray_push_back(&viewer->threads, &thread) != AT_SUCCESS)
+                index = LOG_VIEWER_UNKNOWN_THREAD;
+        }
+    }
+
+    viewer->last_thread_id = thread_id;
+    viewer->last_thread = index;
+    return index;
+}
+
+
+// Copies one message into the text ring, lines whose text is overwritten are dropped
+static void store_entry(const log_entry* entry, void* user_data) {
+
+    log_viewer* viewer = user_data;
+    u32 length = entry->length;
+    while (length && (entry->text[length - 1] == '\n' || entry->text[length - 1] == '\r'))
+        length--;
+    if (length > LOG_VIEWER_MAX_LINE_LENGTH - 1)
+        length = LOG_VIEWER_MAX_LINE_LENGTH - 1;
+
+    // lines are stored contiguous, skip the rest of the ring if the line does not fit before the end
+    u64 position = viewer->text_head;
+    const u64 offset = position % viewer->text_capacity;
+    if (offset + length + 1 > viewer->text_capacity)
+        position += viewer->text_capacity - offset;
+    viewer->text_head = position + length + 1;
+
+    if (viewer->line_count - viewer->first_line == viewer->max_lines)
+        drop_oldest_line(viewer);
+    while (viewer->first_line < viewer->line_count && get_line(viewer, viewer->first_line)->text_position + viewer->text_capacity < viewer->text_head)
+        drop_oldest_line(viewer);
+
+    char* text = viewer->text + (position % viewer->text_capacity);
+    for (u32 x = 0; x < length; x++) {                  // one line per message, control characters would break the row layout
+        const char c = entry->text[x];
+        text[x] = (c == '\n' || c == '\r' || c == '\t') ? ' ' : c;
+    }
+    text[length] = '\0';
+    index_line(viewer, viewer->line_count, text, length);
+
+    *get_line(viewer, viewer->line_count) = (log_viewer_line){
+        .timestamp_ns = entry->timestamp_ns,
+        .text_position = position,
+        .text_length = length,
+        .thread = find_thread(viewer, entry->thread_id, entry->thread_label),
+        .level = entry->site ? (u8)entry->site->type : (u8)LOG_TYPE_INFO,
+    };
+    viewer->line_count++;
+}
+
+
+// ============================================================================================================================================
+// filter
+// ============================================================================================================================================
+
+static inline b8 line_matches(const log_viewer* viewer, const u64 line_number) {
+
+    const log_viewer_line* line = get_line(viewer, line_number);
+    if (!viewer->applied_show_level[line->level])
+        return false;
+    if (!darray_at(&viewer->threads, log_viewer_thread, line->thread).applied_shown)
+        return false;
+    return viewer->applied_search[0] == '\0' || strcasestr(viewer->text + (line->text_position % viewer->text_capacity), viewer->applied_search);
+}
+
+
+// @return False if no line of the block can contain the applied search text, searches shorter than a trigram match every block
+static inline b8 block_may_match(const log_viewer* viewer, const u64 block) {
+
+    const u64* bits = get_index_block(viewer, block);
+    for (u32 x = 0; x < viewer->search_trigram_count; x++) {
+        const u32 bit = viewer->search_trigrams[x];
+        if (!(bits[bit / 64] & (1ULL << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+
+// Compares the edited filter with the applied one
+// @return 0 if unchanged, 1 if every line passing the edited filter also passes the applied one, 2 otherwise
+static u32 compare_filter(const log_viewer* viewer) {
+
+    b8 changed = false;
+    b8 narrower = true;
+
+    if (strcmp(viewer->search, viewer->applied_search) != 0) {
+        changed = true;
+        narrower &= (strcasestr(viewer->search, viewer->applied_search) != NULL);
+    }
+
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++) {
+        if (viewer->show_level[x] != viewer->applied_show_level[x]) {
+            changed = true;
+            narrower &= !viewer->show_level[x];
+        }
+    }
+
+    for (u32 x = 0; x < viewer->threads.count; x++) {
+        const log_viewer_thread* thread = &darray_at(&viewer->threads, log_viewer_thread, x);
+        if (thread->shown != thread->applied_shown) {
+            changed = true;
+            narrower &= !thread->shown;
+        }
+    }
+
+    return changed ? (narrower ? 1 : 2) : 0;
+}
+
+
+static void apply_filter(log_viewer* viewer) {
+
+    const u32 change = compare_filter(viewer);
+    if (change == 0)
+        return;
+
+    b8 rescan = (change == 2);
+    if (!rescan) {
+        // only re-test what passed the old filter: the verified matches followed by the candidates of a narrowing that is still running
+        const size_t pending = viewer->narrow_source.count - viewer->narrow_position;
+        const size_t count = viewer->matches.count;
+        if (pending && log_viewer_line_array_reserve(&viewer->matches, count + pending) != AT_SUCCESS)
+            rescan = true;
+        else {
+            memcpy(viewer->matches.data + count, viewer->narrow_source.data + viewer->narrow_position, pending * sizeof(u64));
+            viewer->matches.count = count + pending;
+            const log_viewer_line_array swap = viewer->narrow_source;
+            viewer->narrow_source = viewer->matches;
+            viewer->matches = swap;
+            viewer->narrow_position = viewer->match_head;
+            viewer->match_head = 0;
+            log_viewer_line_array_clear(&viewer->matches);
+        }
+    }
+
+    if (rescan) {
+        log_viewer_line_array_clear(&viewer->matches);
+        log_viewer_line_array_clear(&viewer->narrow_source);
+        viewer->match_head = 0;
+        viewer->narrow_position = 0;
+        viewer->scan_line = viewer->first_line;
+    }
+
+    memcpy(viewer->applied_search, viewer->search, sizeof(viewer->search));
+    viewer->search_trigram_count = 0;
+    u32 key = 0;
+    for (u32 x = 0; viewer->applied_search[x]; x++) {
+        key = push_trigram_key(key, viewer->applied_search[x]);
+        if (x >= 2)
+            viewer->search_trigrams[viewer->search_trigram_count++] = get_trigram_bit(key);
+    }
+
+    memcpy(viewer->applied_show_level, viewer->show_level, sizeof(viewer->show_level));
+    for (u32 x = 0; x < viewer->threads.count; x++) {
+        log_viewer_thread* thread = &darray_at(&viewer->threads, log_viewer_thread, x);
+        thread->applied_shown = thread->shown;
+    }
+}
+
+
+// Tests lines against the applied filter until everything is evaluated or the time budget of this frame is used up.
+// The candidates of a narrowing come first, they are all below [scan_line], so [matches] stays sorted.
+// Blocks of the search index that can not contain the search text are passed over without testing their lines
+static void scan(log_viewer* viewer) {
+
+    const f64 deadline = get_precise_time() + SCAN_TIME_BUDGET;
+    u32 tested = 0;
+    u64 checked_block = UINT64_MAX;
+    b8 block_possible = true;
+
+    const u64* candidates = viewer->narrow_source.data;
+    while (viewer->narrow_position < viewer->narrow_source.count) {
+        const u64 line = candidates[viewer->narrow_position++];
+        if (line >= viewer->first_line) {
+            if (line / INDEX_BLOCK_LINES != checked_block) {
+                checked_block = line / INDEX_BLOCK_LINES;
+                block_possible = block_may_match(viewer, checked_block);
+            }
+            if (block_possible && line_matches(viewer, line) && log_viewer_line_array_push(&viewer->matches, line) != AT_SUCCESS)
+                return;
+        }
+
+        if (++tested % SCAN_CHECK_INTERVAL == 0 && get_precise_time() > deadline)
+            return;
+    }
+    if (viewer->narrow_source.count) {
+        log_viewer_line_array_clear(&viewer->narrow_source);
+        viewer->narrow_position = 0;
+    }
+
+    checked_block = UINT64_MAX;
+    while (viewer->scan_line < viewer->line_count) {
+        const u64 line = viewer->scan_line;
+        const u64 block = line / INDEX_BLOCK_LINES;
+        if (block != checked_block && !block_may_match(viewer, block)) {
+            // lines that arrive later in the same block are checked again with the extended bitmap
+            const u64 block_end = (block + 1) * INDEX_BLOCK_LINES;
+            viewer->scan_line = block_end < viewer->line_count ? block_end : viewer->line_count;
+        } else {
+            checked_block = block;
+            if (line_matches(viewer, line) && log_viewer_line_array_push(&viewer->matches, line) != AT_SUCCESS)
+                return;
+            viewer->scan_line++;
+        }
+
+        if (++tested % SCAN_CHECK_INTERVAL == 0 && get_precise_time() > deadline)
+            return;
+    }
+}
+
+
+static inline b8 is_scanning(const log_viewer* viewer) { return viewer->narrow_position < viewer->narrow_source.count || viewer->scan_line < viewer->line_count; }
+
+
+// ============================================================================================================================================
+// public functions
+// ============================================================================================================================================
+
+i32 log_viewer_init(log_viewer* viewer, const log_viewer_config* config) {
+
+    if (!viewer || viewer->initialized)
+        return AT_INVALID_ARGUMENT;
+
+    const log_viewer_config used_config = config ? *config : LOG_VIEWER_DEFAULT_CONFIG;
+    if (used_config.max_lines == 0 || used_config.text_budget < LOG_VIEWER_MAX_LINE_LENGTH)
+        return AT_INVALID_ARGUMENT;
+
+    memset(viewer, 0, sizeof(log_viewer));
+    viewer->max_lines = used_config.max_lines;
+    viewer->text_capacity = used_config.text_budget;
+    viewer->index_blocks = viewer->max_lines / INDEX_BLOCK_LINES + 2;     // a partial block at both ends of the stored lines
+    viewer->lines = malloc(sizeof(log_viewer_line) * viewer->max_lines);
+    viewer->text = malloc(viewer->text_capacity);
+    viewer->search_index = malloc(sizeof(u64) * INDEX_BLOCK_WORDS * viewer->index_blocks);
+    const log_viewer_thread unknown_thread = { .label = "unknown", .shown = true, .applied_shown = true };
+    if (!viewer->lines || !viewer->text || !viewer->search_index
+        || darray_init_with_capacity(&viewer->threads, sizeof(log_viewer_thread), 16) != AT_SUCCESS
+        || darray_push_back(&viewer->threads, &unknown_thread) != AT_SUCCESS
+        || log_viewer_line_array_init(&viewer->matches, 4096) != AT_SUCCESS
+        || log_viewer_line_array_init(&viewer->narrow_source, 16) != AT_SUCCESS) {
+
+        free(viewer->lines);
+        free(viewer->text);
+        free(viewer->search_index);
+        darray_free(&viewer->threads);
+        log_viewer_line_array_free(&viewer->matches);
+        log_viewer_line_array_free(&viewer->narrow_source);
+        return AT_MEMORY_ERROR;
+    }
+
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++)
+        viewer->show_level[x] = viewer->applied_show_level[x] = true;
+
+    const log_sink_config sink = {
+        .type = LOG_SINK_MEMORY,
+        .min_level = used_config.min_level,
+        .format = "$C",
+        .output = LOG_OUTPUT_TEXT,
+        .memory_size = used_config.sink_size,
+    };
+    const i32 result = logger_add_sink(&sink, &viewer->sink_id);
+    if (result != AT_SUCCESS) {
+        free(viewer->lines);
+        free(viewer->text);
+        free(viewer->search_index);
+        darray_free(&viewer->threads);
+        log_viewer_line_array_free(&viewer->matches);
+        log_viewer_line_array_free(&viewer->narrow_source);
+        return result;
+    }
+
+    viewer->next_sequence = 1;
+    viewer->auto_scroll = true;
+    viewer->initialized = true;
+    return AT_SUCCESS;
+}
+
+
+void log_viewer_shutdown(log_viewer* viewer) {
+
+    if (!viewer || !viewer->initialized)
+        return;
+
+    logger_remove_sink(viewer->sink_id);
+    free(viewer->lines);
+    free(viewer->text);
+    free(viewer->search_index);
+    darray_free(&viewer->threads);
+    log_viewer_line_array_free(&viewer->matches);
+    log_viewer_line_array_free(&viewer->narrow_source);
+    memset(viewer, 0, sizeof(log_viewer));
+}
+
+
+void log_viewer_update(log_viewer* viewer) {
+
+    if (!viewer || !viewer->initialized)
+        return;
+
+    viewer->next_sequence = logger_read_memory_sink(viewer->sink_id, viewer->next_sequence, store_entry, viewer);
+    compact_matches(viewer);
+    apply_filter(viewer);
+    scan(viewer);
+}
+
+
+void log_viewer_clear(log_viewer* viewer) {
+
+    if (!viewer || !viewer->initialized)
+        return;
+
+    viewer->first_line = viewer->line_count;
+    viewer->scan_line = viewer->line_count;
+    log_viewer_line_array_clear(&viewer->matches);
+    log_viewer_line_array_clear(&viewer->narrow_source);
+    viewer->match_head = 0;
+    viewer->narrow_position = 0;
+}
+
+
+u64 log_viewer_get_match_count(const log_viewer* viewer) {
+
+    return (viewer && viewer->initialized) ? viewer->matches.count - viewer->match_head : 0;
+}
+
+
+// ============================================================================================================================================
+// drawing
+// ============================================================================================================================================
+
+static void draw_filter(log_viewer* viewer) {
+
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++) {
+        igPushStyleColor_Vec4(ImGuiCol_Text, c_level_colors[x]);
+        igCheckbox(c_level_names[x], &viewer->show_level[x]);
+        igPopStyleColor(1);
+        igSameLine(0.0f, -1.0f);
+    }
+
+    igSetNextItemWidth(160.0f);
+    if (igBeginCombo("##threads", "Threads", 0)) {
+        for (u32 x = 0; x < viewer->threads.count; x++) {
+            log_viewer_thread* thread = &darray_at(&viewer->threads, log_viewer_thread, x);
+            igPushID_Int((int)x);
+            igCheckbox(thread->label, &thread->shown);
+            igPopID();
+        }
+        igEndCombo();
+    }
+    igSameLine(0.0f, -1.0f);
+
+    igSetNextItemWidth(240.0f);
+    igInputTextWithHint("##search", "Search", viewer->search, sizeof(viewer->search), 0, NULL, NULL);
+    igSameLine(0.0f, -1.0f);
+
+    igCheckbox("Auto-scroll", &viewer->auto_scroll);
+    igSameLine(0.0f, -1.0f);
+    if (igButton("Clear", (ImVec2){0, 0}))
+        log_viewer_clear(viewer);
+    igSameLine(0.0f, -1.0f);
+
+    const u64 stored = viewer->line_count - viewer->first_line;
+    if (is_scanning(viewer)) {
+        const u64 total = stored + viewer->narrow_source.count;
+        const u64 done = (viewer->scan_line - viewer->first_line) + viewer->narrow_position;
+        igText("%llu of %llu lines (searching %llu%%)", (unsigned long long)log_viewer_get_match_count(viewer), (unsigned long long)stored,
+            (unsigned long long)(total ? done * 100 / total : 100));
+    } else
+        igText("%llu of %llu lines", (unsigned long long)log_viewer_get_match_count(viewer), (unsigned long long)stored);
+}
+
+
+static void draw_line(const log_viewer* viewer, const u64 line_number) {
+
+    const log_viewer_line* line = get_line(viewer, line_number);
+    const system_time time = system_time_from_ns(line->timestamp_ns);
+    const char* text = viewer->text + (line->text_position % viewer->text_capacity);
+
+    char prefix[96];
+    snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%03d %-5s [%s]", time.hour, time.minute, time.second, time.millisec,
+        c_level_names[line->level], darray_at(&viewer->threads, log_viewer_thread, line->thread).label);
+
+    igPushStyleColor_Vec4(ImGuiCol_Text, c_level_colors[line->level]);
+    igTextUnformatted(prefix, NULL);
+    igSameLine(0.0f, -1.0f);
+    igTextUnformatted(text, text + line->text_length);
+    igPopStyleColor(1);
+}
+
+
+void log_viewer_draw(log_viewer* viewer, const char* title, b8* p_open) {
+
+    if (!viewer || !viewer->initialized)
+        return;
+
+    if (!igBegin(title, p_open, 0)) {
+        igEnd();
+        return;
+    }
+
+    draw_filter(viewer);
+    igSeparator();
+
+    if (igBeginChild_Str("##log_lines", (ImVec2){0, 0}, ImGuiChildFlags_None, ImGuiWindowFlags_HorizontalScrollbar)) {
+        const u64* matches = viewer->matches.data + viewer->match_head;
+        const u64 count = log_viewer_get_match_count(viewer);
+
+        // only the visible rows are formatted
+        ImGuiListClipper* clipper = ImGuiListClipper_ImGuiListClipper();
+        ImGuiListClipper_Begin(clipper, (int)(count < INT32_MAX ? count : INT32_MAX), -1.0f);
+        while (ImGuiListClipper_Step(clipper))
+            for (int x = clipper->DisplayStart; x < clipper->DisplayEnd; x++)
+                draw_line(viewer, matches[x]);
+        ImGuiListClipper_End(clipper);
+        ImGuiListClipper_destroy(clipper);
+
+        if (viewer->auto_scroll && igGetScrollY() >= igGetScrollMaxY())     // only follow new lines while the view is at the bottom
+            igSetScrollHereY(1.0f);
+    }
+    igEndChild();
+
+    igEnd();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "util/data_structure/data_types.h"
+#include "util/data_structure/darray.h"
+#include "util/data_structure/darray_template.h"
+#include "util/io/logger.h"
+
+
+// Log console panel. The viewer adds its own LOG_SINK_MEMORY sink (format "$C") and copies new messages out of it once per frame
+// into a bounded store: a ring of line descriptors and a ring of text bytes, the oldest lines are dropped first.
+// Only the rows inside the visible area are formatted (ImGuiListClipper), filtering by level, thread and substring runs incrementally:
+// new lines are tested once when they arrive, a changed filter is re-evaluated over a few frames (time sliced), and a filter that only
+// gets stricter (e.g. typing more characters) only re-tests the lines that matched before.
+// The substring search is backed by an index that is extended as lines arrive: every block of 64 lines records which (lowercase)
+// trigrams occur in it, blocks that lack a trigram of the search text are skipped without looking at their text.
+
+
+#define LOG_VIEWER_MAX_THREADS                  256             // distinct threads shown in the thread filter, further threads share the "unknown" entry
+#define LOG_VIEWER_UNKNOWN_THREAD               0               // reserved thread entry, used when a thread can not get an entry of its own
+#define LOG_VIEWER_MAX_LINE_LENGTH              4096            // longer messages are cut when they are copied into the viewer
+#define LOG_VIEWER_SEARCH_LENGTH                256
+
+typedef struct {
+    u64                     text_budget;            // bytes of message text kept by the viewer
+    u32                     max_lines;              // lines kept by the viewer, the search index adds 1 KiB per 64 lines
+    u32                     sink_size;              // size of the memory sink, only needs to hold the messages logged during one frame
+    log_type                min_level;              // messages below this severity are not passed to the viewer
+} log_viewer_config;
+
+#define LOG_VIEWER_DEFAULT_CONFIG               ((log_viewer_config){ .text_budget = 128 << 20, .max_lines = 1 << 20, .sink_size = 8 << 20, .min_level = LOG_TYPE_TRACE })
+
+
+typedef struct {
+    u64                     timestamp_ns;
+    u64                     text_position;          // absolute position inside the text ring, the text is '\0' terminated
+    u32                     text_length;
+    u16                     thread;                 // index into [log_viewer.threads]
+    u8                      level;                  // log_type
+} log_viewer_line;
+
+typedef struct {
+    pthread_t               thread_id;
+    char                    label[32];              // thread label, or the ID if the thread has none
+    b8                      shown;                  // edited by the thread filter
+    b8                      applied_shown;          // [shown] when the current scan started
+} log_viewer_thread;
+
+DEFINE_DARRAY(log_viewer_line_array, u64)                  // absolute line numbers
+
+typedef struct {
+    u32                     sink_id;
+    u64                     next_sequence;          // next message to read from the sink
+
+    // storage
+    log_viewer_line*        lines;                  // ring of [max_lines], line n is at [n % max_lines]
+    u32                     max_lines;
+    u64                     first_line;             // oldest line still stored (absolute number)
+    u64                     line_count;             // lines received since the last clear (absolute number of the next line)
+    char*                   text;                   // ring of [text_capacity] bytes
+    u64                     text_capacity;
+    u64                     text_head;              // absolute write position in [text]
+    darray                  threads;                // log_viewer_thread
+    pthread_t               last_thread_id;         // cache for the thread lookup, messages tend to come in bursts of one thread
+    u16                     last_thread;
+    u64*                    search_index;           // ring of [index_blocks] trigram bitmaps, block n covers the lines [n * 64, n * 64 + 64)
+    u32                     index_blocks;
+
+    // filter, [matches] holds the absolute numbers of all lines below [scan_line] that pass the applied filter
+    log_viewer_line_array   matches;
+    u64                     match_head;             // entries before this index belong to dropped lines
+    log_viewer_line_array   narrow_source;          // previous matches that are re-tested after the filter got stricter
+    u64                     narrow_position;
+    u64                     scan_line;              // next line tested against the filter
+    char                    search[LOG_VIEWER_SEARCH_LENGTH];               // edited by the search field
+    char                    applied_search[LOG_VIEWER_SEARCH_LENGTH];
+    b8                      show_level[LOG_TYPE_FATAL + 1];                 // edited by the level filter
+    b8                      applied_show_level[LOG_TYPE_FATAL + 1];
+    u32                     search_trigrams[LOG_VIEWER_SEARCH_LENGTH];      // index bits of the trigrams in [applied_search]
+    u32                     search_trigram_count;
+
+    b8                      auto_scroll;            // follow new messages while the view is scrolled to the bottom
+    b8                      initialized;
+} log_viewer;
+
+
+// @brief Creates the memory sink and the storage of the viewer.
+// @param viewer The viewer to initialize
+// @param config NULL for LOG_VIEWER_DEFAULT_CONFIG
+// @return AT_SUCCESS, AT_INVALID_ARGUMENT, AT_MEMORY_ERROR or the error of logger_add_sink()
+i32 log_viewer_init(log_viewer* viewer, const log_viewer_config* config);
+
+
+// @brief Removes the memory sink and frees the storage of the viewer.
+void log_viewer_shutdown(log_viewer* viewer);
+
+
+// @brief Copies new messages out of the sink and continues filtering. Call once per frame, also while the window is hidden,
+//        messages that are overwritten in the sink before they are read are missing in the viewer.
+//        Filtering stops after a few milliseconds and continues on the next call.
+void log_viewer_update(log_viewer* viewer);
+
+
+// @brief Drops every stored line.
+void log_viewer_clear(log_viewer* viewer);
+
+
+// @brief Returns the number of lines that pass the filter (as far as it has been evaluated).
+u64 log_viewer_get_match_count(const log_viewer* viewer);
+
+
+// @brief Draws the viewer as its own window, only the visible rows are formatted.
+// @param viewer The viewer to draw
+// @param title Title of the window
+// @param p_open Closes the window when set to false by the close button, can be NULL
+void log_viewer_draw(log_viewer* viewer, const char* title, b8* p_open);
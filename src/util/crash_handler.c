@@ -4,15 +4,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdalign.h>
 #include <unistd.h>
 #include <limits.h>
+#include <fcntl.h>
 #include <execinfo.h>
 #include <ucontext.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <link.h>
+#include <sys/wait.h>
 
 #include "util/data_structure/dynamic_string.h"
-#include "util/data_structure/unordered_map.h"
+#include "util/data_structure/concurrent_map.h"
 #include "util/io/logger.h"
 #include "util/system.h"
 
@@ -21,42 +25,60 @@
 
 
 // Maximum number of stack frames to capture
-#define MAX_STACK_FRAMES 40
+#define MAX_STACK_FRAMES        40
+#define CRASH_MSG_LEN           (16 * 1024)
+#define ADDR2LINE_OUTPUT_LEN    (16 * 1024)
+#define ALT_STACK_SIZE          (64 * 1024)
+#define ADDRESS_TEXT_LEN        20                      // "0x" + 16 hex digits + '\0'
 
 // Original signal handlers for restoration
 static struct sigaction     s_old_handlers[NSIG];
 
 static const int            s_crash_signals[] = {SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGBUS};
 
-static unordered_map        s_user_crash_callbacks = {0};
+// handle -> callback, (un)subscribing can happen on any thread and the signal handler reads it without locking
+static concurrent_map       s_user_crash_callbacks = {0};
 
-static u32                  s_next_handle = 0; // Start handles from 1 (0 is invalid)
+static _Atomic u32          s_next_handle = 0; // Start handles from 1 (0 is invalid)
 
+// The handler runs at most once (see [in_handler]) and can run after a stack overflow, so everything large it needs is static.
+// It does not allocate: symbols come from dladdr() and from one addr2line child process that writes into a pipe
+static char                 s_crash_msg_buffer[CRASH_MSG_LEN];
+static char                 s_addr2line_output[ADDR2LINE_OUTPUT_LEN];
+static char                 s_address_text[MAX_STACK_FRAMES][ADDRESS_TEXT_LEN];
+static alignas(16) u8       s_alt_stack[ALT_STACK_SIZE];
 
-#ifdef __cplusplus
-    #include <cxxabi.h>
+extern char**               environ;
+
+
+// Writes [address] as "0x..." into [out] (ADDRESS_TEXT_LEN bytes) without printf
+static void format_address(char* out, const void* address) {
+
+    static const char digits[] = "0123456789abcdef";
+    uintptr_t value = (uintptr_t)address;
+    char reversed[16];
+    u32 count = 0;
+    do {
+        reversed[count++] = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+
+    out[0] = '0';
+    out[1] = 'x';
+    for (u32 x = 0; x < count; x++)
+        out[2 + x] = reversed[count - 1 - x];
+    out[2 + count] = '\0';
+}
 
-    // Function to demangle C++ symbols
-    static char* demangle_symbol(const char* symbol) {
-        int status;
-        char* demangled = abi::__cxa_demangle(symbol, NULL, NULL, &status);
-        return (status == 0) ? demangled : NULL;
-    }
-#else
-    static char* demangle_symbol(const char* symbol) {
-        (void)symbol;
-        return NULL;
-    }
-#endif
 
-// Function to get symbol information for an address
-static void get_symbol_info(void* addr, char** symbol_name, void** symbol_addr, char** file_name, long* offset) {
+// Function to get symbol information for an address, the strings belong to the loaded module (no copies)
+static void get_symbol_info(void* addr, const char** symbol_name, void** symbol_addr, const char** file_name, long* offset) {
 
     Dl_info info;
     if (dladdr(addr, &info)) {
-        *symbol_name = info.dli_sname ? strdup(info.dli_sname) : NULL;
+        *symbol_name = info.dli_sname;
         *symbol_addr = info.dli_saddr;
-        *file_name = info.dli_fname ? strdup(info.dli_fname) : NULL;
+        *file_name = info.dli_fname;
         *offset = (char*)addr - (char*)info.dli_saddr;
     } else {
         *symbol_name = NULL;
@@ -66,72 +88,150 @@ static void get_symbol_info(void* addr, char** symbol_name, void** symbol_addr,
     }
 }
 
-// Function to resolve address to file and line number using addr2line
-static void resolve_address(void* addr, const char* executable, char** file, int* line) {
-    *file = NULL;
-    *line = 0;
-    
-    // Create command for addr2line
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "addr2line -e %s -f -C -p %p 2>/dev/null", 
-             executable, addr);
-    
-    FILE* fp = popen(cmd, "r");
-    if (!fp) return;
-    
-    char result[256];
-    if (fgets(result, sizeof(result), fp)) {
-        // Parse the result: "function_name at file:line"
-        char* at_pos = strstr(result, " at ");
-        if (at_pos) {
-            *at_pos = '\0'; // Separate function name from file:line
-            at_pos += 4;    // Skip " at "
-            
-            char* colon_pos = strrchr(at_pos, ':');
-            if (colon_pos) {
-                *colon_pos = '\0'; // Separate file from line
-                *file = strdup(at_pos);
-                *line = atoi(colon_pos + 1);
+
+// Runs "addr2line -f -C -p -e [executable] [addresses...]" once for all frames and reads its output into [s_addr2line_output],
+// one line per address: "function at file:line". [addresses] are relative to the load address of [executable] (PIE), frames of other
+// modules are passed as 0 and come back as "??". Only uses pipe, fork, execve, read and waitpid. The child searches PATH itself
+// because execvp may allocate
+// @return Number of bytes read, 0 if addr2line could not be run
+static size_t run_addr2line(const char* executable, void* const* addresses, const int count) {
+
+    const char* argv[MAX_STACK_FRAMES + 7];
+    int argc = 0;
+    argv[argc++] = "addr2line";
+    argv[argc++] = "-f";
+    argv[argc++] = "-C";
+    argv[argc++] = "-p";
+    argv[argc++] = "-e";
+    argv[argc++] = executable;
+    for (int x = 0; x < count && x < MAX_STACK_FRAMES; x++) {
+        format_address(s_address_text[x], addresses[x]);
+        argv[argc++] = s_address_text[x];
+    }
+    argv[argc] = NULL;
+
+    const char* path = getenv("PATH");
+    if (!path)
+        path = "/usr/bin:/bin";
+
+    int fds[2];
+    if (pipe(fds) == -1)
+        return 0;
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    if (pid == 0) {                                     // child: stdout into the pipe, stderr discarded
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        const int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1)
+            dup2(null_fd, STDERR_FILENO);
+
+        char candidate[PATH_MAX];
+        const char* dir = path;
+        while (*dir) {
+            const char* dir_end = strchr(dir, ':');
+            const size_t dir_len = dir_end ? (size_t)(dir_end - dir) : strlen(dir);
+            if (dir_len > 0 && dir_len + sizeof("/addr2line") <= sizeof(candidate)) {
+                memcpy(candidate, dir, dir_len);
+                memcpy(candidate + dir_len, "/addr2line", sizeof("/addr2line"));
+                execve(candidate, (char* const*)argv, environ);
             }
+            if (!dir_end)
+                break;
+            dir = dir_end + 1;
         }
+        _exit(127);
+    }
+
+    close(fds[1]);
+    size_t length = 0;
+    while (length < sizeof(s_addr2line_output) - 1) {
+        const ssize_t result = read(fds[0], s_addr2line_output + length, sizeof(s_addr2line_output) - 1 - length);
+        if (result > 0)
+            length += (size_t)result;
+        else if (result == 0 || errno != EINTR)
+            break;
+    }
+    s_addr2line_output[length] = '\0';
+    close(fds[0]);
+
+    while (waitpid(pid, NULL, 0) == -1 && errno == EINTR) {}
+    return length;
+}
+
+
+// Splits the next line of the addr2line output at [*cursor] into function, file and line. "??" parts are returned as NULL
+static void next_addr2line_line(char** cursor, const char** function, const char** file, int* line) {
+
+    *function = NULL;
+    *file = NULL;
+    *line = 0;
+    if (!*cursor || **cursor == '\0')
+        return;
+
+    char* text = *cursor;
+    char* line_end = strchr(text, '\n');
+    if (line_end) {
+        *line_end = '\0';
+        *cursor = line_end + 1;
+    } else
+        *cursor = NULL;
+
+    // Parse the result: "function_name at file:line"
+    char* at_pos = strstr(text, " at ");
+    if (!at_pos)
+        return;
+
+    *at_pos = '\0';                                     // Separate function name from file:line
+    char* location = at_pos + 4;                        // Skip " at "
+    char* colon_pos = strrchr(location, ':');
+    if (colon_pos) {
+        *colon_pos = '\0';                              // Separate file from line
+        *line = atoi(colon_pos + 1);
     }
-    
-    pclose(fp);
+    *function = (strcmp(text, "??") != 0) ? text : NULL;
+    *file = (strcmp(location, "??") != 0) ? location : NULL;
 }
 
+
 // execute callbacks with highest key first. (as handle is iterated this will ensure reverse execution os subscribing order)
+// Runs inside the signal handler: only lock free reads of the map, the callbacks are not removed
 static void execute_user_callbacks() {
 
-    if (s_user_crash_callbacks.size == 0) return;
-    
-    while (s_user_crash_callbacks.size > 0) {
+    u64 below = (u64)UINT32_MAX + 1;
+    while (1) {
 
-        u32 max_handle = 0;
+        u64 max_handle = 0;
         crash_callback_t callback_to_execute = NULL;
 
-        for (size_t i = 0; i < s_user_crash_callbacks.cap; i++) {      // Find the callback with the highest handle
-            node* current = s_user_crash_callbacks.buckets[i];
-            while (current != NULL) {
-                u32 current_handle = *(u32*)current->key;
-                if (current_handle > max_handle) {
-                    max_handle = current_handle;
-                    callback_to_execute = (crash_callback_t)current->value;
-                }
-                current = current->next;
+        size_t iterator = 0;
+        u64 handle, callback;
+        while (c_map_next(&s_user_crash_callbacks, &iterator, &handle, &callback)) {      // Find the callback with the highest handle not executed yet
+            if (handle < below && handle > max_handle) {
+                max_handle = handle;
+                callback_to_execute = (crash_callback_t)(uintptr_t)callback;
             }
         }
-        
-        if (callback_to_execute) {                                      // Execute the callback and remove it from the map
-            u_map_erase(&s_user_crash_callbacks, &max_handle);
-            callback_to_execute();
-        }
+
+        if (!callback_to_execute)
+            return;
+
+        below = max_handle;
+        callback_to_execute();
     }
 }
 
 
 //
 static void crash_handler(int sig, siginfo_t* info, void* ucontext) {
-    
+
     // Prevent recursive crashes in handler
     static volatile sig_atomic_t in_handler = 0;
     if (in_handler) {
@@ -140,7 +240,7 @@ static void crash_handler(int sig, siginfo_t* info, void* ucontext) {
     in_handler = 1;
 
     execute_user_callbacks();
-    
+
     // Get program counter
     ucontext_t* uc = (ucontext_t*)ucontext;
     void* caller_address = NULL;
@@ -164,72 +264,74 @@ static void crash_handler(int sig, siginfo_t* info, void* ucontext) {
         case SIGBUS:  sig_name = "SIGBUS (Bus Error)"; break;
     }
 
+    // addr2line needs the executable itself (get_executable_path() returns its directory)
     char exe_path[PATH_MAX] = {0};
-    get_executable_path(exe_path, sizeof(exe_path));
-    
-    dyn_str crash_msg;
-    ds_init(&crash_msg);
+    const ssize_t exe_path_len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    exe_path[(exe_path_len > 0) ? exe_path_len : 0] = '\0';
+
+    // static storage, the crashed process should not depend on malloc. Lines that do not fit anymore are left out
+    dyn_str crash_msg = {0};
+    ds_init_buffer(&crash_msg, s_crash_msg_buffer, sizeof(s_crash_msg_buffer), false);
 
     ds_append_str(&crash_msg, "\n=================== CRASH DETECTED ===================\n");
     ds_append_fmt(&crash_msg, NULL, "Signal: %s (%d)\n", sig_name, sig);
     ds_append_fmt(&crash_msg, NULL, "Fault address: %p\n", info->si_addr);
     ds_append_fmt(&crash_msg, NULL, "Fault instruction: %p\n", caller_address);
 
-    // Get backtrace
+    // Get backtrace (already loaded by crash_handler_init, so this does not allocate)
     void* buffer[MAX_STACK_FRAMES];
     int frames = backtrace(buffer, MAX_STACK_FRAMES);
-    
+
     // Overwrite the first frame (this function) with the actual fault address
     if (caller_address)
         buffer[1] = caller_address;
-    
+
     ds_append_fmt(&crash_msg, NULL, "-------------- Stack trace (%d frames) --------------\n", frames);
-    
+
+    // Resolve all frames to function (demangled) and file:line with one addr2line process
+    // addr2line wants addresses relative to the load address (PIE). The link map of the executable itself has an empty name
+    void* exe_offsets[MAX_STACK_FRAMES] = {0};
+    for (int i = 1; i < frames; i++) {
+        Dl_info module;
+        struct link_map* map = NULL;
+        if (dladdr1(buffer[i], &module, (void**)&map, RTLD_DL_LINKMAP) && map && map->l_name && map->l_name[0] == '\0')
+            exe_offsets[i - 1] = (void*)((uintptr_t)buffer[i] - map->l_addr);
+    }
+
+    char* addr2line_cursor = NULL;
+    if (frames > 1 && exe_path[0] && run_addr2line(exe_path, exe_offsets, frames - 1) > 0)
+        addr2line_cursor = s_addr2line_output;
+
     for (int i = 1; i < frames; i++) {
         void* addr = buffer[i];
-        
+
         // Get symbol information
-        char* symbol_name = NULL;
+        const char* symbol_name = NULL;
         void* symbol_addr = NULL;
-        char* file_name = NULL;
+        const char* file_name = NULL;
         long offset = 0;
         get_symbol_info(addr, &symbol_name, &symbol_addr, &file_name, &offset);
-        
-        // Try to demangle the symbol name
-        char* demangled_name = NULL;
-        if (symbol_name) {
-            demangled_name = demangle_symbol(symbol_name);
-        }
-        
-        // Try to resolve to source file and line
-        char* source_file = NULL;
+
+        const char* function_name = NULL;
+        const char* source_file = NULL;
         int source_line = 0;
-        resolve_address(addr, exe_path, &source_file, &source_line);
-        
+        next_addr2line_line(&addr2line_cursor, &function_name, &source_file, &source_line);
+
         // Print frame information
         ds_append_fmt(&crash_msg, NULL, "#%-2d %p", i, addr);
-        ds_append_fmt(&crash_msg, NULL, " in [%s]", file_name);
-        ds_append_fmt(&crash_msg, NULL, " name [%s]", demangled_name ? demangled_name : "null");
+        ds_append_fmt(&crash_msg, NULL, " in [%s]", file_name ? file_name : "null");
+        ds_append_fmt(&crash_msg, NULL, " name [%s]", function_name ? function_name : "null");
         ds_append_fmt(&crash_msg, NULL, " symbol [%s]", symbol_name ? symbol_name : "null");
         ds_append_fmt(&crash_msg, NULL, " offset [0x%lx]", offset);
         ds_append_fmt(&crash_msg, NULL, " file:line [%s:%d]\n", source_file ? source_file : "null", source_line);
-
-        if (demangled_name)
-            free(demangled_name);
-        if (source_file && source_line > 0)
-            free(source_file);
-        
-        // Clean up
-        if (symbol_name) free(symbol_name);
-        if (file_name) free(file_name);
     }
-    
+
     ds_append_str(&crash_msg, "------------------------------------------------------\n");
     ds_append_str(&crash_msg, "Note: Install debug symbols for more detailed information\n");
-    
+
     LOG(Error, "%s", crash_msg.data);
     ds_free(&crash_msg);
-    
+
     // Restore default handler and re-raise signal to trigger core dump
     sigaction(sig, &s_old_handlers[sig], NULL);
     raise(sig);
@@ -245,12 +347,22 @@ bool crash_handler_init() {
     struct sigaction sa;
     sa.sa_sigaction = crash_handler;
     sigemptyset(&sa.sa_mask);
-    
+
     for (int i = 0; i < num_signals; i++)               // Add all crash signals to the mask to prevent nested handling
         sigaddset(&sa.sa_mask, s_crash_signals[i]);
-    
+
     sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
-    
+
+    // SA_ONSTACK runs the handler on [s_alt_stack], after a stack overflow the faulting stack has no room left.
+    // An alternate stack belongs to one thread, this covers the thread calling crash_handler_init (the main thread)
+    stack_t alt_stack = { .ss_sp = s_alt_stack, .ss_size = sizeof(s_alt_stack), .ss_flags = 0 };
+    if (sigaltstack(&alt_stack, NULL) == -1)
+        perror("sigaltstack failed");
+
+    // backtrace() loads libgcc on its first call, which allocates. Do that here instead of inside the handler
+    void* warm_up[1];
+    backtrace(warm_up, 1);
+
     // Register signal handlers
     for (int i = 0; i < num_signals; i++) {
         if (sigaction(s_crash_signals[i], &sa, &s_old_handlers[s_crash_signals[i]]) == -1) {
@@ -258,10 +370,10 @@ bool crash_handler_init() {
             return false;
         }
     }
-    
+
     signal(SIGPIPE, SIG_IGN);           // Ignore SIGPIPE to prevent crashes from broken pipes
-    
-    VALIDATE(u_map_init(&s_user_crash_callbacks, 2, u32_hash, u32_compare) == AT_SUCCESS, return false, "", "Failed to create u_map for crash callbacks")
+
+    VALIDATE(c_map_init(&s_user_crash_callbacks, 2) == AT_SUCCESS, return false, "", "Failed to create the map for crash callbacks")
     s_next_handle = 1;                  // Start handles from 1 (0 is invalid)
 
     return true;
@@ -276,7 +388,10 @@ void crash_handler_shutdown() {
     for (int i = 0; i < num_signals; i++)                                           // Restore original signal handlers
         sigaction(s_crash_signals[i], &s_old_handlers[s_crash_signals[i]], NULL);
 
-    u_map_free(&s_user_crash_callbacks);
+    stack_t alt_stack = { .ss_flags = SS_DISABLE };
+    sigaltstack(&alt_stack, NULL);
+
+    c_map_free(&s_user_crash_callbacks);
 }
 
 
@@ -284,28 +399,19 @@ u32 crash_handler_subscribe_callback(crash_callback_t user_callback) {
 
     if (!s_next_handle || !user_callback) return 0;
 
-    const u32 handle = s_next_handle++;
-
-    // Allocate memory for the key (u32)
-    u32* key = malloc(sizeof(u32));
-    if (!key) return 0;
-    *key = handle;
-    
-    // Insert into map
-    if (u_map_insert(&s_user_crash_callbacks, key, (void*)user_callback) != AT_SUCCESS) {
-        free(key);
+    const u32 handle = atomic_fetch_add(&s_next_handle, 1);
+    if (c_map_insert(&s_user_crash_callbacks, handle, (u64)(uintptr_t)user_callback) != AT_SUCCESS)
         return 0;
-    }
-    
+
     return handle;
 }
 
 
 // Unsubscribe a crash callback
 void crash_handler_unsubscribe_callback(u32 handle) {
-    
+
     if (!s_next_handle || handle == 0) return;
-    
-    u_map_erase(&s_user_crash_callbacks, &handle);
+
+    c_map_erase(&s_user_crash_callbacks, handle);
 
 }
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "allocator.h"
+#include "arena.h"
+
+#define DEFAULT_BLOCKS_PER_CHUNK    64
+
+
+// ============================================================================================================================================
+// heap
+// ============================================================================================================================================
+
+static void* heap_alloc(void* context, size_t size) {
+
+    (void)context;
+    return malloc(size);
+}
+
+
+static void* heap_realloc(void* context, void* memory, size_t old_size, size_t new_size) {
+
+    (void)context;
+    (void)old_size;
+    return realloc(memory, new_size);
+}
+
+
+static void heap_free(void* context, void* memory, size_t size) {
+
+    (void)context;
+    (void)size;
+    free(memory);
+}
+
+
+static const allocator              s_heap = { .alloc = heap_alloc, .realloc = heap_realloc, .free = heap_free };
+static _Atomic(const allocator*)    s_default = &s_heap;
+
+
+const allocator* allocator_heap()                       { return &s_heap; }
+
+const allocator* allocator_get_default()                { return atomic_load_explicit(&s_default, memory_order_acquire); }
+
+void allocator_set_default(const allocator* alloc)      { atomic_store_explicit(&s_default, alloc ? alloc : &s_heap, memory_order_release); }
+
+
+// ============================================================================================================================================
+// arena
+// ============================================================================================================================================
+
+static void* arena_allocator_alloc(void* context, size_t size) {
+
+    return arena_alloc(context, size, ALLOCATOR_ALIGNMENT);
+}
+
+
+static void* arena_allocator_realloc(void* context, void* memory, size_t old_size, size_t new_size) {
+
+    return arena_realloc(context, memory, old_size, new_size);
+}
+
+
+// memory comes back with arena_reset / arena_free
+static void arena_allocator_free(void* context, void* memory, size_t size) {
+
+    (void)context;
+    (void)memory;
+    (void)size;
+}
+
+
+allocator allocator_from_arena(arena* a) {
+
+    return (allocator){ .alloc = arena_allocator_alloc, .realloc = arena_allocator_realloc, .free = arena_allocator_free, .context = a };
+}
+
+
+// ============================================================================================================================================
+// pool
+// ============================================================================================================================================
+
+// Chunks are linked through their first ALLOCATOR_ALIGNMENT bytes, free blocks through their first pointer
+typedef struct pool_chunk {
+    struct pool_chunk*  next;
+} pool_chunk;
+
+
+i32 pool_init(pool* p, size_t block_size, size_t blocks_per_chunk) {
+    if (!p || block_size == 0) return AT_INVALID_ARGUMENT;
+
+    block_size = (block_size + ALLOCATOR_ALIGNMENT - 1) & ~(size_t)(ALLOCATOR_ALIGNMENT - 1);
+    *p = (pool){ .block_size = block_size, .blocks_per_chunk = blocks_per_chunk ? blocks_per_chunk : DEFAULT_BLOCKS_PER_CHUNK };
+    return AT_SUCCESS;
+}
+
+
+i32 pool_free(pool* p) {
+    if (!p) return AT_INVALID_ARGUMENT;
+
+    pool_chunk* chunk = p->chunks;
+    while (chunk) {
+        pool_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    p->chunks = NULL;
+    p->free_list = NULL;
+    p->used_blocks = 0;
+    return AT_SUCCESS;
+}
+
+
+void* pool_alloc(pool* p) {
+
+    if (!p->free_list) {
+        pool_chunk* chunk = malloc(ALLOCATOR_ALIGNMENT + p->block_size * p->blocks_per_chunk);
+        if (!chunk) return NULL;
+
+        chunk->next = p->chunks;
+        p->chunks = chunk;
+
+        // thread the new blocks into the free list, first block first
+        u8* blocks = (u8*)chunk + ALLOCATOR_ALIGNMENT;
+        for (size_t x = p->blocks_per_chunk; x-- > 0;) {
+            *(void**)(blocks + x * p->block_size) = p->free_list;
+            p->free_list = blocks + x * p->block_size;
+        }
+    }
+
+    void* block = p->free_list;
+    p->free_list = *(void**)block;
+    p->used_blocks++;
+    return block;
+}
+
+
+void pool_release(pool* p, void* block) {
+
+    if (!block) return;
+
+    *(void**)block = p->free_list;
+    p->free_list = block;
+    p->used_blocks--;
+}
+
+
+static void* pool_allocator_alloc(void* context, size_t size) {
+
+    pool* p = context;
+    return (size <= p->block_size) ? pool_alloc(p) : NULL;
+}
+
+
+static void* pool_allocator_realloc(void* context, void* memory, size_t old_size, size_t new_size) {
+
+    (void)old_size;
+    pool* p = context;
+    if (new_size > p->block_size) return NULL;
+    return memory ? memory : pool_alloc(p);             // every block already has the full block size
+}
+
+
+static void pool_allocator_free(void* context, void* memory, size_t size) {
+
+    (void)size;
+    pool_release(context, memory);
+}
+
+
+allocator allocator_from_pool(pool* p) {
+
+    return (allocator){ .alloc = pool_allocator_alloc, .realloc = pool_allocator_realloc, .free = pool_allocator_free, .context = p };
+}
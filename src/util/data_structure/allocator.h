@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include "data_types.h"
+
+// Memory interface of the containers (darray, stack, dyn_str, unordered_map, arena pages). A container takes an allocator at init
+// and uses it for all its memory until it is freed, so the allocator has to stay valid that long. Passing NULL uses the global
+// default, which is the heap (malloc / realloc / free) unless allocator_set_default() changed it.
+//
+//      arena frame = {0};
+//      arena_init(&frame, 0);
+//      allocator frame_allocator = allocator_from_arena(&frame);
+//
+//      darray visible = {0};
+//      darray_init_with_allocator(&visible, sizeof(u32), 64, &frame_allocator);
+//      ...                                                     // no darray_free, arena_reset(&frame) at the end of the frame
+//
+// Memory returned by an allocator is aligned for any type (ALLOCATOR_ALIGNMENT). The sizes passed to realloc / free are the sizes
+// the memory was requested with, so allocators do not have to store them.
+
+#define ALLOCATOR_ALIGNMENT     16
+
+struct arena;
+
+typedef struct {
+    void*               (*alloc)(void* context, size_t size);
+    void*               (*realloc)(void* context, void* memory, size_t old_size, size_t new_size);
+    void                (*free)(void* context, void* memory, size_t size);
+    void*               context;                // passed to the functions, the arena / pool the allocator works on
+} allocator;
+
+
+// Fixed size blocks taken from larger chunks, freed blocks are kept in a free list and reused first
+typedef struct {
+    void*               free_list;
+    void*               chunks;                 // all chunks, released by pool_free
+    size_t              block_size;
+    size_t              blocks_per_chunk;
+    size_t              used_blocks;
+} pool;
+
+
+// ============================================================================================================================================
+// allocators
+// ============================================================================================================================================
+
+// @brief malloc / realloc / free
+const allocator* allocator_heap();
+
+// @brief The allocator containers use when they are initialized without one
+const allocator* allocator_get_default();
+
+// @brief Replaces the default allocator, only affects containers initialized afterwards. Set it during startup, before other threads
+//        create containers
+// @param alloc New default, NULL restores the heap. Has to stay valid as long as containers use it
+void allocator_set_default(const allocator* alloc);
+
+// @brief Allocator that takes its memory from [a]. free does nothing, the memory comes back with arena_reset / arena_free.
+//        realloc of the last allocation grows it in place when the page has room
+allocator allocator_from_arena(struct arena* a);
+
+// @brief Allocator that hands out blocks of [p]. Requests larger than the block size fail (NULL), so it suits containers whose
+//        size is bounded by the block size
+allocator allocator_from_pool(pool* p);
+
+
+// ============================================================================================================================================
+// pool
+// ============================================================================================================================================
+
+// @brief Initializes a pool, no memory is allocated until the first pool_alloc()
+// @param block_size Size of one block, rounded up to ALLOCATOR_ALIGNMENT
+// @param blocks_per_chunk Blocks allocated at once when the free list is empty, 0 for 64
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT
+i32 pool_init(pool* p, size_t block_size, size_t blocks_per_chunk);
+
+// @brief Releases all chunks, every block becomes invalid
+i32 pool_free(pool* p);
+
+// @brief Returns a free block, NULL if a new chunk could not be allocated
+void* pool_alloc(pool* p);
+
+// @brief Puts [block] back into the free list
+void pool_release(pool* p, void* block);
+
+
+// ============================================================================================================================================
+// helpers used by the containers
+// ============================================================================================================================================
+
+static inline void* allocator_alloc(const allocator* alloc, const size_t size) {
+
+    return alloc->alloc(alloc->context, size);
+}
+
+
+static inline void* allocator_realloc(const allocator* alloc, void* memory, const size_t old_size, const size_t new_size) {
+
+    return alloc->realloc(alloc->context, memory, old_size, new_size);
+}
+
+
+static inline void allocator_free(const allocator* alloc, void* memory, const size_t size) {
+
+    if (memory)
+        alloc->free(alloc->context, memory, size);
+}
+
+
+// @brief [alloc] or the default allocator if it is NULL
+static inline const allocator* allocator_or_default(const allocator* alloc)     { return alloc ? alloc : allocator_get_default(); }
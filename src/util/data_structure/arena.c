@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define DEFAULT_PAGE_SIZE       (64 * 1024)
+#define MAX_ALIGNMENT           64
+
+struct arena_page {
+    arena_page*         next;
+    size_t              size;                   // usable bytes after the header
+    size_t              used;
+    void*               memory;                 // allocation the page was placed in, the page starts at its first aligned byte
+    size_t              memory_size;
+    u8                  _padding[MAX_ALIGNMENT - 5 * sizeof(size_t)];
+    u8                  data[];                 // aligned to MAX_ALIGNMENT
+};
+
+
+// Offset of the first [alignment] aligned byte at or after [used]
+static inline size_t align_up(const size_t used, const size_t alignment)   { return (used + alignment - 1) & ~(alignment - 1); }
+
+
+static arena_page* allocate_page(const allocator* backing, const size_t size) {
+
+    // allocators only guarantee ALLOCATOR_ALIGNMENT, the page is moved to the next MAX_ALIGNMENT boundary
+    const size_t memory_size = sizeof(arena_page) + size + MAX_ALIGNMENT - ALLOCATOR_ALIGNMENT;
+    void* memory = allocator_alloc(backing, memory_size);
+    if (!memory) return NULL;
+
+    arena_page* page = (arena_page*)align_up((size_t)memory, MAX_ALIGNMENT);
+    page->next = NULL;
+    page->size = size;
+    page->used = 0;
+    page->memory = memory;
+    page->memory_size = memory_size;
+    return page;
+}
+
+
+i32 arena_init(arena* a, size_t page_size) {
+
+    return arena_init_with_allocator(a, page_size, NULL);
+}
+
+
+i32 arena_init_with_allocator(arena* a, size_t page_size, const allocator* backing) {
+    if (!a) return AT_INVALID_ARGUMENT;
+
+    *a = (arena){ .page_size = page_size ? page_size : DEFAULT_PAGE_SIZE, .backing = backing ? backing : allocator_heap() };
+    return AT_SUCCESS;
+}
+
+
+i32 arena_free(arena* a) {
+    if (!a) return AT_INVALID_ARGUMENT;
+
+    const allocator* backing = a->backing ? a->backing : allocator_heap();
+    arena_page* page = a->first;
+    while (page) {
+        arena_page* next = page->next;
+        allocator_free(backing, page->memory, page->memory_size);
+        page = next;
+    }
+    *a = (arena){ .page_size = a->page_size, .backing = a->backing };         // stays usable
+    return AT_SUCCESS;
+}
+
+
+void* arena_alloc(arena* a, size_t size, size_t alignment) {
+    if (!a || alignment == 0 || alignment > MAX_ALIGNMENT || (alignment & (alignment - 1))) return NULL;
+
+    // current page, then the pages kept by arena_reset, then a new one
+    arena_page* page = a->current;
+    while (page && align_up(page->used, alignment) + size > page->size) {
+        page = page->next;
+        if (page)
+            page->used = 0;
+    }
+
+    if (!page) {
+        page = allocate_page(a->backing ? a->backing : allocator_heap(), size > a->page_size ? size : a->page_size);
+        if (!page) return NULL;
+
+        // new pages go behind the current one, the pages after it stay the unused ones
+        if (a->current) {
+            page->next = a->current->next;
+            a->current->next = page;
+        } else {
+            page->next = a->first;
+            a->first = page;
+        }
+        a->page_count++;
+    }
+
+    const size_t offset = align_up(page->used, alignment);
+    page->used = offset + size;
+    a->current = page;
+    return page->data + offset;
+}
+
+
+void* arena_realloc(arena* a, void* memory, size_t old_size, size_t new_size) {
+
+    if (!memory)
+        return arena_alloc(a, new_size, ALLOCATOR_ALIGNMENT);
+
+    // the last allocation of the current page can change its size in place
+    arena_page* page = a ? a->current : NULL;
+    if (page && (u8*)memory + old_size == page->data + page->used) {
+        const size_t offset = (size_t)((u8*)memory - page->data);
+        if (offset + new_size <= page->size) {
+            page->used = offset + new_size;
+            return memory;
+        }
+    }
+
+    if (new_size <= old_size)
+        return memory;
+
+    void* new_memory = arena_alloc(a, new_size, ALLOCATOR_ALIGNMENT);
+    if (new_memory && old_size)
+        memcpy(new_memory, memory, old_size);
+    return new_memory;
+}
+
+
+void* arena_copy(arena* a, const void* data, size_t size) {
+
+    void* memory = arena_alloc(a, size, 8);
+    if (memory && size)
+        memcpy(memory, data, size);
+    return memory;
+}
+
+
+i32 arena_reset(arena* a) {
+    if (!a) return AT_INVALID_ARGUMENT;
+
+    a->current = a->first;
+    if (a->current)
+        a->current->used = 0;
+    return AT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include "data_types.h"
+#include "allocator.h"
+
+// Page based bump allocator. Allocations are carved out of large pages and are never freed one by one: arena_reset() makes all
+// pages available again (without returning them to the system) and arena_free() releases them. A workload that refills the
+// arena every frame stops allocating once the pages of its biggest frame exist.
+// The pages come from the heap or from the allocator passed to arena_init_with_allocator (not from the default allocator, which may
+// itself be an arena).
+
+typedef struct arena_page arena_page;
+
+typedef struct arena {
+    arena_page*         first;
+    arena_page*         current;                // page allocations are taken from, the pages after it are unused
+    size_t              page_size;              // size of a new page, larger allocations get a page of their own size
+    size_t              page_count;
+    const allocator*    backing;                // allocator of the pages
+} arena;
+
+
+// @brief Initializes an arena, no page is allocated until the first arena_alloc()
+// @param page_size Size of the pages, 0 for the default (64 KiB)
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT
+i32 arena_init(arena* a, size_t page_size);
+
+// @brief Initializes an arena whose pages are allocated with [backing]
+// @param backing Allocator of the pages, NULL for the heap
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT
+i32 arena_init_with_allocator(arena* a, size_t page_size, const allocator* backing);
+
+// @brief Releases all pages
+i32 arena_free(arena* a);
+
+// @brief Allocates [size] bytes aligned to [alignment] (power of two, at most 64)
+// @return Pointer to the memory, NULL if a new page could not be allocated
+void* arena_alloc(arena* a, size_t size, size_t alignment);
+
+// @brief Resizes [memory] (allocated from [a] with [old_size] bytes). The last allocation grows or shrinks in place if its page has
+//        room, otherwise the content is copied into a new allocation (alignment 16) and the old memory stays unused until arena_reset
+// @return Pointer to the memory, NULL if a new page could not be allocated ([memory] stays valid)
+void* arena_realloc(arena* a, void* memory, size_t old_size, size_t new_size);
+
+// @brief Copies [size] bytes of [data] into the arena (alignment 8)
+void* arena_copy(arena* a, const void* data, size_t size);
+
+// @brief Makes the memory of all allocations available again, the pages stay allocated
+i32 arena_reset(arena* a);
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "data_types.h"
+#include "hash_map_template.h"             // hash_mix, hash_capacity_for
+#include "concurrent_map.h"
+
+
+// Slot states, the low two bits of [c_map_slot.state]. The bits above count the changes of the slot, so a reader can detect that a
+// slot was changed (erased and reused for another key) while it read the key and value: it reads the state before and after.
+// Writers of different stripes can race for the same free slot, they claim it with a CAS on the state.
+enum {
+    SLOT_EMPTY = 0,                 // never used, ends a probe
+    SLOT_BUSY,                      // claimed by a writer, not visible yet
+    SLOT_FULL,
+    SLOT_DELETED,                   // erased, probes continue past it and inserts can reuse it
+};
+
+#define SLOT_KIND(state)                ((u32)((state) & 3))
+#define SLOT_NEXT(state, kind)          ((((state) >> 2) + 1) << 2 | (kind))
+
+typedef struct {
+    _Atomic u64             state;
+    _Atomic u64             key;
+    _Atomic u64             value;
+} c_map_slot;
+
+struct c_map_table {
+    size_t                  cap;                // power of two
+    size_t                  limit;              // maximum of [used], keeps EMPTY slots so every probe ends
+    _Atomic size_t          used;               // slots that are not EMPTY
+    c_map_slot              slots[];
+};
+
+
+// ------------------------------------------------------------------------------------------
+// Helpers
+// ------------------------------------------------------------------------------------------
+
+static inline u64 hash_key(const u64 key)                                   { return hash_mix(key); }
+
+// the slot position uses the low bits of the hash, the stripe the high ones
+static inline u32 get_stripe_index(const u64 hash)                          { return (u32)(hash >> 60 & (C_MAP_STRIPES - 1)); }
+static inline c_map_stripe* get_stripe(concurrent_map* map, const u64 hash) { return &map->stripes[get_stripe_index(hash)]; }
+
+
+static c_map_table* allocate_table(const size_t capacity) {
+
+    c_map_table* table = calloc(1, sizeof(c_map_table) + capacity * sizeof(c_map_slot));         // all slots SLOT_EMPTY
+    if (!table)
+        return NULL;
+
+    table->cap = capacity;
+    table->limit = hash_capacity_to_growth(capacity);
+    return table;
+}
+
+
+// Registers a lock free reader in [stripe] for the current epoch, returns the epoch to pass to read_end().
+// The epoch is checked again after registering, a reader that raced with a replacement registers again in the new epoch.
+// Readers only modify the counters, so a const map is cast once here
+static inline u64 read_begin(const concurrent_map* map, const u32 stripe_index) {
+
+    c_map_stripe* stripe = (c_map_stripe*)&map->stripes[stripe_index];
+    while (1) {
+        const u64 epoch = atomic_load(&map->epoch);
+        atomic_fetch_add(&stripe->readers[epoch & 1], 1);
+        if (atomic_load(&map->epoch) == epoch)
+            return epoch;
+        atomic_fetch_sub(&stripe->readers[epoch & 1], 1);
+    }
+}
+
+static inline void read_end(const concurrent_map* map, const u32 stripe_index, const u64 epoch) {
+
+    c_map_stripe* stripe = (c_map_stripe*)&map->stripes[stripe_index];
+    atomic_fetch_sub_explicit(&stripe->readers[epoch & 1], 1, memory_order_release);
+}
+
+
+// Reads the entry of [slot] consistently, false if it is not FULL
+static inline b8 read_slot(const c_map_slot* slot, u64* key, u64* value) {
+
+    while (1) {
+        const u64 state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (SLOT_KIND(state) != SLOT_FULL)
+            return false;
+        *key = atomic_load_explicit(&slot->key, memory_order_relaxed);
+        *value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_relaxed) == state)
+            return true;
+    }
+}
+
+
+// Lock free lookup in [table]
+static b8 find_in_table(const c_map_table* table, const u64 key, const u64 hash, u64* value) {
+
+    const size_t mask = table->cap - 1;
+    for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+        const c_map_slot* slot = &table->slots[index];
+        if (SLOT_KIND(atomic_load_explicit(&slot->state, memory_order_acquire)) == SLOT_EMPTY)
+            return false;
+        u64 slot_key, slot_value;
+        if (read_slot(slot, &slot_key, &slot_value) && slot_key == key) {
+            *value = slot_value;
+            return true;
+        }
+    }
+}
+
+
+// Slot of [key], NULL if it is not in [table]. The slot can only change under the stripe of [key]
+// CAUTION: caller needs to hold the stripe of [key]
+static c_map_slot* find_slot_locked(c_map_table* table, const u64 key, const u64 hash) {
+
+    const size_t mask = table->cap - 1;
+    for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+        c_map_slot* slot = &table->slots[index];
+        const u32 kind = SLOT_KIND(atomic_load_explicit(&slot->state, memory_order_acquire));
+        if (kind == SLOT_EMPTY)
+            return NULL;
+        if (kind == SLOT_FULL && atomic_load_explicit(&slot->key, memory_order_relaxed) == key)
+            return slot;
+    }
+}
+
+
+static void lock_all(concurrent_map* map) {
+
+    for (u32 x = 0; x < C_MAP_STRIPES; x++)
+        pthread_mutex_lock(&map->stripes[x].mutex);
+}
+
+static void unlock_all(concurrent_map* map) {
+
+    for (u32 x = C_MAP_STRIPES; x > 0; x--)
+        pthread_mutex_unlock(&map->stripes[x - 1].mutex);
+}
+
+
+// Publishes [table] as the current table and frees the old one once no reader can probe it anymore: a reader that loaded the old table
+// registered in the current epoch before, so advancing the epoch and waiting for its counters to drop to zero is the grace period.
+// Readers that arrive meanwhile count in the other parity and see [table]. Waiting with all stripes held keeps replacements in order,
+// so when the next one starts every reader still active belongs to the epoch it waits for
+// CAUTION: caller needs to hold all stripes
+static void replace_table_locked(concurrent_map* map, c_map_table* table) {
+
+    c_map_table* old = atomic_load_explicit(&map->table, memory_order_relaxed);
+    atomic_store(&map->table, table);
+
+    const u64 epoch = atomic_fetch_add(&map->epoch, 1);
+    for (u32 x = 0; x < C_MAP_STRIPES; x++)
+        while (atomic_load(&map->stripes[x].readers[epoch & 1]) != 0)
+            sched_yield();
+
+    free(old);
+}
+
+
+// Replaces [full] by a table with room for twice the current entries, unless another writer did it already.
+// With many tombstones and few entries this compacts the table instead of growing it
+static i32 grow(concurrent_map* map, const c_map_table* full) {
+
+    lock_all(map);
+    c_map_table* old = atomic_load_explicit(&map->table, memory_order_relaxed);
+    if (old != full) {
+        unlock_all(map);
+        return AT_SUCCESS;
+    }
+
+    const size_t size = atomic_load_explicit(&map->size, memory_order_relaxed);
+    c_map_table* table = allocate_table(hash_capacity_for(size * 2 + 1));
+    if (!table) {
+        unlock_all(map);
+        return AT_MEMORY_ERROR;
+    }
+
+    // no writer is active, so there are no BUSY slots. The new table is not visible yet, the release store in replace_table_locked
+    // publishes its content
+    const size_t mask = table->cap - 1;
+    for (size_t x = 0; x < old->cap; x++) {
+        const c_map_slot* source = &old->slots[x];
+        if (SLOT_KIND(atomic_load_explicit(&source->state, memory_order_relaxed)) != SLOT_FULL)
+            continue;
+        const u64 key = atomic_load_explicit(&source->key, memory_order_relaxed);
+        size_t index = hash_key(key) & mask;
+        while (SLOT_KIND(atomic_load_explicit(&table->slots[index].state, memory_order_relaxed)) != SLOT_EMPTY)
+            index = (index + 1) & mask;
+        atomic_store_explicit(&table->slots[index].key, key, memory_order_relaxed);
+        atomic_store_explicit(&table->slots[index].value, atomic_load_explicit(&source->value, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&table->slots[index].state, SLOT_FULL, memory_order_relaxed);
+    }
+    atomic_store_explicit(&table->used, size, memory_order_relaxed);
+
+    replace_table_locked(map, table);
+    unlock_all(map);
+    return AT_SUCCESS;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Map implementation
+// ------------------------------------------------------------------------------------------
+
+i32 c_map_init(concurrent_map* map, size_t capacity) {
+    if (!map || capacity == 0) return AT_INVALID_ARGUMENT;
+
+    memset(map, 0, sizeof(concurrent_map));
+    c_map_table* table = allocate_table(hash_capacity_for(capacity));
+    if (!table) return AT_MEMORY_ERROR;
+
+    for (u32 x = 0; x < C_MAP_STRIPES; x++)
+        pthread_mutex_init(&map->stripes[x].mutex, NULL);
+    atomic_store_explicit(&map->table, table, memory_order_release);        // last, readers treat a NULL table as "not initialized"
+    return AT_SUCCESS;
+}
+
+
+i32 c_map_free(concurrent_map* map) {
+    if (!map) return AT_INVALID_ARGUMENT;
+
+    c_map_table* table = atomic_load(&map->table);
+    if (!table) return AT_NOT_INITIALIZED;
+
+    free(table);
+    for (u32 x = 0; x < C_MAP_STRIPES; x++)
+        pthread_mutex_destroy(&map->stripes[x].mutex);
+    memset(map, 0, sizeof(concurrent_map));
+    return AT_SUCCESS;
+}
+
+
+i32 c_map_insert(concurrent_map* map, const u64 key, const u64 value) {
+    if (!map) return AT_INVALID_ARGUMENT;
+    if (!atomic_load_explicit(&map->table, memory_order_acquire)) return AT_NOT_INITIALIZED;
+
+    const u64 hash = hash_key(key);
+    c_map_stripe* stripe = get_stripe(map, hash);
+    while (1) {
+        pthread_mutex_lock(&stripe->mutex);
+        c_map_table* table = atomic_load_explicit(&map->table, memory_order_acquire);      // stable while a stripe is held
+
+        // the same key always maps to this stripe, so no other writer can insert it meanwhile
+        c_map_slot* existing = find_slot_locked(table, key, hash);
+        if (existing) {
+            atomic_store_explicit(&existing->value, value, memory_order_release);
+            pthread_mutex_unlock(&stripe->mutex);
+            return AT_SUCCESS;
+        }
+
+        // claim the first EMPTY or DELETED slot, writers of other stripes can claim it first. There is always an EMPTY slot,
+        // taking one is reserved in [used] first, the table is replaced when that would exceed its limit
+        const size_t mask = table->cap - 1;
+        b8 claimed = false;
+        for (size_t index = hash & mask; !claimed; index = (index + 1) & mask) {
+            c_map_slot* slot = &table->slots[index];
+            u64 state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+            const u32 kind = SLOT_KIND(state);
+            if (kind != SLOT_EMPTY && kind != SLOT_DELETED)
+                continue;
+
+            if (kind == SLOT_EMPTY && atomic_fetch_add_explicit(&table->used, 1, memory_order_relaxed) >= table->limit) {
+                atomic_fetch_sub_explicit(&table->used, 1, memory_order_relaxed);
+                break;
+            }
+            if (!atomic_compare_exchange_strong_explicit(&slot->state, &state, SLOT_NEXT(state, SLOT_BUSY), memory_order_acquire, memory_order_relaxed)) {
+                if (kind == SLOT_EMPTY)
+                    atomic_fetch_sub_explicit(&table->used, 1, memory_order_relaxed);
+                index = (index - 1) & mask;             // look at the same slot again
+                continue;
+            }
+
+            atomic_store_explicit(&slot->key, key, memory_order_relaxed);
+            atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+            atomic_store_explicit(&slot->state, SLOT_NEXT(state, SLOT_FULL), memory_order_release);
+            claimed = true;
+        }
+
+        if (!claimed) {
+            pthread_mutex_unlock(&stripe->mutex);
+            const i32 result = grow(map, table);
+            if (result != AT_SUCCESS) return result;
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&map->size, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&stripe->mutex);
+        return AT_SUCCESS;
+    }
+}
+
+
+i32 c_map_erase(concurrent_map* map, const u64 key) {
+    if (!map) return AT_INVALID_ARGUMENT;
+    if (!atomic_load_explicit(&map->table, memory_order_acquire)) return AT_NOT_INITIALIZED;
+
+    const u64 hash = hash_key(key);
+    c_map_stripe* stripe = get_stripe(map, hash);
+    pthread_mutex_lock(&stripe->mutex);
+
+    c_map_table* table = atomic_load_explicit(&map->table, memory_order_acquire);
+    c_map_slot* slot = find_slot_locked(table, key, hash);
+    if (slot) {
+        const u64 state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+        atomic_store_explicit(&slot->state, SLOT_NEXT(state, SLOT_DELETED), memory_order_release);
+        atomic_fetch_sub_explicit(&map->size, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&stripe->mutex);
+    return slot ? AT_SUCCESS : AT_ERROR;
+}
+
+
+i32 c_map_clear(concurrent_map* map) {
+    if (!map) return AT_INVALID_ARGUMENT;
+    if (!atomic_load_explicit(&map->table, memory_order_acquire)) return AT_NOT_INITIALIZED;
+
+    // a new table instead of resetting the slots, readers may still be probing the old one
+    lock_all(map);
+    c_map_table* table = allocate_table(atomic_load_explicit(&map->table, memory_order_relaxed)->cap);
+    if (!table) {
+        unlock_all(map);
+        return AT_MEMORY_ERROR;
+    }
+    replace_table_locked(map, table);
+    atomic_store_explicit(&map->size, 0, memory_order_relaxed);
+    unlock_all(map);
+    return AT_SUCCESS;
+}
+
+
+i32 c_map_find(const concurrent_map* map, const u64 key, u64* value) {
+    if (!map || !value) return AT_INVALID_ARGUMENT;
+
+    if (!atomic_load_explicit(&map->table, memory_order_acquire)) return AT_NOT_INITIALIZED;
+
+    const u64 hash = hash_key(key);
+    const u32 stripe_index = get_stripe_index(hash);            // spreads the reader counters like the writers
+    const u64 epoch = read_begin(map, stripe_index);
+    const b8 found = find_in_table(atomic_load(&map->table), key, hash, value);
+    read_end(map, stripe_index, epoch);
+    return found ? AT_SUCCESS : AT_ERROR;
+}
+
+
+b8 c_map_next(const concurrent_map* map, size_t* iterator, u64* key, u64* value) {
+
+    if (!map || !iterator)
+        return false;
+
+    if (!atomic_load_explicit(&map->table, memory_order_acquire))
+        return false;
+
+    const u32 stripe_index = (u32)(*iterator & (C_MAP_STRIPES - 1));
+    const u64 epoch = read_begin(map, stripe_index);
+    const c_map_table* table = atomic_load(&map->table);
+
+    b8 found = false;
+    size_t x = *iterator;
+    for (; x < table->cap && !found; x++) {
+        u64 slot_key, slot_value;
+        if (!read_slot(&table->slots[x], &slot_key, &slot_value))
+            continue;
+        if (key)    *key = slot_key;
+        if (value)  *value = slot_value;
+        found = true;
+    }
+    *iterator = found ? x : table->cap;
+
+    read_end(map, stripe_index, epoch);
+    return found;
+}
+
+
+size_t c_map_size(const concurrent_map* map)       { return map ? atomic_load_explicit(&map->size, memory_order_relaxed) : 0; }
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <pthread.h>
+
+#include "data_types.h"
+
+
+// Hash map for registries that are shared between threads, u64 keys and u64 values (store handles, IDs or pointers cast to u64).
+//
+//  - c_map_find / c_map_next never lock and never allocate (a read only repeats a slot that a writer changed at the same moment),
+//    so they can be called from any thread at any time, including a signal handler
+//  - writers lock one of C_MAP_STRIPES mutexes, chosen by the hash of the key, so writers of different keys rarely wait for each other
+//  - every slot carries a change counter that readers check before and after reading it, so a reader never pairs a key with the
+//    value of another entry when a slot is erased and reused meanwhile
+//  - a table that was replaced (growth, c_map_clear) is freed after a grace period: readers register in a counter of their stripe for
+//    the current epoch, the writer that replaced the table advances the epoch and waits until no reader of the previous epoch is left.
+//    New readers count in the other epoch, so a steady stream of readers does not hold the writer back. A reader that never returns
+//    (e.g. a crash inside c_map_find) blocks the next replacement
+//
+// Open addressing with linear probing. Erased slots stay in use as tombstones, the table is replaced when 7/8 of its slots were ever
+// used: by a larger one if the map is full, otherwise by a compacted one of the same or a smaller size.
+
+#define C_MAP_STRIPES           16
+
+typedef struct c_map_table c_map_table;
+
+typedef struct {
+    alignas(64) pthread_mutex_t mutex;          // one cache line per stripe
+    _Atomic u32             readers[2];         // lock free readers of this stripe, per parity of [concurrent_map.epoch]
+} c_map_stripe;
+
+typedef struct {
+    _Atomic(c_map_table*)   table;              // current table, NULL if not initialized
+    _Atomic u64             epoch;              // advanced every time a table is replaced
+    _Atomic size_t          size;
+    c_map_stripe            stripes[C_MAP_STRIPES];
+} concurrent_map;
+
+
+// @brief Initializes the map, not thread safe
+// @param capacity Number of entries the map should hold without growing
+// @return AT_SUCCESS, AT_INVALID_ARGUMENT or AT_MEMORY_ERROR
+i32 c_map_init(concurrent_map* map, size_t capacity);
+
+// @brief Frees the map, no other thread may use the map anymore
+i32 c_map_free(concurrent_map* map);
+
+// @brief Inserts [key] or replaces its value
+i32 c_map_insert(concurrent_map* map, const u64 key, const u64 value);
+
+// @brief Removes [key], AT_ERROR if it is not in the map
+i32 c_map_erase(concurrent_map* map, const u64 key);
+
+// @brief Removes all entries
+i32 c_map_clear(concurrent_map* map);
+
+// @brief Looks up [key] without locking, async-signal-safe
+// @return AT_SUCCESS, AT_ERROR if [key] is not in the map or AT_NOT_INITIALIZED
+i32 c_map_find(const concurrent_map* map, const u64 key, u64* value);
+
+// @brief Iterates over all entries without locking, async-signal-safe. Entries inserted or erased during the iteration may or may not
+//        be returned, if the table is replaced meanwhile entries can be skipped or returned twice.
+// @param iterator Set to 0 before the first call
+// @param key Receives the key of the entry, can be NULL
+// @param value Receives the value of the entry, can be NULL
+// @return true if an entry was returned, false after the last one
+b8 c_map_next(const concurrent_map* map, size_t* iterator, u64* key, u64* value);
+
+// @brief Number of entries
+size_t c_map_size(const concurrent_map* map);
@@ -16,6 +16,22 @@
 
 
 
+// Element pointer from an index
+#define ELEMENT(d, index)       ((char*)(d)->data + ((index) * (d)->element_size))
+
+
+// Grows geometrically (at least doubling) so that [required] elements fit, a bulk operation reallocates at most once
+static i32 ensure_capacity(darray* d, size_t required) {
+
+    if (required <= d->capacity) return AT_SUCCESS;
+
+    size_t new_capacity = d->capacity * 2;
+    if (new_capacity < 8) new_capacity = 8;
+    if (new_capacity < required) new_capacity = required;
+    return darray_reserve(d, new_capacity);
+}
+
+
 // ============================================================================================================================================
 // Initialization and cleanup
 // ============================================================================================================================================
@@ -28,28 +44,55 @@ i32 darray_init(darray* d, size_t element_size) {
 
 
 i32 darray_init_with_capacity(darray* d, size_t element_size, size_t initial_capacity) {
+
+    return darray_init_with_allocator(d, element_size, initial_capacity, NULL);
+}
+
+
+i32 darray_init_with_allocator(darray* d, size_t element_size, size_t initial_capacity, const allocator* alloc) {
     
     if (!d || element_size == 0) return AT_INVALID_ARGUMENT;
     if (d->magic == MAGIC) return AT_ALREADY_INITIALIZED;
     
-    d->data = malloc(element_size * initial_capacity);
+    d->alloc = allocator_or_default(alloc);
+    d->data = allocator_alloc(d->alloc, element_size * initial_capacity);
     if (!d->data) return AT_MEMORY_ERROR;
     
     d->count = 0;
     d->capacity = initial_capacity;
     d->element_size = element_size;
     d->magic = MAGIC;
+    d->owns_data = true;
     
     return AT_SUCCESS;
 }
 
 
+i32 darray_init_with_buffer(darray* d, size_t element_size, void* buffer, size_t capacity) {
+
+    if (!d || element_size == 0 || !buffer || capacity == 0) return AT_INVALID_ARGUMENT;
+    if (d->magic == MAGIC) return AT_ALREADY_INITIALIZED;
+
+    d->data = buffer;
+    d->count = 0;
+    d->capacity = capacity;
+    d->element_size = element_size;
+    d->alloc = allocator_get_default();
+    d->magic = MAGIC;
+    d->owns_data = false;
+
+    return AT_SUCCESS;
+}
+
+
 i32 darray_free(darray* d) {
 
     VALIDATE(d);
     
-    free(d->data);
+    if (d->owns_data)
+        allocator_free(d->alloc, d->data, d->capacity * d->element_size);
     d->data = NULL;
+    d->alloc = NULL;
     d->count = d->capacity = d->element_size = 0;
     d->magic = 0;
     
@@ -93,9 +136,14 @@ i32 darray_reserve(darray* d, size_t new_capacity) {
     VALIDATE(d);
     if (new_capacity <= d->capacity) return AT_SUCCESS;
     
-    void* new_data = realloc(d->data, new_capacity * d->element_size);
+    void* new_data = d->owns_data ? allocator_realloc(d->alloc, d->data, d->capacity * d->element_size, new_capacity * d->element_size)
+                                  : allocator_alloc(d->alloc, new_capacity * d->element_size);
     if (!new_data) return AT_MEMORY_ERROR;
     
+    if (!d->owns_data) {                // leave the caller buffer, it is not touched anymore
+        memcpy(new_data, d->data, d->count * d->element_size);
+        d->owns_data = true;
+    }
     d->data = new_data;
     d->capacity = new_capacity;
     
@@ -106,9 +154,9 @@ i32 darray_reserve(darray* d, size_t new_capacity) {
 i32 darray_shrink_to_fit(darray* d) {
 
     VALIDATE(d);
-    if (d->count == d->capacity) return AT_SUCCESS;
+    if (d->count == d->capacity || !d->owns_data) return AT_SUCCESS;
     
-    void* new_data = realloc(d->data, d->count * d->element_size);
+    void* new_data = allocator_realloc(d->alloc, d->data, d->capacity * d->element_size, d->count * d->element_size);
     if (!new_data && d->count > 0) return AT_MEMORY_ERROR;
     
     d->data = new_data;
@@ -212,6 +260,91 @@ i32 darray_clear(darray* d) {
 }
 
 
+// ============================================================================================================================================
+// Bulk operations
+// ============================================================================================================================================
+
+
+i32 darray_append_n(darray* d, const void* elements, size_t count) {
+
+    VALIDATE(d);
+    if (!elements && count > 0) return AT_INVALID_ARGUMENT;
+    if (count == 0) return AT_SUCCESS;
+
+    i32 result = ensure_capacity(d, d->count + count);
+    if (result != AT_SUCCESS) return result;
+
+    memcpy(ELEMENT(d, d->count), elements, count * d->element_size);
+    d->count += count;
+    return AT_SUCCESS;
+}
+
+
+i32 darray_insert_range(darray* d, size_t index, const void* elements, size_t count) {
+
+    VALIDATE(d);
+    if (!elements && count > 0) return AT_INVALID_ARGUMENT;
+    if (index > d->count) return AT_RANGE_ERROR;
+    if (count == 0) return AT_SUCCESS;
+
+    i32 result = ensure_capacity(d, d->count + count);
+    if (result != AT_SUCCESS) return result;
+
+    // Move the tail once, by the whole range
+    memmove(ELEMENT(d, index + count), ELEMENT(d, index), (d->count - index) * d->element_size);
+    memcpy(ELEMENT(d, index), elements, count * d->element_size);
+    d->count += count;
+    return AT_SUCCESS;
+}
+
+
+i32 darray_erase_range(darray* d, size_t index, size_t count) {
+
+    VALIDATE(d);
+    if (index > d->count || count > d->count - index) return AT_RANGE_ERROR;
+    if (count == 0) return AT_SUCCESS;
+
+    memmove(ELEMENT(d, index), ELEMENT(d, index + count), (d->count - index - count) * d->element_size);
+    d->count -= count;
+    return AT_SUCCESS;
+}
+
+
+i32 darray_erase_if(darray* d, darray_predicate predicate, void* user_data, size_t* out_removed) {
+
+    VALIDATE(d);
+    if (!predicate) return AT_INVALID_ARGUMENT;
+
+    // Kept elements are copied forward over the removed ones, every element is moved at most once
+    size_t kept = 0;
+    for (size_t x = 0; x < d->count; x++) {
+        if (predicate(ELEMENT(d, x), user_data))
+            continue;
+
+        if (kept != x)
+            memcpy(ELEMENT(d, kept), ELEMENT(d, x), d->element_size);
+        kept++;
+    }
+
+    if (out_removed)
+        *out_removed = d->count - kept;
+    d->count = kept;
+    return AT_SUCCESS;
+}
+
+
+i32 darray_swap_remove(darray* d, size_t index) {
+
+    VALIDATE(d);
+    if (index >= d->count) return AT_RANGE_ERROR;
+
+    d->count--;
+    if (index != d->count)
+        memcpy(ELEMENT(d, index), ELEMENT(d, d->count), d->element_size);
+    return AT_SUCCESS;
+}
+
+
 // ============================================================================================================================================
 // Utility
 // ============================================================================================================================================
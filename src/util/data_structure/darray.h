@@ -3,16 +3,34 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include "util/data_structure/data_types.h"
+#include "util/data_structure/allocator.h"
 
 typedef struct {
     void* data;
     size_t count;
     size_t capacity;
     size_t element_size;
+    const allocator* alloc;
     u64 magic;
+    b8 owns_data;           // false while [data] is the caller buffer of darray_init_with_buffer
 } darray;
 
 
+// darray with inline storage for [capacity] elements of [type], for short arrays that should not touch the heap. Initialize it
+// with darray_init_small(&name) and do not copy it after that ([array.data] points into the struct):
+//
+//      DARRAY_SMALL(u32, 16) ids = {0};
+//      darray_init_small(&ids);
+//      darray_push_back(&ids.array, &id);
+//      darray_free(&ids.array);                                // only frees something if the array outgrew the inline storage
+#define DARRAY_SMALL(type, capacity)    struct { darray array; type inline_data[capacity]; }
+
+// @brief Initializes a DARRAY_SMALL, the elements move to the heap when they outgrow the inline storage
+#define darray_init_small(small)                                                                                                            \
+    darray_init_with_buffer(&(small)->array, sizeof((small)->inline_data[0]), (small)->inline_data,                                         \
+                            sizeof((small)->inline_data) / sizeof((small)->inline_data[0]))
+
+
 // ============================================================================================================================================
 // Initialization and cleanup
 // ============================================================================================================================================
@@ -32,7 +50,26 @@ i32 darray_init(darray* d, size_t element_size);
 i32 darray_init_with_capacity(darray* d, size_t element_size, size_t initial_capacity);
 
 
-// @brief Frees the memory used by the dynamic array
+// @brief Initializes a dynamic array that takes its memory from [alloc]
+// @param d Pointer to the darray structure to initialize
+// @param element_size Size of each element in bytes
+// @param initial_capacity Initial capacity of the array
+// @param alloc Allocator for the elements, NULL for the default allocator
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_init_with_allocator(darray* d, size_t element_size, size_t initial_capacity, const allocator* alloc);
+
+
+// @brief Initializes a dynamic array that stores its first [capacity] elements in [buffer] instead of allocating,
+//        the elements are moved to the default allocator when the array grows beyond that
+// @param d Pointer to the darray structure to initialize
+// @param element_size Size of each element in bytes
+// @param buffer Caller memory for [capacity] elements, has to stay valid until darray_free()
+// @param capacity Number of elements that fit into [buffer]
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_init_with_buffer(darray* d, size_t element_size, void* buffer, size_t capacity);
+
+
+// @brief Frees the memory used by the dynamic array (a caller buffer is not freed)
 // @param d Pointer to the darray structure to free
 // @return AT_SUCCESS on success, error code on failure
 i32 darray_free(darray* d);
@@ -127,6 +164,61 @@ i32 darray_erase(darray* d, size_t index);
 i32 darray_clear(darray* d);
 
 
+// ============================================================================================================================================
+// Bulk operations
+// ============================================================================================================================================
+
+// Each of these reallocates at most once and moves the existing elements at most once, independent of the number of elements
+// added or removed
+
+// @brief Callback for darray_erase_if
+// @param element Pointer to the element
+// @param user_data Pointer passed to darray_erase_if
+// @return true if the element should be removed
+typedef b8 (*darray_predicate)(const void* element, void* user_data);
+
+
+// @brief Adds [count] elements to the end of the array
+// @param d Pointer to the darray structure
+// @param elements Pointer to [count] contiguous elements
+// @param count Number of elements to add
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_append_n(darray* d, const void* elements, size_t count);
+
+
+// @brief Inserts [count] elements at the specified position
+// @param d Pointer to the darray structure
+// @param index Position where the first element should be inserted, can be the size of the array
+// @param elements Pointer to [count] contiguous elements, must not point into the array itself
+// @param count Number of elements to insert
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_insert_range(darray* d, size_t index, const void* elements, size_t count);
+
+
+// @brief Removes [count] elements starting at the specified position
+// @param d Pointer to the darray structure
+// @param index Position of the first element to remove
+// @param count Number of elements to remove
+// @return AT_SUCCESS on success, AT_RANGE_ERROR if the range is not inside the array
+i32 darray_erase_range(darray* d, size_t index, size_t count);
+
+
+// @brief Removes all elements for which [predicate] returns true in a single pass, the order of the kept elements is preserved
+// @param d Pointer to the darray structure
+// @param predicate Called once per element
+// @param user_data Passed to [predicate]
+// @param out_removed Optional pointer to store the number of removed elements
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_erase_if(darray* d, darray_predicate predicate, void* user_data, size_t* out_removed);
+
+
+// @brief Removes the element at the specified position by moving the last element into its place, O(1) but does not keep the order
+// @param d Pointer to the darray structure
+// @param index Position of the element to remove
+// @return AT_SUCCESS on success, error code on failure
+i32 darray_swap_remove(darray* d, size_t index);
+
+
 // ============================================================================================================================================
 // Utility
 // ============================================================================================================================================
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_types.h"
+#include "util/breakpoint.h"
+
+
+// Typed dynamic arrays generated by a macro template. Elements are stored as [T] and accessed through typed pointers, so push / at /
+// pop compile to direct loads and stores that the compiler can inline and vectorize, without the element_size multiply and memcpy of
+// the generic darray (which stays for code that only knows the element size at runtime).
+//
+//      DEFINE_DARRAY(u64_array, u64)
+//
+//      u64_array lines = {0};
+//      u64_array_init(&lines, 64);
+//      u64_array_push(&lines, 42);
+//      for (size_t x = 0; x < lines.count; x++)
+//          total += lines.data[x];                                 // or *u64_array_at(&lines, x)
+//      u64_array_free(&lines);
+//
+// Checks (initialized, index in bounds) only exist in DEBUG builds: functions returning i32 then return AT_NOT_INITIALIZED /
+// AT_RANGE_ERROR and accessors returning pointers or elements stop at a BREAK_POINT. Release builds do no checks at all.
+
+
+#define DARRAY_TEMPLATE_MAGIC           0xDEADBEEFDEADBEEF
+#define DARRAY_TEMPLATE_MIN_CAPACITY    16
+
+#if defined(DEBUG)
+    #define DARRAY_DEBUG_VALIDATE(array)                                                                                                    \
+        do {                                                                                                                                \
+            if (!(array)) return AT_INVALID_ARGUMENT;                                                                                       \
+            if ((array)->magic != DARRAY_TEMPLATE_MAGIC) return AT_NOT_INITIALIZED;                                                         \
+        } while (0)
+    #define DARRAY_DEBUG_VALIDATE_INDEX(array, index, end)                                                                                  \
+        do {                                                                                                                                \
+            DARRAY_DEBUG_VALIDATE(array);                                                                                                   \
+            if ((index) >= (end)) return AT_RANGE_ERROR;                                                                                    \
+        } while (0)
+    #define DARRAY_DEBUG_TRAP_INDEX(array, index)                                                                                           \
+        do {                                                                                                                                \
+            if (!(array) || (array)->magic != DARRAY_TEMPLATE_MAGIC || (index) >= (array)->count)                                           \
+                BREAK_POINT();                                                                                                              \
+        } while (0)
+#else
+    #define DARRAY_DEBUG_VALIDATE(array)                        do { } while (0)
+    #define DARRAY_DEBUG_VALIDATE_INDEX(array, index, end)      do { } while (0)
+    #define DARRAY_DEBUG_TRAP_INDEX(array, index)               do { } while (0)
+#endif
+
+
+// @brief Defines the array type [name] with static inline functions:
+//        [name]_init, [name]_free, [name]_reserve, [name]_resize, [name]_push, [name]_pop, [name]_at, [name]_insert, [name]_erase,
+//        [name]_append_n, [name]_insert_range, [name]_erase_range, [name]_erase_if, [name]_swap_remove, [name]_clear
+// @param name Name of the array type, also the prefix of its functions
+// @param T Type of the elements, copied by assignment
+#define DEFINE_DARRAY(name, T)                                                                                                              \
+    typedef T name##_element;                                                                                                               \
+                                                                                                                                            \
+    typedef struct {                                                                                                                        \
+        name##_element*     data;                                                                                                           \
+        size_t              count;                                                                                                          \
+        size_t              capacity;                                                                                                       \
+        u64                 magic;                  /* only checked in DEBUG builds */                                                      \
+    } name;                                                                                                                                 \
+                                                                                                                                            \
+    /* Out of line so the fast path of push / insert stays small enough to be inlined */                                                    \
+    static __attribute__((noinline)) i32 name##_grow(name* array, const size_t min_capacity) {                                              \
+        size_t capacity = array->capacity ? array->capacity * 2 : DARRAY_TEMPLATE_MIN_CAPACITY;                                             \
+        while (capacity < min_capacity)                                                                                                     \
+            capacity *= 2;                                                                                                                  \
+        name##_element* data = realloc(array->data, capacity * sizeof(name##_element));                                                     \
+        if (!data) return AT_MEMORY_ERROR;                                                                                                  \
+        array->data = data;                                                                                                                 \
+        array->capacity = capacity;                                                                                                         \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* @param capacity Number of elements to allocate up front, 0 for none */                                                               \
+    static inline i32 name##_init(name* array, const size_t capacity) {                                                                     \
+        if (!array) return AT_INVALID_ARGUMENT;                                                                                             \
+        if (array->magic == DARRAY_TEMPLATE_MAGIC) return AT_ALREADY_INITIALIZED;                                                           \
+        *array = (name){ .magic = DARRAY_TEMPLATE_MAGIC };                                                                                  \
+        return capacity ? name##_grow(array, capacity) : AT_SUCCESS;                                                                        \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    static inline i32 name##_free(name* array) {                                                                                            \
+        if (!array) return AT_INVALID_ARGUMENT;                                                                                             \
+        if (array->magic != DARRAY_TEMPLATE_MAGIC) return AT_NOT_INITIALIZED;                                                               \
+        free(array->data);                                                                                                                  \
+        memset(array, 0, sizeof(name));                                                                                                     \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Makes room for at least [capacity] elements */                                                                                       \
+    static inline i32 name##_reserve(name* array, const size_t capacity) {                                                                  \
+        DARRAY_DEBUG_VALIDATE(array);                                                                                                       \
+        return (capacity > array->capacity) ? name##_grow(array, capacity) : AT_SUCCESS;                                                    \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* New elements are set to [value] */                                                                                                   \
+    static inline i32 name##_resize(name* array, const size_t count, const name##_element value) {                                          \
+        DARRAY_DEBUG_VALIDATE(array);                                                                                                       \
+        if (count > array->capacity && name##_grow(array, count) != AT_SUCCESS) return AT_MEMORY_ERROR;                                     \
+        for (size_t x = array->count; x < count; x++)                                                                                       \
+            array->data[x] = value;                                                                                                         \
+        array->count = count;                                                                                                               \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    static inline i32 name##_push(name* array, const name##_element value) {                                                                \
+        DARRAY_DEBUG_VALIDATE(array);                                                                                                       \
+        if (array->count == array->capacity && name##_grow(array, array->count + 1) != AT_SUCCESS) return AT_MEMORY_ERROR;                  \
+        array->data[array->count++] = value;                                                                                                \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Removes and returns the last element, the array must not be empty */                                                                 \
+    static inline name##_element name##_pop(name* array) {                                                                                  \
+        DARRAY_DEBUG_TRAP_INDEX(array, array->count - 1);                                                                                   \
+        return array->data[--array->count];                                                                                                 \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Pointer to the element at [index], valid until the array grows */                                                                    \
+    static inline name##_element* name##_at(const name* array, const size_t index) {                                                        \
+        DARRAY_DEBUG_TRAP_INDEX(array, index);                                                                                              \
+        return &array->data[index];                                                                                                         \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Moves the elements from [index] on back by one, [index] can be [count] */                                                            \
+    static inline i32 name##_insert(name* array, const size_t index, const name##_element value) {                                          \
+        DARRAY_DEBUG_VALIDATE_INDEX(array, index, array->count + 1);                                                                        \
+        if (array->count == array->capacity && name##_grow(array, array->count + 1) != AT_SUCCESS) return AT_MEMORY_ERROR;                  \
+        memmove(&array->data[index + 1], &array->data[index], (array->count - index) * sizeof(name##_element));                             \
+        array->data[index] = value;                                                                                                         \
+        array->count++;                                                                                                                     \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Moves the elements after [index] forward by one */                                                                                   \
+    static inline i32 name##_erase(name* array, const size_t index) {                                                                       \
+        DARRAY_DEBUG_VALIDATE_INDEX(array, index, array->count);                                                                            \
+        memmove(&array->data[index], &array->data[index + 1], (array->count - index - 1) * sizeof(name##_element));                         \
+        array->count--;                                                                                                                     \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Copies [count] elements to the end, reallocates at most once */                                                                      \
+    static inline i32 name##_append_n(name* array, const name##_element* values, const size_t count) {                                      \
+        DARRAY_DEBUG_VALIDATE(array);                                                                                                       \
+        if (array->count + count > array->capacity && name##_grow(array, array->count + count) != AT_SUCCESS) return AT_MEMORY_ERROR;       \
+        memcpy(&array->data[array->count], values, count * sizeof(name##_element));                                                         \
+        array->count += count;                                                                                                              \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Moves the elements from [index] on back by [count] in one memmove, [values] must not point into the array */                         \
+    static inline i32 name##_insert_range(name* array, const size_t index, const name##_element* values, const size_t count) {              \
+        DARRAY_DEBUG_VALIDATE_INDEX(array, index, array->count + 1);                                                                        \
+        if (array->count + count > array->capacity && name##_grow(array, array->count + count) != AT_SUCCESS) return AT_MEMORY_ERROR;       \
+        memmove(&array->data[index + count], &array->data[index], (array->count - index) * sizeof(name##_element));                         \
+        memcpy(&array->data[index], values, count * sizeof(name##_element));                                                                \
+        array->count += count;                                                                                                              \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Removes [count] elements starting at [index] with one memmove */                                                                     \
+    static inline i32 name##_erase_range(name* array, const size_t index, const size_t count) {                                             \
+        DARRAY_DEBUG_VALIDATE_INDEX(array, index + count, array->count + 1);                                                                \
+        memmove(&array->data[index], &array->data[index + count], (array->count - index - count) * sizeof(name##_element));                 \
+        array->count -= count;                                                                                                              \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Removes every element [predicate] returns true for in a single pass, keeps the order of the others. Returns the removed count */     \
+    static inline size_t name##_erase_if(name* array, b8 (*predicate)(const name##_element*, void*), void* user_data) {                     \
+        size_t kept = 0;                                                                                                                    \
+        for (size_t x = 0; x < array->count; x++)                                                                                           \
+            if (!predicate(&array->data[x], user_data))                                                                                     \
+                array->data[kept++] = array->data[x];                                                                                       \
+        const size_t removed = array->count - kept;                                                                                         \
+        array->count = kept;                                                                                                                \
+        return removed;                                                                                                                     \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Moves the last element into [index], O(1) but changes the order */                                                                   \
+    static inline i32 name##_swap_remove(name* array, const size_t index) {                                                                 \
+        DARRAY_DEBUG_VALIDATE_INDEX(array, index, array->count);                                                                            \
+        array->data[index] = array->data[--array->count];                                                                                   \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Keeps the memory */                                                                                                                  \
+    static inline void name##_clear(name* array) {                                                                                          \
+        array->count = 0;                                                                                                                   \
+    }
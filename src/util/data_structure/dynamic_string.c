@@ -25,30 +25,45 @@
 
 i32 ds_init(dyn_str* s) {
 
+    return ds_init_with_allocator(s, 4096 - 64, NULL);
+}
+
+
+i32 ds_init_s(dyn_str* s, const size_t needed_size) {
+
+    return ds_init_with_allocator(s, needed_size, NULL);
+}
+
+
+i32 ds_init_with_allocator(dyn_str* s, const size_t needed_size, const allocator* alloc) {
+
     if (s->magic == MAGIC) return AT_ALREADY_INITIALIZED;
 
-    s->cap = 4096;
-    s->data = malloc(s->cap);
+    s->alloc = allocator_or_default(alloc);
+    s->cap = needed_size + 64;      // add small buffer
+    s->data = allocator_alloc(s->alloc, s->cap);
     if (!s->data) return AT_MEMORY_ERROR;
 
     s->len = 0;
     s->data[0] = '\0';
     s->magic = MAGIC;
+    s->storage = DS_STORAGE_HEAP;
     return AT_SUCCESS;
 }
 
 
-i32 ds_init_s(dyn_str* s, const size_t needed_size) {
+i32 ds_init_buffer(dyn_str* s, char* buffer, const size_t size, const b8 can_grow) {
 
     if (s->magic == MAGIC) return AT_ALREADY_INITIALIZED;
+    if (!buffer || size == 0) return AT_INVALID_ARGUMENT;
 
-    s->cap = needed_size + 64;      // add small buffer
-    s->data = malloc(s->cap);
-    if (!s->data) return AT_MEMORY_ERROR;
-
+    s->data = buffer;
+    s->cap = size;
     s->len = 0;
     s->data[0] = '\0';
     s->magic = MAGIC;
+    s->storage = can_grow ? DS_STORAGE_BUFFER : DS_STORAGE_FIXED;
+    s->alloc = allocator_get_default();
     return AT_SUCCESS;
 }
 
@@ -86,8 +101,7 @@ i32 ds_from_file(dyn_str* s, FILE* file) {
     s->len = fread(s->data, 1, (size_t)file_size, file);
     if (s->len != (size_t)file_size) {
         // Handle read error
-        free(s->data);
-        s->magic = 0;
+        ds_free(s);
         return AT_IO_ERROR;
     }
     
@@ -108,10 +122,13 @@ i32 ds_free(dyn_str* s) {
 
     VALIDATE(s);
 
-    free(s->data);
+    if (s->storage == DS_STORAGE_HEAP)
+        allocator_free(s->alloc, s->data, s->cap);
     s->data = NULL;
     s->len = s->cap = 0;
     s->magic = 0;
+    s->storage = DS_STORAGE_HEAP;
+    s->alloc = NULL;
     return AT_SUCCESS;
 }
 
@@ -179,7 +196,7 @@ i32 ds_append_fmt(dyn_str* s, i32* needed_space, const char* fmt, ...) {
 
     if (*needed_buffer > 0) {
 
-        const i32 result = ds_ensure(s, (size_t)needed_space);
+        const i32 result = ds_ensure(s, (size_t)*needed_buffer);
         if (result != AT_SUCCESS) {
             va_end(ap);
             return result;
@@ -431,8 +448,8 @@ i32 ds_replace(dyn_str* s, const char* old_str, const char* new_str) {
     if (old_len == 0) return AT_SUCCESS; // Nothing to replace
     
     // Find all occurrences
-    dyn_str result;
-    const i32 init_result = ds_init(&result);
+    dyn_str result = {0};
+    const i32 init_result = ds_init_with_allocator(&result, s->len, s->alloc);
     if (init_result != AT_SUCCESS) return init_result;
     
     size_t pos = 0;
@@ -445,10 +462,20 @@ i32 ds_replace(dyn_str* s, const char* old_str, const char* new_str) {
     }
     
     ds_append_str(&result, s->data + pos);          // Append the remaining part
-    ds_free(s);                                     // Swap the contents
-    *s = result;
-    
-    return AT_SUCCESS;
+    if (s->storage == DS_STORAGE_HEAP) {
+        ds_free(s);                                 // Swap the contents
+        *s = result;
+        return AT_SUCCESS;
+    }
+
+    // a caller buffer stays the storage of [s]
+    const i32 copy_result = (result.len > s->len) ? ds_ensure(s, result.len - s->len) : AT_SUCCESS;
+    if (copy_result == AT_SUCCESS) {
+        memcpy(s->data, result.data, result.len + 1);
+        s->len = result.len;
+    }
+    ds_free(&result);
+    return copy_result;
 }
 
 
@@ -467,15 +494,9 @@ i32 ds_replace_range(dyn_str* s, const size_t start_pos, const size_t length, co
     const size_t new_total_len = s->len - remove_len + new_str_len;
 
     // Ensure we have enough capacity
-    if (new_total_len + 1 > s->cap) {
-        size_t new_cap = s->cap;
-        while (new_cap < new_total_len + 1) {
-            new_cap *= 2;
-        }
-        char* new_data = realloc(s->data, new_cap);
-        if (!new_data) return AT_MEMORY_ERROR;
-        s->data = new_data;
-        s->cap = new_cap;
+    if (new_total_len > s->len) {
+        const i32 result = ds_ensure(s, new_total_len - s->len);
+        if (result != AT_SUCCESS) return result;
     }
 
     // Move the tail of the string if needed
@@ -591,12 +612,24 @@ i32 ds_ensure(dyn_str* s, const size_t extra) {
 
     const size_t need = s->len + extra + 1;
     if (need > s->cap) {
-        while (s->cap < need)
-            s->cap *= 2;
+        if (s->storage == DS_STORAGE_FIXED) return AT_RANGE_ERROR;
 
-        char* new_data = realloc(s->data, s->cap);
-        if (!new_data)  return AT_MEMORY_ERROR;
-        s->data = new_data;
+        size_t new_cap = s->cap;
+        while (new_cap < need)
+            new_cap *= 2;
+
+        if (s->storage == DS_STORAGE_BUFFER) {      // leave the caller buffer, it is not touched anymore
+            char* new_data = allocator_alloc(s->alloc, new_cap);
+            if (!new_data)  return AT_MEMORY_ERROR;
+            memcpy(new_data, s->data, s->len + 1);
+            s->data = new_data;
+            s->storage = DS_STORAGE_HEAP;
+        } else {
+            char* new_data = allocator_realloc(s->alloc, s->data, s->cap, new_cap);
+            if (!new_data)  return AT_MEMORY_ERROR;
+            s->data = new_data;
+        }
+        s->cap = new_cap;
     }
     return AT_SUCCESS;
 }
@@ -4,17 +4,42 @@
 #include <sys/types.h>
 
 #include "data_types.h"
+#include "allocator.h"
    
 
 
+typedef enum {
+    DS_STORAGE_HEAP = 0,        // [data] is allocated with [alloc] and owned by the string
+    DS_STORAGE_BUFFER,          // [data] is a caller buffer, moves to [alloc] when it is too small
+    DS_STORAGE_FIXED,           // [data] is a caller buffer and never grows, operations that do not fit return AT_RANGE_ERROR
+} ds_storage;
+
 typedef struct {
     char*       data;   // pointer to the dynamically allocated string buffer
     size_t      len;    // current length of the string (excluding null terminator)
     size_t      cap;    // allocated capacity of the buffer
     u32         magic;  // Magic number to verify initialization
+    u32         storage;    // ds_storage, who owns [data]
+    const allocator* alloc; // allocator of [data]
 } dyn_str;
 
 
+// dyn_str with [size] bytes of inline storage, for short strings that should not touch the heap. Initialize it with
+// ds_init_small(&name) and do not copy it after that ([str.data] points into the struct):
+//
+//      DS_SMALL(256) line = {0};
+//      ds_init_small(&line);
+//      ds_append_fmt(&line.str, NULL, "%s: %d", key, value);
+//      ds_free(&line.str);                                     // only frees something if the string outgrew the inline storage
+#define DS_SMALL(size)              struct { dyn_str str; char inline_data[size]; }
+
+// @brief Initializes a DS_SMALL, the string moves to the heap when it outgrows the inline storage
+#define ds_init_small(small)        ds_init_buffer(&(small)->str, (small)->inline_data, sizeof((small)->inline_data), true)
+
+// @brief Initializes a DS_SMALL that never allocates, operations that do not fit the inline storage return AT_RANGE_ERROR
+#define ds_init_small_fixed(small)  ds_init_buffer(&(small)->str, (small)->inline_data, sizeof((small)->inline_data), false)
+
+
 
 // ============================================================================================================================================
 // init
@@ -30,6 +55,20 @@ i32 ds_init(dyn_str* s);
 i32 ds_init_s(dyn_str* s, const size_t needed_size);
 
 
+// @brief Initializes a dynamic string that takes its memory from [alloc]
+// @param needed_size The minimum inital capacity to allocate
+// @param alloc Allocator of the string, NULL for the default allocator
+i32 ds_init_with_allocator(dyn_str* s, const size_t needed_size, const allocator* alloc);
+
+
+// @brief Initializes a dynamic string that uses [buffer] as storage instead of allocating,
+//          [buffer] has to stay valid until ds_free()
+// @param buffer Caller memory (stack array, struct member, ...) of [size] bytes
+// @param can_grow true: the content moves to the default allocator when it does not fit into [buffer] anymore
+//                 false: the string never allocates, operations that do not fit return AT_RANGE_ERROR and change nothing
+i32 ds_init_buffer(dyn_str* s, char* buffer, const size_t size, const b8 can_grow);
+
+
 // @brief Initializes a dynamic stringfrom an existing C-string.
 //          Allocates enough memory to hold the provided string.
 // @param text The null-terminated string to initialize from.
@@ -42,7 +81,7 @@ i32 ds_from_file(dyn_str* s, FILE* file);
 // free
 // ============================================================================================================================================
 
-// @brief Frees the memory used by the dynamic string
+// @brief Frees the memory used by the dynamic string (a caller buffer is not freed)
 //          after this call, the string will be in an uninitialized state
 i32 ds_free(dyn_str* s);
 
@@ -229,4 +268,5 @@ i32 ds_iterate_lines(const dyn_str* ds, b8 (*callback)(const char* line, size_t
 // @brief Ensure hat the dynamic string has enough capacity to hold
 //          at least "extra" more characters beyond its current length.
 //          If necessary, reallocates the internal buffer.
+//          Returns AT_RANGE_ERROR for a DS_STORAGE_FIXED string that is too small.
 i32 ds_ensure(dyn_str* s, const size_t extra);
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_types.h"
+
+
+// Typed hash maps generated by a macro template. Same table layout as unordered_map (Swiss table: control byte groups, power of two
+// capacity, 7/8 load), but keys and values are stored by value and hash / equality are macros or inline functions, so lookups compile
+// to straight code without calls through function pointers.
+//
+//      DEFINE_HASHMAP(font_map, font_type, ImFont*, hash_u32, HASH_EQ_VALUE)
+//
+//      font_map fonts = {0};
+//      font_map_init(&fonts, 16);
+//      font_map_insert(&fonts, FT_REGULAR, font);
+//      ImFont** found = font_map_get(&fonts, FT_REGULAR);             // NULL if missing
+//      for (size_t it = 0; (entry = font_map_next(&fonts, &it)); )     // font_map_entry* entry: ->key, ->value
+//      font_map_free(&fonts);
+//
+// A zero initialized map counts as not initialized, functions return AT_NOT_INITIALIZED (or NULL) for it.
+
+
+// ============================================================================================================================================
+// control byte groups (shared with unordered_map)
+// ============================================================================================================================================
+
+// A group is HASH_GROUP_WIDTH consecutive control bytes, compared at once. A match returns a bit mask with one bit per matching byte,
+// bit (index << HASH_MASK_SHIFT) for the byte at [index]. The scalar version may report false positives for hash_group_match_h2.
+
+#define HASH_CTRL_EMPTY         ((u8)0x80)
+#define HASH_CTRL_DELETED       ((u8)0xFE)
+// full slots store the lower 7 bits of the hash (0x00 - 0x7F), so "high bit set" means EMPTY or DELETED
+#define HASH_CTRL_IS_FULL(ctrl) (((ctrl) & 0x80) == 0)
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+
+    #define HASH_GROUP_WIDTH    16
+    #define HASH_MASK_SHIFT     0
+    typedef u32 hash_group_mask;
+
+    static inline hash_group_mask hash_group_match_h2(const u8* ctrl, const u8 h2) {
+        return (hash_group_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)ctrl), _mm_set1_epi8((char)h2)));
+    }
+    static inline hash_group_mask hash_group_match_empty(const u8* ctrl) {
+        return (hash_group_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)ctrl), _mm_set1_epi8((char)HASH_CTRL_EMPTY)));
+    }
+    static inline hash_group_mask hash_group_match_empty_or_deleted(const u8* ctrl) {
+        return (hash_group_mask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+    }
+    static inline u32 hash_group_leading_zeros(const hash_group_mask mask) { return (u32)__builtin_clz(mask) - (32 - HASH_GROUP_WIDTH); }
+
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+
+    #define HASH_GROUP_WIDTH    8
+    #define HASH_MASK_SHIFT     3
+    #define HASH_GROUP_MSBS     0x8080808080808080ULL
+    typedef u64 hash_group_mask;
+
+    static inline hash_group_mask hash_group_match_h2(const u8* ctrl, const u8 h2) {
+        return vget_lane_u64(vreinterpret_u64_u8(vceq_u8(vld1_u8(ctrl), vdup_n_u8(h2))), 0) & HASH_GROUP_MSBS;
+    }
+    static inline hash_group_mask hash_group_match_empty(const u8* ctrl) {
+        return vget_lane_u64(vreinterpret_u64_u8(vceq_u8(vld1_u8(ctrl), vdup_n_u8(HASH_CTRL_EMPTY))), 0) & HASH_GROUP_MSBS;
+    }
+    static inline hash_group_mask hash_group_match_empty_or_deleted(const u8* ctrl) {
+        return vget_lane_u64(vreinterpret_u64_u8(vld1_u8(ctrl)), 0) & HASH_GROUP_MSBS;
+    }
+    static inline u32 hash_group_leading_zeros(const hash_group_mask mask) { return (u32)__builtin_clzll(mask) >> HASH_MASK_SHIFT; }
+
+#else
+    #define HASH_GROUP_WIDTH    8
+    #define HASH_MASK_SHIFT     3
+    #define HASH_GROUP_MSBS     0x8080808080808080ULL
+    #define HASH_GROUP_LSBS     0x0101010101010101ULL
+    typedef u64 hash_group_mask;
+
+    static inline u64 hash_group_load(const u8* ctrl) {
+        u64 group;
+        memcpy(&group, ctrl, sizeof(group));
+    #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        group = __builtin_bswap64(group);
+    #endif
+        return group;
+    }
+    static inline hash_group_mask hash_group_match_h2(const u8* ctrl, const u8 h2) {
+        const u64 x = hash_group_load(ctrl) ^ (HASH_GROUP_LSBS * h2);
+        return (x - HASH_GROUP_LSBS) & ~x & HASH_GROUP_MSBS;
+    }
+    static inline hash_group_mask hash_group_match_empty(const u8* ctrl) {
+        const u64 group = hash_group_load(ctrl);
+        return group & ~(group << 6) & HASH_GROUP_MSBS;            // 0x80 is the only control byte with the high bit set and bit 1 clear
+    }
+    static inline hash_group_mask hash_group_match_empty_or_deleted(const u8* ctrl) { return hash_group_load(ctrl) & HASH_GROUP_MSBS; }
+    static inline u32 hash_group_leading_zeros(const hash_group_mask mask) { return (u32)__builtin_clzll(mask) >> HASH_MASK_SHIFT; }
+#endif
+
+static inline u32 hash_group_lowest(const hash_group_mask mask)                 { return (u32)__builtin_ctzll(mask) >> HASH_MASK_SHIFT; }
+
+
+// @brief Mixes a (possibly weak) hash, so the position (hash_h1) and the control byte (hash_h2) both depend on every input bit
+static inline u64 hash_mix(u64 hash) {
+
+    hash *= 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+static inline size_t hash_h1(const u64 mixed_hash)                              { return (size_t)(mixed_hash >> 7); }
+static inline u8 hash_h2(const u64 mixed_hash)                                  { return (u8)(mixed_hash & 0x7F); }
+
+// @brief Maximum number of entries for [capacity] (7/8 load factor)
+static inline size_t hash_capacity_to_growth(const size_t capacity)             { return capacity - capacity / 8; }
+
+// @brief Smallest table capacity (power of two, at least one group) that holds [count] entries without growing
+static inline size_t hash_capacity_for(const size_t count) {
+
+    size_t capacity = HASH_GROUP_WIDTH;
+    while (hash_capacity_to_growth(capacity) < count)
+        capacity *= 2;
+    return capacity;
+}
+
+// @brief Sets the control byte of [index] and its copy behind the end of the array (only exists for the first HASH_GROUP_WIDTH - 1 slots)
+static inline void hash_set_ctrl(u8* ctrl, const size_t capacity, const size_t index, const u8 value) {
+
+    ctrl[index] = value;
+    ctrl[((index - (HASH_GROUP_WIDTH - 1)) & (capacity - 1)) + (HASH_GROUP_WIDTH - 1)] = value;
+}
+
+// @brief First EMPTY or DELETED slot on the probe sequence of [mixed_hash], the table must have EMPTY slots
+static inline size_t hash_find_insert_index(const u8* ctrl, const size_t capacity, const u64 mixed_hash) {
+
+    const size_t mask = capacity - 1;
+    size_t position = hash_h1(mixed_hash) & mask;
+    size_t stride = 0;
+    while (1) {
+        const hash_group_mask free_slots = hash_group_match_empty_or_deleted(ctrl + position);
+        if (free_slots)
+            return (position + hash_group_lowest(free_slots)) & mask;
+
+        stride += HASH_GROUP_WIDTH;                 // triangular steps visit every group of a power of two table
+        position = (position + stride) & mask;
+    }
+}
+
+// @brief Control byte for a slot that is erased. A probe only stops at an EMPTY slot, if no group containing [index] was ever full
+//        no probe went past it and it can become EMPTY again
+static inline u8 hash_erased_ctrl(const u8* ctrl, const size_t capacity, const size_t index) {
+
+    const hash_group_mask empty_after = hash_group_match_empty(ctrl + index);
+    const hash_group_mask empty_before = hash_group_match_empty(ctrl + ((index - HASH_GROUP_WIDTH) & (capacity - 1)));
+    const b8 was_never_full = empty_before && empty_after && (hash_group_lowest(empty_after) + hash_group_leading_zeros(empty_before)) < HASH_GROUP_WIDTH;
+    return was_never_full ? HASH_CTRL_EMPTY : HASH_CTRL_DELETED;
+}
+
+
+// ============================================================================================================================================
+// hash and equality functions for DEFINE_HASHMAP (the result is mixed by the map, identity is fine)
+// ============================================================================================================================================
+
+static inline u64 hash_u32(const u32 key)                                       { return key; }
+static inline u64 hash_u64(const u64 key)                                       { return key; }
+static inline u64 hash_ptr(const void* key)                                     { return (u64)(uintptr_t)key; }
+
+static inline u64 hash_string(const char* key) {
+
+    u64 hash = 5381;
+    for (const unsigned char* c = (const unsigned char*)key; *c; c++)
+        hash = ((hash << 5) + hash) + *c;           // hash * 33 + c
+    return hash;
+}
+
+#define HASH_EQ_VALUE(a, b)                     ((a) == (b))
+#define HASH_EQ_STRING(a, b)                    (strcmp((a), (b)) == 0)
+
+
+// ============================================================================================================================================
+// template
+// ============================================================================================================================================
+
+// @brief Defines the map type [name] (and [name]_entry) with static inline functions:
+//        [name]_init, [name]_free, [name]_get, [name]_find, [name]_insert, [name]_erase, [name]_next
+// @param name Name of the map type, also the prefix of its functions
+// @param key_t Type of the keys, stored by value
+// @param val_t Type of the values, stored by value
+// @param hash Function or macro (key_t) -> u64
+// @param eq Function or macro (key_t, key_t) -> true if equal
+#define DEFINE_HASHMAP(name, key_t, val_t, hash, eq)                                                                                        \
+                                                                                                                                            \
+    typedef key_t name##_key;               /* typedefs keep const correct for pointer types */                                             \
+    typedef val_t name##_value;                                                                                                             \
+                                                                                                                                            \
+    typedef struct {                                                                                                                        \
+        name##_key          key;                                                                                                            \
+        name##_value        value;                                                                                                          \
+    } name##_entry;                                                                                                                         \
+                                                                                                                                            \
+    typedef struct {                                                                                                                        \
+        u8*                 ctrl;                   /* [cap] control bytes + copies of the first group, NULL if not initialized */          \
+        name##_entry*       entries;                /* [cap] entries, the control bytes are stored in the same allocation */                \
+        size_t              size;                                                                                                           \
+        size_t              cap;                                                                                                            \
+        size_t              growth_left;            /* inserts into EMPTY slots until the map has to grow */                                \
+    } name;                                                                                                                                 \
+                                                                                                                                            \
+    static inline i32 name##_allocate(name* map, const size_t capacity) {                                                                   \
+        const size_t entry_bytes = capacity * sizeof(name##_entry);                                                                         \
+        u8* memory = malloc(entry_bytes + capacity + HASH_GROUP_WIDTH - 1);                                                                 \
+        if (!memory) return AT_MEMORY_ERROR;                                                                                                \
+        map->entries = (name##_entry*)memory;                                                                                               \
+        map->ctrl = memory + entry_bytes;                                                                                                   \
+        map->cap = capacity;                                                                                                                \
+        memset(map->ctrl, HASH_CTRL_EMPTY, capacity + HASH_GROUP_WIDTH - 1);                                                                \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Moves every entry into a new table of [capacity], which also removes all DELETED markers */                                          \
+    static inline i32 name##_rehash(name* map, const size_t capacity) {                                                                     \
+        const name old = *map;                                                                                                              \
+        if (name##_allocate(map, capacity) != AT_SUCCESS) {                                                                                 \
+            *map = old;                                                                                                                     \
+            return AT_MEMORY_ERROR;                                                                                                         \
+        }                                                                                                                                   \
+        for (size_t x = 0; x < old.cap; x++) {                                                                                              \
+            if (!HASH_CTRL_IS_FULL(old.ctrl[x])) continue;                                                                                  \
+            const u64 mixed = hash_mix(hash(old.entries[x].key));                                                                           \
+            const size_t index = hash_find_insert_index(map->ctrl, map->cap, mixed);                                                        \
+            hash_set_ctrl(map->ctrl, map->cap, index, hash_h2(mixed));                                                                      \
+            map->entries[index] = old.entries[x];                                                                                           \
+        }                                                                                                                                   \
+        map->growth_left = hash_capacity_to_growth(capacity) - map->size;                                                                   \
+        free(old.entries);                                                                                                                  \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* @param capacity Number of entries the map should hold without growing */                                                             \
+    static inline i32 name##_init(name* map, const size_t capacity) {                                                                       \
+        if (!map) return AT_INVALID_ARGUMENT;                                                                                               \
+        if (name##_allocate(map, hash_capacity_for(capacity)) != AT_SUCCESS) return AT_MEMORY_ERROR;                                        \
+        map->size = 0;                                                                                                                      \
+        map->growth_left = hash_capacity_to_growth(map->cap);                                                                               \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    static inline i32 name##_free(name* map) {                                                                                              \
+        if (!map) return AT_INVALID_ARGUMENT;                                                                                               \
+        if (!map->ctrl) return AT_NOT_INITIALIZED;                                                                                          \
+        free(map->entries);                                                                                                                 \
+        memset(map, 0, sizeof(name));                                                                                                       \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Index of [key] in [entries], (size_t)-1 if it is not in the map */                                                                   \
+    static inline size_t name##_find_index(const name* map, const name##_key key, const u64 mixed) {                                        \
+        const size_t mask = map->cap - 1;                                                                                                   \
+        const u8 h2 = hash_h2(mixed);                                                                                                       \
+        size_t position = hash_h1(mixed) & mask;                                                                                            \
+        size_t stride = 0;                                                                                                                  \
+        while (1) {                                                                                                                         \
+            const u8* group = map->ctrl + position;                                                                                         \
+            for (hash_group_mask match = hash_group_match_h2(group, h2); match; match &= match - 1) {                                       \
+                const size_t index = (position + hash_group_lowest(match)) & mask;                                                          \
+                if (eq(map->entries[index].key, key))                                                                                       \
+                    return index;                                                                                                           \
+            }                                                                                                                               \
+            if (hash_group_match_empty(group))                                                                                              \
+                return (size_t)-1;                                                                                                          \
+            stride += HASH_GROUP_WIDTH;                                                                                                     \
+            position = (position + stride) & mask;                                                                                          \
+        }                                                                                                                                   \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Pointer to the value of [key], NULL if it is not in the map. Valid until the next insert */                                          \
+    static inline name##_value* name##_get(const name* map, const name##_key key) {                                                         \
+        if (!map || !map->ctrl) return NULL;                                                                                                \
+        const size_t index = name##_find_index(map, key, hash_mix(hash(key)));                                                              \
+        return (index == (size_t)-1) ? NULL : &map->entries[index].value;                                                                   \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* AT_ERROR if [key] is not in the map */                                                                                               \
+    static inline i32 name##_find(const name* map, const name##_key key, name##_value* value) {                                             \
+        if (!map || !value) return AT_INVALID_ARGUMENT;                                                                                     \
+        if (!map->ctrl) return AT_NOT_INITIALIZED;                                                                                          \
+        const name##_value* found = name##_get(map, key);                                                                                   \
+        if (!found) return AT_ERROR;                                                                                                        \
+        *value = *found;                                                                                                                    \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Replaces the value if [key] is already in the map */                                                                                 \
+    static inline i32 name##_insert(name* map, const name##_key key, const name##_value value) {                                            \
+        if (!map) return AT_INVALID_ARGUMENT;                                                                                               \
+        if (!map->ctrl) return AT_NOT_INITIALIZED;                                                                                          \
+        const u64 mixed = hash_mix(hash(key));                                                                                              \
+        size_t index = name##_find_index(map, key, mixed);                                                                                  \
+        if (index != (size_t)-1) {                                                                                                          \
+            map->entries[index].value = value;                                                                                              \
+            return AT_SUCCESS;                                                                                                              \
+        }                                                                                                                                   \
+        index = hash_find_insert_index(map->ctrl, map->cap, mixed);                                                                         \
+        if (map->growth_left == 0 && map->ctrl[index] == HASH_CTRL_EMPTY) {                                                                 \
+            /* mostly DELETED markers: clean up at the same size, otherwise grow */                                                         \
+            const size_t capacity = (map->size < hash_capacity_to_growth(map->cap) / 2) ? map->cap : map->cap * 2;                          \
+            if (name##_rehash(map, capacity) != AT_SUCCESS) return AT_MEMORY_ERROR;                                                         \
+            index = hash_find_insert_index(map->ctrl, map->cap, mixed);                                                                     \
+        }                                                                                                                                   \
+        map->growth_left -= (map->ctrl[index] == HASH_CTRL_EMPTY);                                                                          \
+        hash_set_ctrl(map->ctrl, map->cap, index, hash_h2(mixed));                                                                          \
+        map->entries[index].key = key;                                                                                                      \
+        map->entries[index].value = value;                                                                                                  \
+        map->size++;                                                                                                                        \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* AT_ERROR if [key] is not in the map */                                                                                               \
+    static inline i32 name##_erase(name* map, const name##_key key) {                                                                       \
+        if (!map) return AT_INVALID_ARGUMENT;                                                                                               \
+        if (!map->ctrl) return AT_NOT_INITIALIZED;                                                                                          \
+        const size_t index = name##_find_index(map, key, hash_mix(hash(key)));                                                              \
+        if (index == (size_t)-1) return AT_ERROR;                                                                                           \
+        const u8 ctrl = hash_erased_ctrl(map->ctrl, map->cap, index);                                                                       \
+        hash_set_ctrl(map->ctrl, map->cap, index, ctrl);                                                                                    \
+        map->growth_left += (ctrl == HASH_CTRL_EMPTY);                                                                                      \
+        map->size--;                                                                                                                        \
+        return AT_SUCCESS;                                                                                                                  \
+    }                                                                                                                                       \
+                                                                                                                                            \
+    /* Iterates over all entries in no particular order, start with [*iterator] = 0. Returns NULL after the last entry.                     \
+       The map must not be changed while iterating */                                                                                       \
+    static inline name##_entry* name##_next(const name* map, size_t* iterator) {                                                            \
+        if (!map || !map->ctrl) return NULL;                                                                                                \
+        for (size_t x = *iterator; x < map->cap; x++) {                                                                                     \
+            if (HASH_CTRL_IS_FULL(map->ctrl[x])) {                                                                                          \
+                *iterator = x + 1;                                                                                                          \
+                return &map->entries[x];                                                                                                    \
+            }                                                                                                                               \
+        }                                                                                                                                   \
+        *iterator = map->cap;                                                                                                               \
+        return NULL;                                                                                                                        \
+    }
@@ -14,12 +14,19 @@
 
 i32 stack_init(stack* s, size_t elem_size, size_t initial_capacity) {
 
+    return stack_init_with_allocator(s, elem_size, initial_capacity, NULL);
+}
+
+
+i32 stack_init_with_allocator(stack* s, size_t elem_size, size_t initial_capacity, const allocator* alloc) {
+
     if (!s || elem_size == 0) return AT_INVALID_ARGUMENT;
     if (s->magic == STACK_MAGIC) return AT_ALREADY_INITIALIZED;
 
     if (initial_capacity == 0) initial_capacity = 16;
 
-    s->data = malloc(elem_size * initial_capacity);
+    s->alloc = allocator_or_default(alloc);
+    s->data = allocator_alloc(s->alloc, elem_size * initial_capacity);
     if (!s->data) return AT_MEMORY_ERROR;
 
     s->size = 0;
@@ -35,8 +42,9 @@ i32 stack_free(stack* s) {
 
     VALIDATE(s);
 
-    free(s->data);
+    allocator_free(s->alloc, s->data, s->cap * s->elem_size);
     s->data = NULL;
+    s->alloc = NULL;
     s->size = s->cap = s->elem_size = 0;
     s->magic = 0;
 
@@ -56,7 +64,7 @@ i32 stack_push(stack* s, const void* element) {
     // Ensure capacity
     if (s->size >= s->cap) {
         size_t new_cap = s->cap * 2;
-        void* new_data = realloc(s->data, new_cap * s->elem_size);
+        void* new_data = allocator_realloc(s->alloc, s->data, s->cap * s->elem_size, new_cap * s->elem_size);
         if (!new_data) return AT_MEMORY_ERROR;
         
         s->data = new_data;
@@ -136,7 +144,7 @@ i32 stack_ensure_capacity(stack* s, size_t min_capacity) {
         new_cap *= 2;
     }
     
-    void* new_data = realloc(s->data, new_cap * s->elem_size);
+    void* new_data = allocator_realloc(s->alloc, s->data, s->cap * s->elem_size, new_cap * s->elem_size);
     if (!new_data) return AT_MEMORY_ERROR;
     
     s->data = new_data;
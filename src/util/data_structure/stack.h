@@ -3,12 +3,14 @@
 
 #include <stdlib.h>
 #include "data_types.h"
+#include "allocator.h"
 
 typedef struct {
     void* data;         // Pointer to stack elements
     size_t size;        // Current number of elements
     size_t cap;         // Allocated capacity
     size_t elem_size;   // Size of each element in bytes
+    const allocator* alloc;     // Allocator of [data]
     u32 magic;          // Magic number for validation
 } stack;
 
@@ -16,6 +18,9 @@ typedef struct {
 // Initializes a stack with a specific element size
 i32 stack_init(stack* s, size_t elem_size, size_t initial_capacity);
 
+// Initializes a stack that takes its memory from [alloc] (NULL for the default allocator)
+i32 stack_init_with_allocator(stack* s, size_t elem_size, size_t initial_capacity, const allocator* alloc);
+
 // Frees the stack memory
 i32 stack_free(stack* s);
 
@@ -4,14 +4,14 @@
 
 #include "data_types.h"
 #include "unordered_map.h"
+#include "hash_map_template.h"             // control byte groups
 
-#define LOAD_FACTOR_THRESHOLD   0.75
 #define MAGIC                   0xDEADBEEF
 
 #define VALIDATE(map)                                               \
     do {                                                            \
         if (!(map)) return AT_INVALID_ARGUMENT;                     \
-        if ((map)->magic != MAGIC || !(map)->buckets || (map)->cap == 0) \
+        if ((map)->magic != MAGIC || !(map)->ctrl || (map)->cap == 0) \
             return AT_NOT_INITIALIZED;                              \
         if (!(map)->hash_fn || !(map)->key_cmp_fn)                  \
             return AT_NOT_INITIALIZED;                              \
@@ -87,160 +87,399 @@ int i64_compare(const void* key1, const void* key2) {
 
 
 // ------------------------------------------------------------------------------------------
-// Map implementation
+// Hashing
 // ------------------------------------------------------------------------------------------
 
-// Map creation
-i32 u_map_init(unordered_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn) {
-    if (capacity == 0 || !hash_fn || !key_cmp_fn) return AT_INVALID_ARGUMENT;
-    
-    map = malloc(sizeof(unordered_map));
-    if (!map) return AT_MEMORY_ERROR;
-    
-    map->buckets = calloc(capacity, sizeof(node*));
-    if (!map->buckets) {
-        free(map);
-        return AT_MEMORY_ERROR;
+// pairs of predefined functions that are evaluated inline
+enum {
+    KEY_CUSTOM = 0,
+    KEY_POINTER,                // the pointer itself is the key
+    KEY_32,
+    KEY_64,
+    KEY_STRING,
+};
+
+static u32 get_key_kind(const hash_func hash_fn, const key_compare_func key_cmp_fn) {
+
+    if ((hash_fn == ptr_hash && key_cmp_fn == ptr_compare) || (hash_fn == func_ptr_hash && key_cmp_fn == func_ptr_compare))
+        return KEY_POINTER;
+    if ((hash_fn == u32_hash && key_cmp_fn == u32_compare) || (hash_fn == i32_hash && key_cmp_fn == i32_compare))
+        return KEY_32;
+    if ((hash_fn == u64_hash && key_cmp_fn == u64_compare) || (hash_fn == i64_hash && key_cmp_fn == i64_compare))
+        return KEY_64;
+    if (hash_fn == string_hash && key_cmp_fn == string_compare)
+        return KEY_STRING;
+    return KEY_CUSTOM;
+}
+
+
+// The predefined hash functions are weak (identity for integers and pointers), the result is mixed (see hash_mix)
+static inline u64 hash_key(const unordered_map* map, const void* key) {
+
+    u64 hash;
+    switch (map->key_kind) {
+        case KEY_POINTER:   hash = (u64)(uintptr_t)key; break;
+        case KEY_32:        hash = *(const u32*)key; break;
+        case KEY_64:        hash = *(const u64*)key; break;
+        case KEY_STRING:    hash = string_hash(key); break;
+        default:            hash = map->hash_fn(key); break;
     }
-    
-    map->size = 0;
+    return hash_mix(hash);
+}
+
+
+static inline b8 keys_equal(const unordered_map* map, const void* stored, const void* key) {
+
+    switch (map->key_kind) {
+        case KEY_POINTER:   return stored == key;
+        case KEY_32:        return *(const u32*)stored == *(const u32*)key;
+        case KEY_64:        return *(const u64*)stored == *(const u64*)key;
+        case KEY_STRING:    return strcmp(stored, key) == 0;
+        default:            return map->key_cmp_fn(stored, key) == 0;
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Table helpers
+// ------------------------------------------------------------------------------------------
+
+#define NOT_FOUND               ((size_t)-1)
+
+// Tables with fewer slots are rehashed at once, larger ones grow incrementally
+#define INCREMENTAL_MIN_CAPACITY    4096
+// Old slots moved per insert/erase during an incremental resize. The new table has room for at least [old_cap] / 2 more
+// entries than it receives by moving, so the old table is always empty before the new one fills up
+#define MIGRATE_SLOTS_PER_STEP      64
+
+
+// Probes group by group until the key or an EMPTY slot is found
+static inline size_t find_index_in(const unordered_map* map, const u8* ctrl, const u_map_slot* slots, const size_t capacity, const void* key, const u64 hash) {
+
+    const size_t mask = capacity - 1;
+    const u8 h2 = hash_h2(hash);
+    size_t position = hash_h1(hash) & mask;
+    size_t stride = 0;
+    while (1) {
+        const u8* group = ctrl + position;
+        for (hash_group_mask match = hash_group_match_h2(group, h2); match; match &= match - 1) {
+            const size_t index = (position + hash_group_lowest(match)) & mask;
+            if (keys_equal(map, slots[index].key, key))
+                return index;
+        }
+        if (hash_group_match_empty(group))
+            return NOT_FOUND;
+
+        stride += HASH_GROUP_WIDTH;
+        position = (position + stride) & mask;
+    }
+}
+
+static inline size_t find_index(const unordered_map* map, const void* key, const u64 hash) {
+
+    return find_index_in(map, map->ctrl, map->slots, map->cap, key, hash);
+}
+
+// Index of [key] in the old table, NOT_FOUND if it is not there or no resize is in progress
+static inline size_t find_old_index(const unordered_map* map, const void* key, const u64 hash) {
+
+    return map->old_ctrl ? find_index_in(map, map->old_ctrl, map->old_slots, map->old_cap, key, hash) : NOT_FOUND;
+}
+
+
+// Bytes of the allocation that holds the slots and control bytes of a table of [capacity]
+static inline size_t table_bytes(const size_t capacity)     { return capacity * sizeof(u_map_slot) + capacity + HASH_GROUP_WIDTH - 1; }
+
+
+// Allocates the control bytes and slots of [capacity] (power of two, at least HASH_GROUP_WIDTH), all EMPTY
+static i32 allocate_table(unordered_map* map, const size_t capacity) {
+
+    const size_t slot_bytes = capacity * sizeof(u_map_slot);
+    u8* memory = allocator_alloc(map->alloc, table_bytes(capacity));
+    if (!memory) return AT_MEMORY_ERROR;
+
+    map->slots = (u_map_slot*)memory;
+    map->ctrl = memory + slot_bytes;
     map->cap = capacity;
+    memset(map->ctrl, HASH_CTRL_EMPTY, capacity + HASH_GROUP_WIDTH - 1);
+    return AT_SUCCESS;
+}
+
+
+// Puts an entry that is not in the current table into it, the table must have room
+static inline void place_entry(unordered_map* map, const u_map_slot slot, const u64 hash) {
+
+    const size_t index = hash_find_insert_index(map->ctrl, map->cap, hash);
+    map->growth_left -= (map->ctrl[index] == HASH_CTRL_EMPTY);
+    hash_set_ctrl(map->ctrl, map->cap, index, hash_h2(hash));
+    map->slots[index] = slot;
+}
+
+
+// Moves up to [count] slots of the old table into the current one, frees the old table after its last slot
+static void migrate(unordered_map* map, const size_t count) {
+
+    if (!map->old_ctrl)
+        return;
+
+    const size_t end = (map->old_cap - map->migrate_index > count) ? map->migrate_index + count : map->old_cap;
+    for (size_t x = map->migrate_index; x < end; x++) {
+        if (!HASH_CTRL_IS_FULL(map->old_ctrl[x]))
+            continue;
+        place_entry(map, map->old_slots[x], hash_key(map, map->old_slots[x].key));
+        hash_set_ctrl(map->old_ctrl, map->old_cap, x, HASH_CTRL_DELETED);     // keeps the probe sequences of the old table intact
+    }
+    map->migrate_index = end;
+
+    if (end == map->old_cap) {
+        allocator_free(map->alloc, map->old_slots, table_bytes(map->old_cap));
+        map->old_ctrl = NULL;
+        map->old_slots = NULL;
+        map->old_cap = 0;
+        map->migrate_index = 0;
+    }
+}
+
+
+// Moves every entry into a new table of [capacity], which also removes all DELETED markers
+static i32 rehash(unordered_map* map, const size_t capacity) {
+
+    migrate(map, map->old_cap);                     // finish an incremental resize first
+
+    const unordered_map old = *map;
+    if (allocate_table(map, capacity) != AT_SUCCESS) {
+        *map = old;
+        return AT_MEMORY_ERROR;
+    }
+
+    map->growth_left = hash_capacity_to_growth(capacity);
+    for (size_t x = 0; x < old.cap; x++)
+        if (HASH_CTRL_IS_FULL(old.ctrl[x]))
+            place_entry(map, old.slots[x], hash_key(map, old.slots[x].key));
+
+    allocator_free(map->alloc, old.slots, table_bytes(old.cap));
+    return AT_SUCCESS;
+}
+
+
+// Switches to a new table of [capacity] and keeps the current one as the old table, its entries are moved by later calls to migrate()
+static i32 start_resize(unordered_map* map, const size_t capacity) {
+
+    if (map->cap < INCREMENTAL_MIN_CAPACITY || map->old_ctrl)
+        return rehash(map, capacity);
+
+    const unordered_map old = *map;
+    if (allocate_table(map, capacity) != AT_SUCCESS) {
+        *map = old;
+        return AT_MEMORY_ERROR;
+    }
+
+    map->old_ctrl = old.ctrl;
+    map->old_slots = old.slots;
+    map->old_cap = old.cap;
+    map->migrate_index = 0;
+    map->growth_left = hash_capacity_to_growth(capacity);
+    return AT_SUCCESS;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Map implementation
+// ------------------------------------------------------------------------------------------
+
+i32 u_map_init(unordered_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn) {
+
+    return u_map_init_with_allocator(map, capacity, hash_fn, key_cmp_fn, NULL);
+}
+
+
+i32 u_map_init_with_allocator(unordered_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn, const allocator* alloc) {
+    if (!map || capacity == 0 || !hash_fn || !key_cmp_fn) return AT_INVALID_ARGUMENT;
+
+    memset(map, 0, sizeof(unordered_map));
+    map->alloc = allocator_or_default(alloc);
+    if (allocate_table(map, hash_capacity_for(capacity)) != AT_SUCCESS) return AT_MEMORY_ERROR;
+    arena_init_with_allocator(&map->keys, 0, map->alloc);
+
+    map->growth_left = hash_capacity_to_growth(map->cap);
     map->magic = MAGIC;
+    map->key_kind = get_key_kind(hash_fn, key_cmp_fn);
     map->hash_fn = hash_fn;
     map->key_cmp_fn = key_cmp_fn;
-    
+
     return AT_SUCCESS;
 }
 
 
 i32 u_map_free(unordered_map* map) {
     VALIDATE(map);
-    
-    for (size_t i = 0; i < map->cap; i++) {
-        node* current = map->buckets[i];
-        while (current != NULL) {
-            node* temp = current;
-            current = current->next;
-            free(temp);
-        }
-    }
-    
-    free(map->buckets);
-    free(map);
+
+    allocator_free(map->alloc, map->slots, table_bytes(map->cap));
+    allocator_free(map->alloc, map->old_slots, table_bytes(map->old_cap));
+    arena_free(&map->keys);
+    memset(map, 0, sizeof(unordered_map));
     return AT_SUCCESS;
 }
 
 
+i32 u_map_resize(unordered_map* map) {
+    VALIDATE(map);
+
+    return rehash(map, map->cap * 2);
+}
 
 
-// Resize function
-i32 u_map_resize(unordered_map* map) {
+i32 u_map_reserve(unordered_map* map, size_t count) {
     VALIDATE(map);
-    
-    size_t new_capacity = map->cap * 2;
-    node** new_buckets = calloc(new_capacity, sizeof(node*));
-    if (!new_buckets) return AT_MEMORY_ERROR;
-    
-    // Rehash all elements
-    for (size_t i = 0; i < map->cap; i++) {
-        node* current = map->buckets[i];
-        while (current != NULL) {
-            node* next = current->next;
-            
-            // Rehash the key
-            size_t new_index = map->hash_fn(current->key) % new_capacity;
-            
-            // Insert at head of new bucket
-            current->next = new_buckets[new_index];
-            new_buckets[new_index] = current;
-            
-            current = next;
-        }
+
+    const size_t capacity = hash_capacity_for(count);
+    if (capacity > map->cap)
+        return rehash(map, capacity);
+
+    migrate(map, map->old_cap);                     // the current table is big enough, only finish a running resize
+    return AT_SUCCESS;
+}
+
+
+// Inserts or updates [key], a new key is first copied into [map->keys] if [key_size] is not 0
+static i32 insert(unordered_map* map, void* key, const size_t key_size, void* value) {
+
+    migrate(map, MIGRATE_SLOTS_PER_STEP);
+
+    const u64 hash = hash_key(map, key);
+    size_t index = find_index(map, key, hash);
+    if (index != NOT_FOUND) {
+        map->slots[index].value = value;            // Update existing value
+        return AT_SUCCESS;
     }
-    
-    free(map->buckets);
-    map->buckets = new_buckets;
-    map->cap = new_capacity;
+    index = find_old_index(map, key, hash);
+    if (index != NOT_FOUND) {
+        map->old_slots[index].value = value;        // Not moved yet
+        return AT_SUCCESS;
+    }
+
+    index = hash_find_insert_index(map->ctrl, map->cap, hash);
+    if (map->growth_left == 0 && map->ctrl[index] == HASH_CTRL_EMPTY) {
+        // mostly DELETED markers: clean up at the same size, otherwise grow
+        const size_t capacity = (map->size < hash_capacity_to_growth(map->cap) / 2) ? map->cap : map->cap * 2;
+        const i32 result = start_resize(map, capacity);
+        if (result != AT_SUCCESS) return result;
+    }
+
+    if (key_size) {
+        key = arena_copy(&map->keys, key, key_size);
+        if (!key) return AT_MEMORY_ERROR;
+    }
+
+    place_entry(map, (u_map_slot){ .key = key, .value = value }, hash);
+    map->size++;
     return AT_SUCCESS;
 }
 
-// Insert function
+
 i32 u_map_insert(unordered_map* map, void* key, void* value) {
     VALIDATE(map);
-    
-    // Check if we need to resize
-    if ((double)map->size / map->cap > LOAD_FACTOR_THRESHOLD) {
-        i32 res = u_map_resize(map);
-        if (res != AT_SUCCESS) return res;
-    }
-    
-    size_t index = map->hash_fn(key) % map->cap;
-    node* current = map->buckets[index];
-    
-    // Check if key already exists
-    while (current != NULL) {
-        if (map->key_cmp_fn(current->key, key) == 0) {
-            current->value = value; // Update existing value
-            return AT_SUCCESS;
-        }
-        current = current->next;
-    }
-    
-    // Create new node
-    node* newnode = malloc(sizeof(node));
-    if (!newnode) return AT_MEMORY_ERROR;
-    
-    newnode->key = key;
-    newnode->value = value;
-    newnode->next = map->buckets[index]; // Insert at head
-    map->buckets[index] = newnode;
-    map->size++;
-    
-    return AT_SUCCESS;
+
+    return insert(map, key, 0, value);
+}
+
+
+i32 u_map_insert_copy(unordered_map* map, const void* key, size_t key_size, void* value) {
+    VALIDATE(map);
+    if (!key || key_size == 0 || map->key_kind == KEY_POINTER) return AT_INVALID_ARGUMENT;       // a pointer key has no bytes to copy
+
+    return insert(map, (void*)key, key_size, value);
 }
 
-// Find function
+
 i32 u_map_find(unordered_map* map, const void* key, void** value) {
     VALIDATE(map);
     if (!value) return AT_INVALID_ARGUMENT;
-    
-    size_t index = map->hash_fn(key) % map->cap;
-    node* current = map->buckets[index];
-    
-    while (current != NULL) {
-        if (map->key_cmp_fn(current->key, key) == 0) {
-            *value = current->value;
-            return AT_SUCCESS;
-        }
-        current = current->next;
+
+    const u64 hash = hash_key(map, key);
+    size_t index = find_index(map, key, hash);
+    if (index != NOT_FOUND) {
+        *value = map->slots[index].value;
+        return AT_SUCCESS;
+    }
+    index = find_old_index(map, key, hash);
+    if (index != NOT_FOUND) {
+        *value = map->old_slots[index].value;
+        return AT_SUCCESS;
     }
-    
-    return AT_ERROR; // Key not found
+    return AT_ERROR;                                // Key not found
 }
 
-// Erase function
+
+// Marks [index] of a table as free and clears its slot
+static inline void erase_index(u8* ctrl, u_map_slot* slots, const size_t capacity, const size_t index, size_t* growth_left) {
+
+    const u8 erased = hash_erased_ctrl(ctrl, capacity, index);
+    hash_set_ctrl(ctrl, capacity, index, erased);
+    if (growth_left)
+        *growth_left += (erased == HASH_CTRL_EMPTY);
+    slots[index] = (u_map_slot){ 0 };
+}
+
+
 i32 u_map_erase(unordered_map* map, const void* key) {
     VALIDATE(map);
-    
-    size_t index = map->hash_fn(key) % map->cap;
-    node* current = map->buckets[index];
-    node* prev = NULL;
-    
-    while (current != NULL) {
-        if (map->key_cmp_fn(current->key, key) == 0) {
-            if (prev == NULL) {
-                map->buckets[index] = current->next;
-            } else {
-                prev->next = current->next;
-            }
-            
-            free(current);
-            map->size--;
-            return AT_SUCCESS;
-        }
-        prev = current;
-        current = current->next;
+
+    migrate(map, MIGRATE_SLOTS_PER_STEP);
+
+    const u64 hash = hash_key(map, key);
+    size_t index = find_index(map, key, hash);
+    if (index != NOT_FOUND) {
+        erase_index(map->ctrl, map->slots, map->cap, index, &map->growth_left);
+    } else {
+        index = find_old_index(map, key, hash);
+        if (index == NOT_FOUND)
+            return AT_ERROR;                        // Key not found
+        erase_index(map->old_ctrl, map->old_slots, map->old_cap, index, NULL);
     }
-    
-    return AT_ERROR; // Key not found
+
+    map->size--;
+    return AT_SUCCESS;
+}
+
+
+i32 u_map_clear(unordered_map* map) {
+    VALIDATE(map);
+
+    if (map->old_ctrl) {                            // drop the old table of a running resize, its entries are gone anyway
+        allocator_free(map->alloc, map->old_slots, table_bytes(map->old_cap));
+        map->old_ctrl = NULL;
+        map->old_slots = NULL;
+        map->old_cap = 0;
+        map->migrate_index = 0;
+    }
+
+    memset(map->ctrl, HASH_CTRL_EMPTY, map->cap + HASH_GROUP_WIDTH - 1);
+    map->size = 0;
+    map->growth_left = hash_capacity_to_growth(map->cap);
+    arena_reset(&map->keys);
+    return AT_SUCCESS;
+}
+
+
+b8 u_map_next(const unordered_map* map, size_t* iterator, void** key, void** value) {
+
+    if (!map || map->magic != MAGIC || !iterator)
+        return false;
+
+    // [0, cap) are the slots of the current table, [cap, cap + old_cap) the ones of the old table during a resize
+    for (size_t x = *iterator; x < map->cap + map->old_cap; x++) {
+        const b8 in_old = (x >= map->cap);
+        const size_t index = in_old ? x - map->cap : x;
+        if (!HASH_CTRL_IS_FULL(in_old ? map->old_ctrl[index] : map->ctrl[index]))
+            continue;
+        const u_map_slot* slot = in_old ? &map->old_slots[index] : &map->slots[index];
+        if (key)    *key = slot->key;
+        if (value)  *value = slot->value;
+        *iterator = x + 1;
+        return true;
+    }
+
+    *iterator = map->cap + map->old_cap;
+    return false;
 }
@@ -2,36 +2,67 @@
 
 #include <stddef.h>
 #include "data_types.h"
+#include "arena.h"
+#include "allocator.h"
 
 // Function pointer types for hash and comparison
 typedef size_t (*hash_func)(const void* key);
 typedef int (*key_compare_func)(const void* key1, const void* key2);
 
-typedef struct node {
+// Open addressing hash map (Swiss table layout). Every slot has a control byte that is either EMPTY, DELETED or 7 bits of the hash
+// of its key, lookups compare a whole group of control bytes at once (SSE2 / NEON / 64-bit scalar) and only touch the slots whose
+// bits match. Keys and values are stored by pointer inside the slot array, the map never allocates per entry.
+// Keys inserted with u_map_insert_copy are copied into pages owned by the map, so callers do not have to keep them alive. The pages
+// are only released by u_map_free, u_map_clear keeps them (and the table) for the next fill.
+// The capacity is a power of two and the map grows when it is 7/8 full.
+// Large tables grow incrementally: the new table is allocated and the old one is kept, every insert/erase moves a bounded number of
+// old slots over and lookups check both tables until the old one is empty. This bounds the cost of the insert that triggers the growth.
+typedef struct {
     void*               key;
     void*               value;
-    struct node*        next;
-} node;
+} u_map_slot;
 
 typedef struct {
-    node**              buckets;
+    u8*                 ctrl;                   // [cap] control bytes, followed by copies of the first ones so a group can be loaded at any slot
+    u_map_slot*         slots;                  // [cap] slots, the control bytes are stored in the same allocation
     size_t              size;
     size_t              cap;
+    size_t              growth_left;            // inserts into EMPTY slots until the map has to grow
+    u8*                 old_ctrl;               // table that is still being moved into [ctrl]/[slots], NULL if no resize is in progress
+    u_map_slot*         old_slots;
+    size_t              old_cap;
+    size_t              migrate_index;          // slots of the old table below this index are already moved
     u32                 magic;
+    u32                 key_kind;               // the predefined hash/compare pairs below are handled inline, without calling through the pointers
     hash_func           hash_fn;
     key_compare_func    key_cmp_fn;
+    arena               keys;                   // copies of the keys of u_map_insert_copy
+    const allocator*    alloc;                  // allocator of the tables and of the pages of [keys]
 } unordered_map;
 
 
 // Creation with custom hash and compare functions
+// @param capacity Number of entries the map should hold without growing
 i32 u_map_init(unordered_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn);
+// @param alloc Allocator of the tables and copied keys, NULL for the default allocator
+i32 u_map_init_with_allocator(unordered_map* map, size_t capacity, hash_func hash_fn, key_compare_func key_cmp_fn, const allocator* alloc);
 i32 u_map_free(unordered_map* map);
 
 // Basic operations
-i32 u_map_resize(unordered_map* map);
-i32 u_map_insert(unordered_map* map, void* key, void* value);
-i32 u_map_find(unordered_map* map, const void* key, void** value);
-i32 u_map_erase(unordered_map* map, const void* key);
+i32 u_map_resize(unordered_map* map);                                   // doubles the capacity
+i32 u_map_reserve(unordered_map* map, size_t count);                    // makes room for [count] entries, so inserts up to it never rehash
+i32 u_map_insert(unordered_map* map, void* key, void* value);           // replaces the value if [key] is already in the map
+i32 u_map_insert_copy(unordered_map* map, const void* key, size_t key_size, void* value);  // like insert, a new key is copied into the map
+i32 u_map_find(unordered_map* map, const void* key, void** value);      // AT_ERROR if [key] is not in the map
+i32 u_map_erase(unordered_map* map, const void* key);                   // AT_ERROR if [key] is not in the map, a copied key stays until clear/free
+i32 u_map_clear(unordered_map* map);                                    // removes all entries, keeps the memory
+
+// @brief Iterates over all entries in no particular order. The map must not be changed while iterating.
+// @param iterator Set to 0 before the first call
+// @param key Receives the key of the entry, can be NULL
+// @param value Receives the value of the entry, can be NULL
+// @return true if an entry was returned, false after the last one
+b8 u_map_next(const unordered_map* map, size_t* iterator, void** key, void** value);
 
 
 // Predefined hash functions for common types
@@ -0,0 +1,523 @@
+#define _DEFAULT_SOURCE                                             // tm_gmtoff, syscall()
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+
+#include "util/system.h"
+
+#include "log_file_writer.h"
+
+
+// ============================================================================================================================================
+// housekeeping of rotated files
+// ============================================================================================================================================
+
+// Compressing and deleting rotated files is done by a low-priority background thread (started on first use),
+// so neither the logger thread nor the producers ever wait for it. Jobs are processed in order.
+// Files that are still uncompressed at shutdown are picked up by [scan_rotated_files] on the next start.
+
+#define COMPRESS_CHUNK_SIZE     (256 * 1024)
+
+typedef struct housekeeping_job {
+    struct housekeeping_job*    next;
+    b8                          compress;           // gzip [path] into "<path>.gz", otherwise delete [path] and "<path>.gz"
+    char                        path[];
+} housekeeping_job;
+
+static struct {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              wake;
+    housekeeping_job*           first;
+    housekeeping_job*           last;
+    pthread_t                   thread;
+    b8                          running;
+    _Atomic b8                  stop;
+} s_housekeeping = { .mutex = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+
+// Compresses [path] into "<path>.gz" and deletes the original. Returns false if [s_housekeeping.stop] interrupted it
+static b8 compress_file(const char* path) {
+
+    char gz_path[PATH_MAX];
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return true;                                            // already gone (e.g. deleted by retention)
+
+    gzFile gz = gzopen(gz_path, "wb6");
+    if (!gz) {
+        close(fd);
+        return true;
+    }
+
+    static char chunk[COMPRESS_CHUNK_SIZE];                     // only used by the housekeeping thread
+    b8 success = true;
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+
+        if (bytes_read < 0 || gzwrite(gz, chunk, (unsigned)bytes_read) != (int)bytes_read || atomic_load(&s_housekeeping.stop)) {
+            success = false;
+            break;
+        }
+    }
+    close(fd);
+
+    if (gzclose(gz) != Z_OK)
+        success = false;
+
+    if (!success || unlink(path) != 0)                          // keep the original, a partial archive is useless
+        unlink(gz_path);
+    return !atomic_load(&s_housekeeping.stop);
+}
+
+
+static void* housekeeping_thread_func(void* arg) {
+    (void)arg;
+
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);  // Linux applies the nice value per thread
+
+    pthread_mutex_lock(&s_housekeeping.mutex);
+    for (;;) {
+        while (!s_housekeeping.first && !atomic_load(&s_housekeeping.stop))
+            pthread_cond_wait(&s_housekeeping.wake, &s_housekeeping.mutex);
+
+        housekeeping_job* job = s_housekeeping.first;
+        if (!job)
+            break;                                              // stop requested and nothing left to do
+
+        s_housekeeping.first = job->next;
+        if (!s_housekeeping.first)
+            s_housekeeping.last = NULL;
+        pthread_mutex_unlock(&s_housekeeping.mutex);
+
+        if (job->compress) {
+            if (!atomic_load(&s_housekeeping.stop))             // left for the next start
+                compress_file(job->path);
+        } else {
+            char gz_path[PATH_MAX];
+            snprintf(gz_path, sizeof(gz_path), "%s.gz", job->path);
+            unlink(job->path);
+            unlink(gz_path);
+        }
+        free(job);
+
+        pthread_mutex_lock(&s_housekeeping.mutex);
+    }
+    pthread_mutex_unlock(&s_housekeeping.mutex);
+    return NULL;
+}
+
+
+static void housekeeping_enqueue(const char* path, const b8 compress) {
+
+    const size_t path_len = strlen(path);
+    housekeeping_job* job = malloc(sizeof(housekeeping_job) + path_len + 1);
+    if (!job)
+        return;
+
+    job->next = NULL;
+    job->compress = compress;
+    memcpy(job->path, path, path_len + 1);
+
+    pthread_mutex_lock(&s_housekeeping.mutex);
+    if (!s_housekeeping.running) {
+        atomic_store(&s_housekeeping.stop, false);
+        s_housekeeping.running = (pthread_create(&s_housekeeping.thread, NULL, housekeeping_thread_func, NULL) == 0);
+    }
+
+    if (s_housekeeping.last)
+        s_housekeeping.last->next = job;
+    else
+        s_housekeeping.first = job;
+    s_housekeeping.last = job;
+
+    pthread_cond_signal(&s_housekeeping.wake);
+    pthread_mutex_unlock(&s_housekeeping.mutex);
+}
+
+
+// Finishes pending deletions and stops the thread, an ongoing compression is aborted
+void housekeeping_shutdown() {
+
+    pthread_mutex_lock(&s_housekeeping.mutex);
+    const b8 running = s_housekeeping.running;
+    s_housekeeping.running = false;
+    atomic_store(&s_housekeeping.stop, true);
+    pthread_cond_signal(&s_housekeeping.wake);
+    pthread_mutex_unlock(&s_housekeeping.mutex);
+
+    if (running)
+        pthread_join(s_housekeeping.thread, NULL);
+}
+
+
+// Finds the rotated files of "<stem><extension>" from previous runs. Queues files beyond [rotation.max_files] for deletion
+// and uncompressed files for compression. Returns the highest sequence found (0 if none)
+static u32 scan_rotated_files(const char* stem, const char* extension, const logger_rotation_policy rotation) {
+
+    char dir_path[PATH_MAX];
+    const char* name = strrchr(stem, '/');
+    if (name) {
+        snprintf(dir_path, sizeof(dir_path), "%.*s", (int)(name - stem), stem);
+        name++;
+    } else {
+        snprintf(dir_path, sizeof(dir_path), ".");
+        name = stem;
+    }
+
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return 0;
+
+    const size_t name_len = strlen(name);
+    const size_t extension_len = strlen(extension);
+    u32 max_sequence = 0;
+    for (int pass = 0; pass < 2; pass++) {                      // first pass finds the highest sequence, second pass cleans up
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+
+            // "<name>.<sequence><extension>" optionally followed by ".gz"
+            const char* c = entry->d_name;
+            if (strncmp(c, name, name_len) != 0 || c[name_len] != '.' || c[name_len + 1] < '0' || c[name_len + 1] > '9')
+                continue;
+
+            char* end;
+            const unsigned long sequence = strtoul(c + name_len + 1, &end, 10);
+            if (sequence == 0 || sequence > UINT32_MAX || strncmp(end, extension, extension_len) != 0)
+                continue;
+
+            const b8 compressed = (strcmp(end + extension_len, ".gz") == 0);
+            if (!compressed && end[extension_len] != '\0')
+                continue;
+
+            if (pass == 0) {
+                if (sequence > max_sequence)
+                    max_sequence = (u32)sequence;
+                continue;
+            }
+
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s.%lu%s", stem, sequence, extension);
+            if (rotation.max_files && sequence + rotation.max_files <= max_sequence)
+                housekeeping_enqueue(path, false);
+            else if (rotation.compress && !compressed)
+                housekeeping_enqueue(path, true);
+        }
+        rewinddir(dir);
+    }
+
+    closedir(dir);
+    return max_sequence;
+}
+
+
+// Returns the wall-clock time (ns since the epoch) at which local time reaches the next multiple of [interval_s] after [now_ns], 0 if [interval_s] is 0
+static u64 next_rotation_time(const u32 interval_s, const u64 now_ns) {
+
+    if (!interval_s)
+        return 0;
+
+    const time_t now = (time_t)(now_ns / 1000000000ULL);
+    struct tm tm_local;
+    localtime_r(&now, &tm_local);
+
+    const i64 local_s = (i64)now + tm_local.tm_gmtoff;
+    const i64 next_local_s = (local_s / interval_s + 1) * interval_s;
+    return (u64)(next_local_s - tm_local.tm_gmtoff) * 1000000000ULL;
+}
+
+
+// ============================================================================================================================================
+// file writer
+// ============================================================================================================================================
+
+// Formatted messages are collected in [buffer] and written to the log file (kept open for the lifetime of the sink)
+// according to [policy]. A message that does not fit is written together with the buffered data using a single writev().
+
+#define FILE_BUFFER_SIZE        LOGGER_FILE_BUFFER_SIZE
+#define ROTATION_RETRY_NS       (1000ULL * 1000000ULL)          // size based rotation is retried this long after a failed rename
+
+struct log_file_writer {
+    int                 fd;                         // -1 while closed
+    u32                 fill;                       // bytes used in [buffer]
+    u64                 last_flush_ns;              // CLOCK_MONOTONIC
+    u64                 file_size;                  // bytes written to the current file
+    logger_flush_policy policy;
+    char*               path;
+    logger_rotation_policy rotation;
+    char*               stem;                       // [path] without extension, rotated files are named "<stem>.<sequence><extension>"
+    const char*         extension;                  // points into [path]
+    u32                 next_sequence;              // sequence of the next rotated file
+    u64                 next_rotation_ns;           // wall-clock time of the next time based rotation, 0 if disabled
+    u64                 rotation_retry_ns;          // CLOCK_MONOTONIC time before which no size based rotation is tried after a failure
+    b8                  rotation_failed;            // the failure was reported, reset by the next successful rotation
+    b8                  binary;                     // every new file starts with the LOG_BINARY_MAGIC header
+    pthread_mutex_t     mutex;
+    char                buffer[FILE_BUFFER_SIZE];
+};
+
+
+// writes all [iov_count] buffers, retries on partial writes and EINTR
+b8 write_all(const int fd, struct iovec* iov, int iov_count) {
+
+    while (iov_count > 0) {
+        ssize_t written = writev(fd, iov, iov_count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        while (iov_count > 0 && (size_t)written >= iov->iov_len) {        // skip completely written buffers
+            written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+
+static b8 file_writer_open(log_file_writer* writer, const b8 use_append_mode) {
+
+    writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_CLOEXEC | (use_append_mode ? O_APPEND : O_TRUNC), 0644);
+    writer->fill = 0;
+    writer->last_flush_ns = monotonic_ns();
+
+    struct stat st;
+    writer->file_size = (writer->fd >= 0 && use_append_mode && fstat(writer->fd, &st) == 0) ? (u64)st.st_size : 0;
+
+    if (writer->binary && writer->fd >= 0 && writer->file_size == 0) {     // header of the binary format, buffered like a record
+        const u32 version = LOG_BINARY_VERSION;
+        memcpy(writer->buffer, LOG_BINARY_MAGIC, 8);
+        memcpy(writer->buffer + 8, &version, sizeof(version));
+        writer->fill = 8 + sizeof(version);
+    }
+    return writer->fd >= 0;
+}
+
+
+log_file_writer* file_writer_create(const char* file_path, const b8 use_append_mode, const logger_flush_policy policy, const logger_rotation_policy rotation, const b8 binary) {
+
+    log_file_writer* writer = calloc(1, sizeof(log_file_writer));
+    if (!writer)
+        return NULL;
+
+    writer->path = strdup(file_path);
+    writer->policy = policy;
+    writer->rotation = rotation;
+    writer->binary = binary;
+    if (writer->path) {                                                     // split "dir/name.ext" into "dir/name" and ".ext"
+        const char* name = strrchr(writer->path, '/');
+        const char* dot = strrchr(name ? name : writer->path, '.');
+        writer->extension = (dot && dot != (name ? name + 1 : writer->path)) ? dot : writer->path + strlen(writer->path);
+        writer->stem = strndup(writer->path, (size_t)(writer->extension - writer->path));
+    }
+
+    if (!writer->path || !writer->stem || !file_writer_open(writer, use_append_mode)) {
+        free(writer->stem);
+        free(writer->path);
+        free(writer);
+        return NULL;
+    }
+
+    if (rotation.max_file_size || rotation.interval_s) {
+        writer->next_sequence = scan_rotated_files(writer->stem, writer->extension, rotation) + 1;
+        writer->next_rotation_ns = next_rotation_time(rotation.interval_s, get_system_time_ns());
+    }
+
+    pthread_mutex_init(&writer->mutex, NULL);
+    return writer;
+}
+
+
+// CAUTION: caller needs to hold [writer->mutex]
+static void file_writer_flush_locked(log_file_writer* writer) {
+
+    if (writer->fill > 0 && writer->fd >= 0) {
+        struct iovec iov = { .iov_base = writer->buffer, .iov_len = writer->fill };
+        write_all(writer->fd, &iov, 1);
+        writer->file_size += writer->fill;
+    }
+    writer->fill = 0;
+    writer->last_flush_ns = monotonic_ns();
+}
+
+
+// Renames the current file to the next sequence and starts a new one, independent of the number of files kept.
+// Compression and deleting the file that dropped out of [rotation.max_files] are left to the housekeeping thread.
+// If the rename fails the current file is kept (reopened in append mode, it may have been removed or replaced) and nothing is deleted
+// CAUTION: caller needs to hold [writer->mutex]
+static void file_writer_rotate_locked(log_file_writer* writer) {
+
+    file_writer_flush_locked(writer);
+    close(writer->fd);
+
+    const u32 sequence = writer->next_sequence;
+    char rotated_path[PATH_MAX];
+    snprintf(rotated_path, sizeof(rotated_path), "%s.%u%s", writer->stem, sequence, writer->extension);
+    if (rename(writer->path, rotated_path) != 0) {
+        if (!writer->rotation_failed)                                       // not logged, this runs inside the sinks
+            fprintf(stderr, "logger: could not rotate [%s] to [%s]: %s, continuing in the current file\n", writer->path, rotated_path, strerror(errno));
+
+        writer->rotation_failed = true;
+        writer->rotation_retry_ns = monotonic_ns() + ROTATION_RETRY_NS;
+        file_writer_open(writer, true);
+        return;
+    }
+
+    writer->rotation_failed = false;
+    writer->next_sequence++;
+    if (writer->rotation.compress)
+        housekeeping_enqueue(rotated_path, true);
+
+    if (writer->rotation.max_files && sequence > writer->rotation.max_files) {
+        snprintf(rotated_path, sizeof(rotated_path), "%s.%u%s", writer->stem, sequence - writer->rotation.max_files, writer->extension);
+        housekeeping_enqueue(rotated_path, false);
+    }
+
+    file_writer_open(writer, false);
+}
+
+
+// Appends [data] and writes the buffer if the flush policy requires it. [timestamp_ns] (wall-clock) is used for time based rotation
+void file_writer_write(log_file_writer* writer, const char* data, const u32 length, const log_type type, const u64 timestamp_ns) {
+
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->fd < 0) {
+        pthread_mutex_unlock(&writer->mutex);
+        return;
+    }
+
+    const u64 file_size = writer->file_size + writer->fill;
+    if (writer->next_rotation_ns && timestamp_ns >= writer->next_rotation_ns) {
+        writer->next_rotation_ns = next_rotation_time(writer->rotation.interval_s, timestamp_ns);
+        if (file_size > 0)
+            file_writer_rotate_locked(writer);
+
+    } else if (writer->rotation.max_file_size && file_size > 0 && file_size + length > writer->rotation.max_file_size
+            && (!writer->rotation_failed || monotonic_ns() >= writer->rotation_retry_ns))
+        file_writer_rotate_locked(writer);
+
+    if (writer->fill + length > writer->policy.size_threshold) {           // write buffered data and the new message in one syscall
+        struct iovec iov[2] = {
+            { .iov_base = writer->buffer,   .iov_len = writer->fill },
+            { .iov_base = (void*)data,      .iov_len = length },
+        };
+        write_all(writer->fd, (writer->fill > 0) ? iov : &iov[1], (writer->fill > 0) ? 2 : 1);
+        writer->file_size += writer->fill + length;
+        writer->fill = 0;
+        writer->last_flush_ns = monotonic_ns();
+
+    } else {
+        memcpy(writer->buffer + writer->fill, data, length);
+        writer->fill += length;
+
+        if (type >= writer->policy.flush_level)
+            file_writer_flush_locked(writer);
+        else if (writer->policy.interval_ms && monotonic_ns() - writer->last_flush_ns >= (u64)writer->policy.interval_ms * 1000000ULL)
+            file_writer_flush_locked(writer);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+
+// Returns the CLOCK_MONOTONIC time at which buffered data has to be written because of the interval policy, 0 if nothing is buffered
+u64 file_writer_deadline(log_file_writer* writer) {
+
+    pthread_mutex_lock(&writer->mutex);
+    const u64 deadline_ns = (writer->fill > 0 && writer->policy.interval_ms) ? writer->last_flush_ns + (u64)writer->policy.interval_ms * 1000000ULL : 0;
+    pthread_mutex_unlock(&writer->mutex);
+    return deadline_ns;
+}
+
+
+void file_writer_flush(log_file_writer* writer) {
+
+    pthread_mutex_lock(&writer->mutex);
+    file_writer_flush_locked(writer);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+
+void file_writer_set_policy(log_file_writer* writer, const logger_flush_policy policy) {
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->policy = policy;
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+
+void file_writer_destroy(log_file_writer* writer) {
+
+    file_writer_flush(writer);
+    if (writer->fd >= 0)
+        close(writer->fd);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer->stem);
+    free(writer->path);
+    free(writer);
+}
+
+
+// Writes the banner that opens / closes a log file
+void file_writer_write_banner(log_file_writer* writer, const char* format) {
+
+    system_time st = get_system_time();
+    char banner[PATH_MAX + 512];
+    const i32 banner_len = format ? snprintf(banner, sizeof(banner),
+            "=====================================================================================================\n"
+            "Log initalized at [%04d/%02d/%02d %02d:%02d:%02d] with format: %s\n"
+            "-----------------------------------------------------------------------------------------------------\n",
+            st.year, st.month, st.day, st.hour, st.minute, st.second, format)
+        : snprintf(banner, sizeof(banner),
+            "-----------------------------------------------------------------------------------------------------\n"
+            "Closing Log at [%04d/%02d/%02d %02d:%02d:%02d]\n"
+            "=====================================================================================================\n",
+            st.year, st.month, st.day, st.hour, st.minute, st.second);
+    file_writer_write(writer, banner, (u32)((banner_len < (i32)sizeof(banner)) ? banner_len : (i32)sizeof(banner) - 1), LOG_TYPE_TRACE, 0);
+    file_writer_flush(writer);
+}
+
+
+// Used after a crash: writes the buffered data followed by [data]. [writer->mutex] is only tried [lock_attempts] times because the
+// crashed thread (or a logger thread that did not stop) may hold it, a busy writer is skipped
+void file_writer_crash_write(log_file_writer* writer, const char* data, const u32 length, const u32 lock_attempts) {
+
+    for (u32 x = 0; pthread_mutex_trylock(&writer->mutex) != 0; x++) {
+        if (x + 1 >= lock_attempts)
+            return;
+        sched_yield();
+    }
+
+    if (writer->fd >= 0) {
+        struct iovec iov[2] = {
+            { .iov_base = writer->buffer,   .iov_len = writer->fill },
+            { .iov_base = (void*)data,      .iov_len = length },
+        };
+        writer->fill = 0;
+        write_all(writer->fd, (iov[0].iov_len > 0) ? iov : &iov[1], (iov[0].iov_len > 0) ? 2 : 1);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
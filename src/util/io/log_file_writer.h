@@ -0,0 +1,65 @@
+#pragma once
+
+#include <time.h>
+#include <sys/uio.h>
+
+#include "logger.h"
+
+// File output of the logger, internal to it: buffered writes according to a [logger_flush_policy], rotation according to a
+// [logger_rotation_policy] and a background thread that compresses and deletes rotated files.
+// All functions of a writer are thread safe, except file_writer_crash_write() which is only meant for logger_on_crash().
+
+typedef struct log_file_writer log_file_writer;
+
+
+static inline u64 monotonic_ns() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+
+// @brief Writes all [iov_count] buffers, retries on partial writes and EINTR. [iov] is modified
+// @return false if writev() failed
+b8 write_all(const int fd, struct iovec* iov, int iov_count);
+
+
+// ============================================================================================================================================
+// file writer
+// ============================================================================================================================================
+
+// @brief Opens [file_path] and scans for rotated files of previous runs if [rotation] is enabled
+// @param binary Every new file starts with the LOG_BINARY_MAGIC header
+// @return NULL if the file could not be opened
+log_file_writer* file_writer_create(const char* file_path, const b8 use_append_mode, const logger_flush_policy policy, const logger_rotation_policy rotation, const b8 binary);
+
+// @brief Writes the buffered data and closes the file
+void file_writer_destroy(log_file_writer* writer);
+
+// @brief Appends [data] and writes the buffer if the flush policy requires it
+// @param timestamp_ns Wall-clock time of the message, used for time based rotation
+void file_writer_write(log_file_writer* writer, const char* data, const u32 length, const log_type type, const u64 timestamp_ns);
+
+// @brief Writes the banner that opens (with [format]) or closes (NULL) a log file and flushes
+void file_writer_write_banner(log_file_writer* writer, const char* format);
+
+void file_writer_flush(log_file_writer* writer);
+
+void file_writer_set_policy(log_file_writer* writer, const logger_flush_policy policy);
+
+// @brief CLOCK_MONOTONIC time at which buffered data has to be written because of the interval policy, 0 if nothing is buffered
+u64 file_writer_deadline(log_file_writer* writer);
+
+// @brief Used after a crash: writes the buffered data followed by [data]. [writer->mutex] is only tried [lock_attempts] times
+//        because the crashed thread (or a logger thread that did not stop) may hold it, a busy writer is skipped
+void file_writer_crash_write(log_file_writer* writer, const char* data, const u32 length, const u32 lock_attempts);
+
+
+// ============================================================================================================================================
+// housekeeping of rotated files
+// ============================================================================================================================================
+
+// @brief Finishes pending deletions and stops the housekeeping thread, an ongoing compression is aborted.
+//        Files that are still uncompressed are picked up on the next start
+void housekeeping_shutdown();
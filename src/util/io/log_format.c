@@ -0,0 +1,810 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "log_format.h"
+
+
+static const char* c_severity_names[] =       { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR", "FATAL" };
+
+
+const char* log_level_to_string(log_type t) {
+
+    if ((int)t < 0 || (size_t)t >= sizeof(c_severity_names) / sizeof(c_severity_names[0]))
+        return "UNK";
+    return c_severity_names[(int)t];
+}
+
+
+static const char* c_console_color_table[] = {
+    "\033[90m",                 // TRACE - gray
+    "\033[94m",                 // DEBUG - blue
+    "\033[92m",                 // INFO  - green
+    "\033[93m",                 // WARN  - yellow
+    "\033[91m",                 // ERROR - red
+    "\x1B[1m\x1B[37m\x1B[41m"   // FATAL - bold white on red
+};
+
+static const char*              c_console_rest = "\033[0m";
+
+
+// ============================================================================================================================================
+// call site formats
+// ============================================================================================================================================
+
+// Parses the conversion starting at [fmt] (which points to a '%'), returns false for malformed specs
+static b8 parse_format_spec(const char* fmt, log_format_spec* spec) {
+
+    const char* c = fmt + 1;
+    spec->begin = fmt;
+    spec->star_width = false;
+    spec->star_precision = false;
+    spec->precision = LOG_NO_PRECISION;
+
+    while (*c && strchr("-+ #0'", *c)) c++;                                         // flags
+    if (*c == '*')  { spec->star_width = true; c++; }                               // width
+    else            while (*c >= '0' && *c <= '9') c++;
+    if (*c == '.') {                                                                // precision
+        c++;
+        if (*c == '*')  { spec->star_precision = true; c++; }
+        else {
+            spec->precision = 0;                                                    // "%.s" is a precision of 0
+            for (; *c >= '0' && *c <= '9'; c++)
+                spec->precision = (spec->precision < INT32_MAX / 10) ? spec->precision * 10 + (*c - '0') : INT32_MAX;
+        }
+    }
+    while (*c && strchr("hlLqjzt", *c)) c++;                                        // length modifier, replaced when rendering
+
+    if (!*c || !strchr("diouxXeEfFgGaAcsp%", *c))                                  // %n is not supported
+        return false;
+
+    spec->conversion = *c;
+    spec->end = c + 1;
+    return true;
+}
+
+
+// Splits the format of [site] into conversions and decides how each argument is stored:
+// pointers are only copied as strings if they are printed with %s, a char* printed with %p (or not at all) is stored as raw pointer.
+// Parsing stops at the first malformed conversion or the first conversion without a matching argument, the rest is printed literally
+struct log_parsed_format* parse_site_format(const log_site* site) {
+
+    u32 arg_count = 0;
+    while (site->arg_types[arg_count] != LOG_ARG_END && arg_count < LOG_MAX_ARGS)
+        arg_count++;
+
+    u32 max_specs = 0;
+    for (const char* c = site->format; *c; c++)
+        max_specs += (*c == '%');
+
+    struct log_parsed_format* parsed = calloc(1, sizeof(struct log_parsed_format) + max_specs * sizeof(log_format_spec));
+    if (!parsed)
+        return NULL;
+
+    parsed->arg_count = arg_count;
+    for (u32 x = 0; x < arg_count; x++)
+        parsed->storage_types[x] = (site->arg_types[x] == LOG_ARG_STR && !site->field_names) ? LOG_ARG_PTR : site->arg_types[x];
+    parsed->storage_types[arg_count] = LOG_ARG_END;
+    for (u32 x = 0; x < LOG_MAX_ARGS; x++) {
+        parsed->str_precision[x] = LOG_NO_PRECISION;
+        parsed->str_precision_arg[x] = LOG_NO_PRECISION_ARG;
+    }
+
+    if (site->field_names)                                  // LOG_KV: every argument is a field, the message has no conversions
+        return parsed;
+
+    u32 arg = 0;
+    const char* c = site->format;
+    while ((c = strchr(c, '%'))) {
+
+        log_format_spec spec;
+        if (!parse_format_spec(c, &spec))
+            break;
+
+        if (spec.conversion != '%') {
+            arg += spec.star_width + spec.star_precision;
+            if (arg >= arg_count)
+                break;
+
+            spec.arg = (u8)arg;
+            u8* type = &parsed->storage_types[arg];
+            if (spec.conversion == 's' && (*type == LOG_ARG_PTR)) {
+                *type = LOG_ARG_STR;
+                parsed->str_precision[arg] = spec.precision;
+                if (spec.star_precision)
+                    parsed->str_precision_arg[arg] = (u8)(arg - 1);
+            }
+            arg++;
+        }
+
+        parsed->specs[parsed->spec_count++] = spec;
+        c = spec.end;
+    }
+
+    return parsed;
+}
+
+
+// ============================================================================================================================================
+// deferred arguments
+// ============================================================================================================================================
+
+// Payload of a deferred record (directly after the header) are the raw argument values, stored as described by the parsed format of the site.
+// Values are unaligned (read/written with memcpy)
+//      LOG_ARG_I32/U32: 4 byte  LOG_ARG_I64/U64/F64/PTR: 8 byte  LOG_ARG_F128: sizeof(long double)
+//      LOG_ARG_STR: u32 length (LOG_STR_NULL for a NULL pointer) followed by the characters and '\0'
+// Strings are shortened so the payload never exceeds MSG_LEN. The same payload holds the fields of LOG_KV records,
+// only formatting the arguments (render_log_args) is limited to the logger thread, without it there is nothing to defer to
+
+#define LOG_STR_NULL                        UINT32_MAX
+#define LOG_ARGS_STRING_BUDGET              (MSG_LEN - LOG_MAX_ARGS * (sizeof(long double) + sizeof(u32) + 1))     // characters of all strings of a payload
+
+static inline b8 is_float_conversion(const char conversion)      { return strchr("eEfFgGaA", conversion) != NULL; }
+
+
+// Captures the arguments of [site] from [args] into [values]. Returns the number of payload bytes needed
+u32 capture_log_args(const struct log_parsed_format* parsed, va_list* args, log_arg_value* values, u32* str_lengths) {
+
+    u32 size = 0;
+    size_t string_budget = LOG_ARGS_STRING_BUDGET;
+    for (u32 x = 0; x < parsed->arg_count; x++) {
+        switch (parsed->storage_types[x]) {
+            case LOG_ARG_I32:   values[x].i = va_arg(*args, int);                   size += sizeof(u32); break;
+            case LOG_ARG_U32:   values[x].u = va_arg(*args, unsigned int);          size += sizeof(u32); break;
+            case LOG_ARG_I64:   values[x].i = va_arg(*args, long long);             size += sizeof(u64); break;
+            case LOG_ARG_U64:   values[x].u = va_arg(*args, unsigned long long);    size += sizeof(u64); break;
+            case LOG_ARG_F64:   values[x].f = va_arg(*args, double);                size += sizeof(u64); break;
+            case LOG_ARG_F128:  values[x].ld = va_arg(*args, long double);          size += sizeof(long double); break;
+            case LOG_ARG_STR: {
+                // the precision limits what printf would read, the string does not need a '\0' within it.
+                // A '*' precision precedes the string, so it is already captured (negative means none, like printf)
+                size_t limit = string_budget;
+                i64 precision = parsed->str_precision[x];
+                if (parsed->str_precision_arg[x] != LOG_NO_PRECISION_ARG)
+                    precision = (int)values[parsed->str_precision_arg[x]].i;
+                if (precision >= 0 && (u64)precision < limit)
+                    limit = (size_t)precision;
+
+                values[x].str = va_arg(*args, const char*);
+                str_lengths[x] = values[x].str ? (u32)strnlen(values[x].str, limit) : LOG_STR_NULL;
+                if (values[x].str) {
+                    string_budget -= str_lengths[x];
+                    size += str_lengths[x] + 1;
+                }
+                size += sizeof(u32);
+            } break;
+            default:            values[x].ptr = va_arg(*args, const void*);         size += sizeof(u64); break;
+        }
+    }
+    return size;
+}
+
+
+// Writes the payload measured by [capture_log_args]
+void write_log_args(u8* payload, const struct log_parsed_format* parsed, const log_arg_value* values, const u32* str_lengths) {
+
+    for (u32 x = 0; x < parsed->arg_count; x++) {
+        switch (parsed->storage_types[x]) {
+            case LOG_ARG_I32:
+            case LOG_ARG_U32: {
+                const u32 value = (u32)values[x].u;
+                memcpy(payload, &value, sizeof(value));
+                payload += sizeof(value);
+            } break;
+            case LOG_ARG_F128:
+                memcpy(payload, &values[x].ld, sizeof(long double));
+                payload += sizeof(long double);
+                break;
+            case LOG_ARG_STR:
+                memcpy(payload, &str_lengths[x], sizeof(u32));
+                payload += sizeof(u32);
+                if (str_lengths[x] != LOG_STR_NULL) {
+                    memcpy(payload, values[x].str, str_lengths[x]);
+                    payload[str_lengths[x]] = '\0';
+                    payload += str_lengths[x] + 1;
+                }
+                break;
+            default:
+                memcpy(payload, &values[x].u, sizeof(u64));
+                payload += sizeof(u64);
+                break;
+        }
+    }
+}
+
+
+// Reads the values written by [write_log_args], strings point into [payload]
+void unpack_log_args(const struct log_parsed_format* parsed, const u8* payload, log_arg_value* values) {
+
+    for (u32 x = 0; x < parsed->arg_count; x++) {
+        switch (parsed->storage_types[x]) {
+            case LOG_ARG_I32: { i32 value; memcpy(&value, payload, sizeof(value)); values[x].i = value; payload += sizeof(value); } break;
+            case LOG_ARG_U32: { u32 value; memcpy(&value, payload, sizeof(value)); values[x].u = value; payload += sizeof(value); } break;
+            case LOG_ARG_F128:  memcpy(&values[x].ld, payload, sizeof(long double)); payload += sizeof(long double); break;
+            case LOG_ARG_STR: {
+                u32 length;
+                memcpy(&length, payload, sizeof(length));
+                payload += sizeof(length);
+                values[x].str = (length == LOG_STR_NULL) ? NULL : (const char*)payload;
+                if (length != LOG_STR_NULL)
+                    payload += length + 1;
+            } break;
+            default:            memcpy(&values[x].u, payload, sizeof(u64)); payload += sizeof(u64); break;
+        }
+    }
+}
+
+
+// Formats the payload of a deferred record into [buffer]. Every conversion is rendered on its own with a length modifier that matches the stored type,
+// so mismatches between format and argument (e.g. %d with a u64) are printed correctly instead of being undefined behavior
+void render_log_args(const log_site* site, const u8* payload, char* buffer, const size_t buffer_size) {
+
+    const struct log_parsed_format* parsed = site->parsed_format;
+    log_arg_value values[LOG_MAX_ARGS];
+    unpack_log_args(parsed, payload, values);
+
+    size_t len = 0;
+    const char* literal = site->format;
+    for (u32 s = 0; s < parsed->spec_count && len < buffer_size - 1; s++) {
+
+        const log_format_spec* spec = &parsed->specs[s];
+        const size_t literal_len = min_size((size_t)(spec->begin - literal), buffer_size - 1 - len);
+        memcpy(buffer + len, literal, literal_len);
+        len += literal_len;
+        literal = spec->end;
+
+        if (spec->conversion == '%') {
+            if (len < buffer_size - 1)
+                buffer[len++] = '%';
+            continue;
+        }
+
+        // rebuild the spec: resolve '*' and drop the length modifier
+        char spec_buffer[64];
+        u32 spec_len = 0;
+        u32 star_arg = spec->arg - spec->star_width - spec->star_precision;
+        for (const char* c = spec->begin; c < spec->end - 1 && spec_len < sizeof(spec_buffer) - 24; c++) {
+            if (c[0] == '.' && c[1] == '*' && (int)values[star_arg].i < 0) {          // a negative precision is taken as if it was omitted
+                star_arg++;
+                c++;
+            } else if (*c == '*')
+                spec_len += snprintf(spec_buffer + spec_len, sizeof(spec_buffer) - spec_len, "%d", (int)values[star_arg++].i);
+            else if (!strchr("hlLqjzt", *c))
+                spec_buffer[spec_len++] = *c;
+        }
+
+        const u8 type = parsed->storage_types[spec->arg];
+        const log_arg_value value = values[spec->arg];
+        const b8 is_float_type = (type == LOG_ARG_F64 || type == LOG_ARG_F128);
+        i32 written = 0;
+        char* out = buffer + len;
+        const size_t remaining = buffer_size - len;
+
+        if (is_float_conversion(spec->conversion)) {
+            spec_buffer[spec_len] = 'L';
+            spec_buffer[spec_len + 1] = spec->conversion;
+            spec_buffer[spec_len + 2] = '\0';
+            long double ld = value.ld;
+            if (type == LOG_ARG_F64)                                    ld = value.f;
+            else if (type == LOG_ARG_I32 || type == LOG_ARG_I64)        ld = (long double)value.i;
+            else if (type != LOG_ARG_F128)                              ld = (long double)value.u;
+            written = snprintf(out, remaining, spec_buffer, ld);
+
+        } else if (spec->conversion == 's' || spec->conversion == 'p') {
+            spec_buffer[spec_len] = spec->conversion;
+            spec_buffer[spec_len + 1] = '\0';
+            written = snprintf(out, remaining, spec_buffer, value.ptr);
+
+        } else {
+            if (spec->conversion != 'c') {
+                spec_buffer[spec_len++] = 'l';
+                spec_buffer[spec_len++] = 'l';
+            }
+            spec_buffer[spec_len] = spec->conversion;
+            spec_buffer[spec_len + 1] = '\0';
+            long long integer = value.i;
+            if (is_float_type)                                          integer = (type == LOG_ARG_F64) ? (long long)value.f : (long long)value.ld;
+            else if (type == LOG_ARG_I32 && strchr("ouxX", spec->conversion))   integer = (unsigned int)value.i;     // keep the 32 bit width of negative values
+            if (spec->conversion == 'c')
+                written = snprintf(out, remaining, spec_buffer, (int)integer);
+            else
+                written = snprintf(out, remaining, spec_buffer, integer);
+        }
+
+        if (written > 0)
+            len += min_size((size_t)written, remaining - 1);
+    }
+
+    // trailing literal text
+    if (len < buffer_size - 1) {
+        const size_t literal_len = min_size(strlen(literal), buffer_size - 1 - len);
+        memcpy(buffer + len, literal, literal_len);
+        len += literal_len;
+    }
+    buffer[len] = '\0';
+}
+
+
+// ============================================================================================================================================
+// format program
+// ============================================================================================================================================
+
+// [use_colors] false drops the $B / $E tags, used for sinks that are not a terminal
+format_program* compile_format(const char* format, const b8 use_colors, const log_output_format output) {
+
+    // every '$' produces at most one field op and one literal op, plus the literal before it
+    u32 max_ops = 1;
+    for (const char* c = format; *c; c++)
+        max_ops += (*c == '$') ? 2 : 0;
+
+    format_program* program = calloc(1, sizeof(format_program) + max_ops * sizeof(format_op));
+    if (!program)
+        return NULL;
+
+    program->format = strdup(format);
+    if (!program->format) {
+        free(program);
+        return NULL;
+    }
+
+    program->output = output;
+    if (output != LOG_OUTPUT_TEXT)
+        return program;
+
+    program->use_colors = use_colors;
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++)
+        program->color_length[x] = (u32)strlen(c_console_color_table[x]);
+    program->color_rest_length = (u32)strlen(c_console_rest);
+
+    const char* literal = program->format;
+    const char* c = program->format;
+    while (*c) {
+
+        if (*c != '$' || c[1] == '\0') {
+            c++;
+            continue;
+        }
+
+        format_op_type type;
+        switch (c[1]) {
+            case 'B': type = FORMAT_OP_COLOR_BEGIN; break;
+            case 'E': type = FORMAT_OP_COLOR_END; break;
+            case 'C': type = FORMAT_OP_MESSAGE; break;
+            case 'L': type = FORMAT_OP_LEVEL; break;
+            case 'Q': type = FORMAT_OP_THREAD; break;
+            case 'F':
+            case 'P': type = FORMAT_OP_FUNCTION; break;
+            case 'A': type = FORMAT_OP_FILE; break;
+            case 'I': type = FORMAT_OP_SHORT_FILE; break;
+            case 'G': type = FORMAT_OP_LINE; break;
+            case 'T': type = FORMAT_OP_TIME; break;
+            case 'H': type = FORMAT_OP_HOUR; break;
+            case 'M': type = FORMAT_OP_MINUTE; break;
+            case 'S': type = FORMAT_OP_SECOND; break;
+            case 'J': type = FORMAT_OP_MILLISEC; break;
+            case 'N': type = FORMAT_OP_DATE; break;
+            case 'Y': type = FORMAT_OP_YEAR; break;
+            case 'O': type = FORMAT_OP_MONTH; break;
+            case 'D': type = FORMAT_OP_DAY; break;
+            case 'Z': type = FORMAT_OP_LITERAL; break;
+            default:                                                // unknown tag - treat literally (keep '$' and the char)
+                c += 2;
+                continue;
+        }
+
+        if (c > literal)
+            program->ops[program->op_count++] = (format_op){ .type = FORMAT_OP_LITERAL, .length = (u32)(c - literal), .text = literal };
+
+        if (c[1] == 'Z')                                            // newline
+            program->ops[program->op_count++] = (format_op){ .type = FORMAT_OP_LITERAL, .length = 1, .text = "\n" };
+        else if (use_colors || (type != FORMAT_OP_COLOR_BEGIN && type != FORMAT_OP_COLOR_END))
+            program->ops[program->op_count++] = (format_op){ .type = type };
+
+        program->uses_time |= (type >= FORMAT_OP_TIME);
+        c += 2;
+        literal = c;
+    }
+
+    if (c > literal)
+        program->ops[program->op_count++] = (format_op){ .type = FORMAT_OP_LITERAL, .length = (u32)(c - literal), .text = literal };
+
+    return program;
+}
+
+
+void free_format_program(format_program* program) {
+
+    if (!program) return;
+    free(program->format);
+    free(program);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------
+// output buffer
+// ------------------------------------------------------------------------------------------------------------------
+
+static const char c_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+static inline void buffer_append(format_buffer* buffer, const char* text, u32 length) {
+
+    if (length > FORMAT_BUFFER_SIZE - 1 - buffer->len)
+        length = FORMAT_BUFFER_SIZE - 1 - buffer->len;
+    memcpy(buffer->data + buffer->len, text, length);
+    buffer->len += length;
+}
+
+
+static inline void buffer_append_char(format_buffer* buffer, const char c) {
+
+    if (buffer->len < FORMAT_BUFFER_SIZE - 1)
+        buffer->data[buffer->len++] = c;
+}
+
+
+// Appends [value] in decimal, zero padded to at least [min_digits] digits
+static void buffer_append_u64(format_buffer* buffer, u64 value, const u32 min_digits) {
+
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* c = end;
+    while (value >= 100) {
+        const u32 pair = (u32)(value % 100) * 2;
+        value /= 100;
+        *--c = c_digit_pairs[pair + 1];
+        *--c = c_digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--c = c_digit_pairs[value * 2 + 1];
+        *--c = c_digit_pairs[value * 2];
+    } else
+        *--c = (char)('0' + value);
+
+    while ((u32)(end - c) < min_digits && c > digits)
+        *--c = '0';
+
+    buffer_append(buffer, c, (u32)(end - c));
+}
+
+
+static inline void buffer_append_2_digits(format_buffer* buffer, const u32 value) {
+
+    buffer_append(buffer, &c_digit_pairs[(value % 100) * 2], 2);
+}
+
+
+static inline void buffer_append_i64(format_buffer* buffer, const i64 value) {
+
+    if (value < 0) {
+        buffer_append_char(buffer, '-');
+        buffer_append_u64(buffer, (u64)0 - (u64)value, 1);
+    } else
+        buffer_append_u64(buffer, (u64)value, 1);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------
+// structured output
+// ------------------------------------------------------------------------------------------------------------------
+
+// Fields of LOG_KV records and the JSON / binary outputs. A record always has to fit into one [format_buffer] and stay well formed,
+// so strings are shortened to end before STRUCTURED_STRING_LIMIT. The reserve behind it holds everything that can follow a string:
+// keys (up to 6 bytes per escaped character), numbers and punctuation of all fields plus the end of the record.
+
+#define STRUCTURED_TAIL_RESERVE     (LOG_MAX_ARGS * (6 * LOG_KV_MAX_KEY_LENGTH + 64) + 64)
+#define STRUCTURED_STRING_LIMIT     (FORMAT_BUFFER_SIZE - 1 - STRUCTURED_TAIL_RESERVE)
+
+STATIC_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary log records are written in host byte order, which needs to be little endian");
+
+
+// Number of bytes a string can still use before the reserve
+static inline u32 structured_string_room(const format_buffer* buffer)  { return (buffer->len < STRUCTURED_STRING_LIMIT) ? STRUCTURED_STRING_LIMIT - buffer->len : 0; }
+
+#define BUFFER_APPEND_LITERAL(buffer, text)     buffer_append(buffer, text, sizeof(text) - 1)
+
+static inline u32 field_key_length(const char* key)                      { return (u32)strnlen(key, LOG_KV_MAX_KEY_LENGTH); }
+
+
+// Appends [length] bytes of [text] as quoted JSON string, stops escaping once [buffer] would grow beyond [limit]
+static void buffer_append_json_string(format_buffer* buffer, const char* text, const u32 length, const u32 limit) {
+
+    static const char c_hex[] = "0123456789abcdef";
+    buffer_append_char(buffer, '"');
+    for (u32 x = 0; x < length && buffer->len + 6 <= limit; x++) {
+        const unsigned char c = (unsigned char)text[x];
+        if (c == '"' || c == '\\') {
+            buffer_append_char(buffer, '\\');
+            buffer_append_char(buffer, (char)c);
+        } else if (c >= 0x20)
+            buffer_append_char(buffer, (char)c);
+        else if (c == '\n')
+            buffer_append(buffer, "\\n", 2);
+        else if (c == '\t')
+            buffer_append(buffer, "\\t", 2);
+        else if (c == '\r')
+            buffer_append(buffer, "\\r", 2);
+        else {
+            const char escape[6] = { '\\', 'u', '0', '0', c_hex[c >> 4], c_hex[c & 0xF] };
+            buffer_append(buffer, escape, sizeof(escape));
+        }
+    }
+    buffer_append_char(buffer, '"');
+}
+
+
+// Appends a single field value, [json] selects JSON syntax (quoted strings and pointers, null) over the " key=value" text form
+static void buffer_append_field_value(format_buffer* buffer, const u8 type, const log_arg_value value, const b8 json) {
+
+    char number[64];
+    i32 number_len = 0;
+    switch (type) {
+        case LOG_ARG_I32:
+        case LOG_ARG_I64:   buffer_append_i64(buffer, value.i); return;
+        case LOG_ARG_U32:
+        case LOG_ARG_U64:   buffer_append_u64(buffer, value.u, 1); return;
+
+        case LOG_ARG_F64:
+        case LOG_ARG_F128: {
+            const f64 f = (type == LOG_ARG_F64) ? value.f : (f64)value.ld;
+            if (json && !isfinite(f)) {                                         // JSON has no NaN or infinity
+                BUFFER_APPEND_LITERAL(buffer, "null");
+                return;
+            }
+            number_len = json ? snprintf(number, sizeof(number), "%.17g", f)  // round trip
+                : (type == LOG_ARG_F64) ? snprintf(number, sizeof(number), "%g", f) : snprintf(number, sizeof(number), "%Lg", value.ld);
+        } break;
+
+        case LOG_ARG_STR:
+            if (!value.str)
+                buffer_append(buffer, json ? "null" : "(null)", json ? 4 : 6);
+            else if (json)
+                buffer_append_json_string(buffer, value.str, (u32)strlen(value.str), STRUCTURED_STRING_LIMIT);
+            else {
+                buffer_append_char(buffer, '"');
+                buffer_append(buffer, value.str, (u32)strlen(value.str));
+                buffer_append_char(buffer, '"');
+            }
+            return;
+
+        default:
+            number_len = snprintf(number, sizeof(number), json ? "\"0x%llx\"" : "0x%llx", (unsigned long long)(uintptr_t)value.ptr);
+            break;
+    }
+    if (number_len > 0)
+        buffer_append(buffer, number, (u32)min_size((size_t)number_len, sizeof(number) - 1));
+}
+
+
+// Appends the fields of a LOG_KV record as " key=value" pairs, used by text outputs after the message
+static void render_fields_text(format_buffer* buffer, const log_site* site, const u8* fields) {
+
+    const struct log_parsed_format* parsed = site->parsed_format;
+    log_arg_value values[LOG_MAX_ARGS];
+    unpack_log_args(parsed, fields, values);
+    for (u32 x = 0; x < parsed->arg_count; x++) {
+        buffer_append_char(buffer, ' ');
+        buffer_append(buffer, site->field_names[x], field_key_length(site->field_names[x]));
+        buffer_append_char(buffer, '=');
+        buffer_append_field_value(buffer, parsed->storage_types[x], values[x], false);
+    }
+}
+
+
+// Renders one record as JSON object followed by '\n' (see LOG_OUTPUT_JSON)
+static void render_json(format_buffer* out, const log_site* site, const pthread_t thread_id, const char* label, const u64 timestamp_ns, const char* message, const u32 message_len, const u8* fields) {
+
+    const char* level = log_level_to_string(site->type);
+    out->len = 0;
+    BUFFER_APPEND_LITERAL(out, "{\"ts_ns\":");
+    buffer_append_u64(out, timestamp_ns, 1);
+    BUFFER_APPEND_LITERAL(out, ",\"level\":\"");
+    buffer_append(out, level, (u32)strcspn(level, " "));
+    BUFFER_APPEND_LITERAL(out, "\",\"thread_id\":");
+    buffer_append_u64(out, (u64)thread_id, 1);
+    if (label) {
+        BUFFER_APPEND_LITERAL(out, ",\"thread\":");
+        buffer_append_json_string(out, label, (u32)strlen(label), STRUCTURED_STRING_LIMIT);
+    }
+    BUFFER_APPEND_LITERAL(out, ",\"file\":");
+    buffer_append_json_string(out, site->file_name, (u32)strlen(site->file_name), STRUCTURED_STRING_LIMIT);
+    BUFFER_APPEND_LITERAL(out, ",\"line\":");
+    buffer_append_i64(out, site->line);
+    BUFFER_APPEND_LITERAL(out, ",\"function\":");
+    buffer_append_json_string(out, site->function_name, (u32)strlen(site->function_name), STRUCTURED_STRING_LIMIT);
+    BUFFER_APPEND_LITERAL(out, ",\"message\":");
+    buffer_append_json_string(out, message, message_len, STRUCTURED_STRING_LIMIT);
+
+    if (fields) {
+        const struct log_parsed_format* parsed = site->parsed_format;
+        log_arg_value values[LOG_MAX_ARGS];
+        unpack_log_args(parsed, fields, values);
+        BUFFER_APPEND_LITERAL(out, ",\"fields\":{");
+        for (u32 x = 0; x < parsed->arg_count; x++) {
+            if (x > 0)
+                buffer_append_char(out, ',');
+            buffer_append_json_string(out, site->field_names[x], field_key_length(site->field_names[x]), FORMAT_BUFFER_SIZE - 1);
+            buffer_append_char(out, ':');
+            buffer_append_field_value(out, parsed->storage_types[x], values[x], true);
+        }
+        buffer_append_char(out, '}');
+    }
+    BUFFER_APPEND_LITERAL(out, "}\n");
+    out->data[out->len] = '\0';
+}
+
+
+static inline void buffer_append_binary(format_buffer* buffer, const void* value, const u32 size)        { buffer_append(buffer, (const char*)value, size); }
+
+
+// Appends a string with its u32 length prefix, shortened to the room left before the reserve
+static void buffer_append_binary_string(format_buffer* buffer, const char* text, const u32 length) {
+
+    const u32 room = structured_string_room(buffer);
+    const u32 written = (room > sizeof(u32)) ? (u32)min_size(length, room - sizeof(u32)) : 0;
+    buffer_append_binary(buffer, &written, sizeof(written));
+    buffer_append(buffer, text, written);
+}
+
+
+// Renders one record in the binary layout described at LOG_BINARY_MAGIC
+static void render_binary(format_buffer* out, const log_site* site, const pthread_t thread_id, const char* label, const u64 timestamp_ns, const char* message, const u32 message_len, const u8* fields) {
+
+    const struct log_parsed_format* parsed = fields ? site->parsed_format : NULL;
+    const u64 thread = (u64)thread_id;
+    const u32 line = (u32)site->line;
+    const u8 level = (u8)site->type;
+    const u8 field_count = parsed ? (u8)parsed->arg_count : 0;
+
+    // the lengths are part of the fixed header, so the strings are shortened up front
+    u32 room = STRUCTURED_STRING_LIMIT - LOG_BINARY_RECORD_HEADER_SIZE;
+    const u16 label_length = label ? (u16)min_size(min_size(strlen(label), UINT16_MAX), room) : 0;
+    room -= label_length;
+    const u16 file_length = (u16)min_size(min_size(strlen(site->file_name), UINT16_MAX), room);
+    room -= file_length;
+    const u16 function_length = (u16)min_size(min_size(strlen(site->function_name), UINT16_MAX), room);
+    room -= function_length;
+    const u32 message_length = (u32)min_size(message_len, room);
+
+    out->len = sizeof(u32);                                                 // [size] is filled in at the end
+    buffer_append_binary(out, &timestamp_ns, sizeof(timestamp_ns));
+    buffer_append_binary(out, &thread, sizeof(thread));
+    buffer_append_binary(out, &line, sizeof(line));
+    buffer_append_binary(out, &level, sizeof(level));
+    buffer_append_binary(out, &field_count, sizeof(field_count));
+    buffer_append_binary(out, &label_length, sizeof(label_length));
+    buffer_append_binary(out, &file_length, sizeof(file_length));
+    buffer_append_binary(out, &function_length, sizeof(function_length));
+    buffer_append_binary(out, &message_length, sizeof(message_length));
+    buffer_append(out, label ? label : "", label_length);
+    buffer_append(out, site->file_name, file_length);
+    buffer_append(out, site->function_name, function_length);
+    buffer_append(out, message, message_length);
+
+    if (parsed) {
+        log_arg_value values[LOG_MAX_ARGS];
+        unpack_log_args(parsed, fields, values);
+        for (u32 x = 0; x < parsed->arg_count; x++) {
+            const u8 type = (parsed->storage_types[x] == LOG_ARG_F128) ? LOG_ARG_F64 : parsed->storage_types[x];
+            const u8 key_length = (u8)field_key_length(site->field_names[x]);
+            buffer_append_binary(out, &type, sizeof(type));
+            buffer_append_binary(out, &key_length, sizeof(key_length));
+            buffer_append(out, site->field_names[x], key_length);
+
+            switch (type) {
+                case LOG_ARG_I32:
+                case LOG_ARG_U32: {
+                    const u32 value = (u32)values[x].u;
+                    buffer_append_binary(out, &value, sizeof(value));
+                } break;
+                case LOG_ARG_F64: {
+                    const f64 value = (parsed->storage_types[x] == LOG_ARG_F128) ? (f64)values[x].ld : values[x].f;
+                    buffer_append_binary(out, &value, sizeof(value));
+                } break;
+                case LOG_ARG_STR:
+                    if (values[x].str)
+                        buffer_append_binary_string(out, values[x].str, (u32)strlen(values[x].str));
+                    else {
+                        const u32 null_length = LOG_BINARY_NULL_STRING;
+                        buffer_append_binary(out, &null_length, sizeof(null_length));
+                    }
+                    break;
+                default:
+                    buffer_append_binary(out, &values[x].u, sizeof(u64));
+                    break;
+            }
+        }
+    }
+
+    const u32 size = out->len - (u32)sizeof(u32);
+    memcpy(out->data, &size, sizeof(size));
+    out->data[out->len] = '\0';
+}
+
+
+// runs [program] for one message, [fields] is the payload of a LOG_KV record or NULL
+void render_message(const format_program* program, format_buffer* out, const log_site* site, const pthread_t thread_id, const char* label,
+    const u64 timestamp_ns, const system_time* st, const char* message, const u32 message_len, const u8* fields) {
+
+    if (program->output == LOG_OUTPUT_JSON) {
+        render_json(out, site, thread_id, label, timestamp_ns, message, message_len, fields);
+        return;
+    }
+    if (program->output == LOG_OUTPUT_BINARY) {
+        render_binary(out, site, thread_id, label, timestamp_ns, message, message_len, fields);
+        return;
+    }
+
+    out->len = 0;
+    for (u32 x = 0; x < program->op_count; x++) {
+        const format_op* op = &program->ops[x];
+        switch (op->type) {
+            case FORMAT_OP_LITERAL:         buffer_append(out, op->text, op->length); break;
+            case FORMAT_OP_COLOR_BEGIN:     buffer_append(out, c_console_color_table[(int)site->type], program->color_length[(int)site->type]); break;
+            case FORMAT_OP_COLOR_END:       buffer_append(out, c_console_rest, program->color_rest_length); break;
+            case FORMAT_OP_MESSAGE:
+                buffer_append(out, message, message_len);
+                if (fields)
+                    render_fields_text(out, site, fields);
+                break;
+            case FORMAT_OP_LEVEL: {
+                const char* level = log_level_to_string(site->type);
+                buffer_append(out, level, (u32)strlen(level));
+            } break;
+            case FORMAT_OP_THREAD:                                                                          // thread id or label
+                if (label)  buffer_append(out, label, (u32)strlen(label));
+                else        buffer_append_u64(out, (u64)thread_id, 1);
+                break;
+            case FORMAT_OP_FUNCTION:        buffer_append(out, site->function_name, (u32)strlen(site->function_name)); break;
+            case FORMAT_OP_FILE:            buffer_append(out, site->file_name, (u32)strlen(site->file_name)); break;
+            case FORMAT_OP_SHORT_FILE: {
+                const char* short_file_name = site->short_file_name ? site->short_file_name : short_filename(site->file_name);
+                buffer_append(out, short_file_name, (u32)strlen(short_file_name));
+            } break;
+            case FORMAT_OP_LINE:            buffer_append_i64(out, site->line); break;
+
+            case FORMAT_OP_TIME:                                                                            // hh:mm:ss
+                buffer_append_2_digits(out, st->hour);
+                buffer_append_char(out, ':');
+                buffer_append_2_digits(out, st->minute);
+                buffer_append_char(out, ':');
+                buffer_append_2_digits(out, st->second);
+                break;
+            case FORMAT_OP_HOUR:            buffer_append_2_digits(out, st->hour); break;
+            case FORMAT_OP_MINUTE:          buffer_append_2_digits(out, st->minute); break;
+            case FORMAT_OP_SECOND:          buffer_append_2_digits(out, st->second); break;
+            case FORMAT_OP_MILLISEC:        buffer_append_u64(out, st->millisec, 3); break;
+
+            case FORMAT_OP_DATE:                                                                            // yyyy/mm/dd
+                buffer_append_u64(out, st->year, 4);
+                buffer_append_char(out, '/');
+                buffer_append_2_digits(out, st->month);
+                buffer_append_char(out, '/');
+                buffer_append_2_digits(out, st->day);
+                break;
+            case FORMAT_OP_YEAR:            buffer_append_u64(out, st->year, 4); break;
+            case FORMAT_OP_MONTH:           buffer_append_2_digits(out, st->month); break;
+            case FORMAT_OP_DAY:             buffer_append_2_digits(out, st->day); break;
+        }
+    }
+
+    // ensure final message ends with newline
+    if (out->len == 0 || out->data[out->len - 1] != '\n') {
+        if (out->len == FORMAT_BUFFER_SIZE - 1)
+            out->len--;
+        out->data[out->len++] = '\n';
+    }
+    out->data[out->len] = '\0';
+}
+
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "util/system.h"
+
+#include "logger.h"
+
+// Formatting of log messages, internal to the logger: the parsed format of every call site, the payload of deferred arguments
+// and the format programs that render a message for a sink.
+
+
+#define MSG_LEN 32000                       // maximum log message length (should never be needed, but ...)
+
+
+static inline size_t min_size(const size_t a, const size_t b)    { return a < b ? a : b; }
+
+
+// @brief Name of [t] padded to 5 characters ("INFO "), "UNK" for unknown values
+const char* log_level_to_string(log_type t);
+
+
+static inline const char *short_filename(const char *path) {
+
+    const char *s1 = strrchr(path, '/');
+    const char *s2 = strrchr(path, '\\');
+    const char *last = NULL;
+
+    if (s1 && s2)
+        last = (s1 > s2) ? s1 : s2;
+    else
+        last = s1 ? s1 : s2;
+
+    return last ? last + 1 : path;
+}
+
+
+// ============================================================================================================================================
+// call site formats
+// ============================================================================================================================================
+
+// A single printf conversion inside a format string
+typedef struct {
+    const char*     begin;                  // points to the '%'
+    const char*     end;                    // one past the conversion character
+    char            conversion;             // 'd', 's', 'f', ... or '%' for a literal percent sign
+    b8              star_width;             // width is provided as an extra int argument
+    b8              star_precision;         // precision is provided as an extra int argument
+    u8              arg;                    // index of the argument holding the value
+    i32             precision;              // static precision, LOG_NO_PRECISION if there is none (or it is a '*')
+} log_format_spec;
+
+
+#define LOG_NO_PRECISION                -1
+#define LOG_NO_PRECISION_ARG            UINT8_MAX
+
+
+// Parsed once per call site by logger_init(), so neither the calling thread nor the logger thread need to scan the format again.
+// Without USE_MULTI_THREADING only LOG_KV sites are parsed, their fields are captured like deferred arguments
+struct log_parsed_format {
+    u32             arg_count;
+    u32             spec_count;
+    u8              storage_types[LOG_MAX_ARGS + 1];        // how each argument is captured, terminated by LOG_ARG_END
+    i32             str_precision[LOG_MAX_ARGS];            // static precision of the %s printing a string argument, LOG_NO_PRECISION if none
+    u8              str_precision_arg[LOG_MAX_ARGS];        // argument holding the '*' precision of that %s, LOG_NO_PRECISION_ARG if none
+    log_format_spec specs[];
+};
+
+
+// @brief Splits the format of [site] into conversions and decides how each argument is stored
+// @return malloc'ed result, NULL if out of memory
+struct log_parsed_format* parse_site_format(const log_site* site);
+
+
+// ============================================================================================================================================
+// deferred arguments
+// ============================================================================================================================================
+
+typedef union {
+    i64             i;
+    u64             u;
+    f64             f;
+    long double     ld;
+    const char*     str;
+    const void*     ptr;
+} log_arg_value;
+
+
+// @brief Captures the arguments described by [parsed] from [args] into [values]
+//        Strings are only read up to the precision of their %s, so "%.*s" can print buffers without a '\0'
+// @return Number of payload bytes needed (never more than MSG_LEN)
+u32 capture_log_args(const struct log_parsed_format* parsed, va_list* args, log_arg_value* values, u32* str_lengths);
+
+// @brief Writes the payload measured by capture_log_args()
+void write_log_args(u8* payload, const struct log_parsed_format* parsed, const log_arg_value* values, const u32* str_lengths);
+
+// @brief Reads the values written by write_log_args(), strings point into [payload]
+void unpack_log_args(const struct log_parsed_format* parsed, const u8* payload, log_arg_value* values);
+
+// @brief Formats the payload of a deferred record of [site] into [buffer] like printf would format the original arguments
+void render_log_args(const log_site* site, const u8* payload, char* buffer, const size_t buffer_size);
+
+
+// ============================================================================================================================================
+// format program
+// ============================================================================================================================================
+
+// Every format in use ([logger_set_format] and the formats of the sinks) is compiled into a flat list of operations,
+// so the formatter never looks at the format string again. Programs are owned by the active [log_sink_set].
+
+typedef enum {
+    FORMAT_OP_LITERAL = 0,                  // copy [length] bytes of [text]
+    FORMAT_OP_COLOR_BEGIN,
+    FORMAT_OP_COLOR_END,
+    FORMAT_OP_MESSAGE,
+    FORMAT_OP_LEVEL,
+    FORMAT_OP_THREAD,
+    FORMAT_OP_FUNCTION,
+    FORMAT_OP_FILE,
+    FORMAT_OP_SHORT_FILE,
+    FORMAT_OP_LINE,
+    FORMAT_OP_TIME,
+    FORMAT_OP_HOUR,
+    FORMAT_OP_MINUTE,
+    FORMAT_OP_SECOND,
+    FORMAT_OP_MILLISEC,
+    FORMAT_OP_DATE,
+    FORMAT_OP_YEAR,
+    FORMAT_OP_MONTH,
+    FORMAT_OP_DAY,
+} format_op_type;
+
+typedef struct {
+    format_op_type      type;
+    u32                 length;             // FORMAT_OP_LITERAL only
+    const char*         text;               // FORMAT_OP_LITERAL only, points into [format_program.format]
+} format_op;
+
+typedef struct {
+    char*               format;             // source of the program, owned
+    log_output_format   output;             // JSON and binary programs have no ops, the record is rendered by render_json / render_binary
+    b8                  use_colors;         // $B / $E are emitted
+    b8                  uses_time;          // the timestamp is only taken if a time/date field is used
+    u32                 color_length[LOG_TYPE_FATAL + 1];       // strlen() of the color escapes
+    u32                 color_rest_length;
+    u32                 op_count;
+    format_op           ops[];
+} format_program;
+
+
+#define FORMAT_BUFFER_SIZE      (MSG_LEN + 4096)        // message plus everything the format adds around it
+
+typedef struct {
+    char                data[FORMAT_BUFFER_SIZE];
+    u32                 len;
+} format_buffer;
+
+
+// @brief Compiles [format] for one output
+// @param use_colors false drops the $B / $E tags, used for sinks that are not a terminal
+// @return NULL if out of memory, free with free_format_program()
+format_program* compile_format(const char* format, const b8 use_colors, const log_output_format output);
+
+void free_format_program(format_program* program);
+
+// @brief Runs [program] for one message into [out] (always '\0' terminated)
+// @param st Local time of [timestamp_ns], only read if the program uses a time/date field
+// @param fields Payload of a LOG_KV record or NULL
+void render_message(const format_program* program, format_buffer* out, const log_site* site, const pthread_t thread_id, const char* label,
+    const u64 timestamp_ns, const system_time* st, const char* message, const u32 message_len, const u8* fields);
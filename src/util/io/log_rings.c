@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "log_rings.h"
+
+
+static inline u64 min_u64(const u64 a, const u64 b)     { return a < b ? a : b; }
+
+
+// ============================================================================================================================================
+// memory ring
+// ============================================================================================================================================
+
+// Keeps the most recent formatted messages of a LOG_SINK_MEMORY sink, the oldest messages are dropped when a new one does not fit.
+// Entries are a fixed header followed by the text (including '\0'), they never wrap around the end of [data].
+
+typedef struct {
+    u64                 sequence;
+    u64                 timestamp_ns;
+    pthread_t           thread_id;
+    u32                 site_id;
+    u32                 length;                     // strlen() of the text, MEMORY_ENTRY_PADDING marks filler at the end of the ring
+    u32                 label_id;                   // thread label (see get_thread_label_id)
+} memory_entry;
+
+#define MEMORY_ENTRY_PADDING                UINT32_MAX
+#define MEMORY_ENTRY_ALIGNMENT              32              // also guarantees room for the [length] of a padding header at the end of the ring
+
+STATIC_ASSERT(offsetof(memory_entry, length) + sizeof(u32) <= MEMORY_ENTRY_ALIGNMENT, "[memory_entry] padding marker needs to fit into the remaining space at the end of the ring");
+
+struct log_memory_ring {
+    u8*                 data;
+    u64                 capacity;                   // multiple of MEMORY_ENTRY_ALIGNMENT
+    u64                 head;                       // absolute positions, (position % capacity) is the offset inside [data]
+    u64                 tail;
+    u64                 first_sequence;             // sequence of the entry at [tail]
+    u64                 next_sequence;
+    pthread_mutex_t     mutex;
+};
+
+
+static inline u32 memory_entry_size(const u32 length)      { return (u32)(sizeof(memory_entry) + length + 1 + MEMORY_ENTRY_ALIGNMENT - 1) & ~(u32)(MEMORY_ENTRY_ALIGNMENT - 1); }
+
+
+log_memory_ring* memory_ring_create(u64 capacity) {
+
+    capacity &= ~(u64)(MEMORY_ENTRY_ALIGNMENT - 1);
+    if (capacity < 4 * MEMORY_ENTRY_ALIGNMENT)
+        return NULL;
+
+    log_memory_ring* ring = calloc(1, sizeof(log_memory_ring));
+    if (!ring)
+        return NULL;
+
+    ring->data = malloc(capacity);
+    if (!ring->data) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    ring->first_sequence = 1;                                   // 0 is used by callers as "from the beginning"
+    ring->next_sequence = 1;
+    pthread_mutex_init(&ring->mutex, NULL);
+    return ring;
+}
+
+
+void memory_ring_destroy(log_memory_ring* ring) {
+
+    pthread_mutex_destroy(&ring->mutex);
+    free(ring->data);
+    free(ring);
+}
+
+
+// Drops the oldest entry (or the padding at the end of the ring)
+// CAUTION: caller needs to hold [ring->mutex]
+static void memory_ring_pop_locked(log_memory_ring* ring) {
+
+    const u64 offset = ring->tail % ring->capacity;
+    const memory_entry* entry = (const memory_entry*)(ring->data + offset);
+    if (entry->length == MEMORY_ENTRY_PADDING) {
+        ring->tail += ring->capacity - offset;
+        return;
+    }
+
+    ring->tail += memory_entry_size(entry->length);
+    ring->first_sequence++;
+}
+
+
+void memory_ring_push(log_memory_ring* ring, const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns, const char* text, u32 length) {
+
+    const u32 max_size = (u32)(ring->capacity / 2) & ~(u32)(MEMORY_ENTRY_ALIGNMENT - 1);
+    if (memory_entry_size(length) > max_size)                   // keep at least two entries, longer messages are cut
+        length = max_size - (u32)sizeof(memory_entry) - 1;
+    const u32 size = memory_entry_size(length);
+
+    pthread_mutex_lock(&ring->mutex);
+
+    const u64 contiguous = ring->capacity - (ring->head % ring->capacity);
+    const u64 total = (size <= contiguous) ? size : contiguous + size;
+    while (ring->head + total - ring->tail > ring->capacity)
+        memory_ring_pop_locked(ring);
+
+    if (total != size) {                                        // fill the end of the ring and start the entry at offset 0
+        ((memory_entry*)(ring->data + (ring->head % ring->capacity)))->length = MEMORY_ENTRY_PADDING;
+        ring->head += contiguous;
+    }
+
+    memory_entry* entry = (memory_entry*)(ring->data + (ring->head % ring->capacity));
+    entry->sequence = ring->next_sequence++;
+    entry->timestamp_ns = timestamp_ns;
+    entry->thread_id = thread_id;
+    entry->site_id = site->id;
+    entry->length = length;
+    entry->label_id = label_id;
+    memcpy(entry + 1, text, length);
+    ((char*)(entry + 1))[length] = '\0';
+    ring->head += size;
+
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+
+// Calls [callback] for every entry with a sequence >= [first_sequence], oldest first. Returns the sequence of the next entry
+u64 memory_ring_read(log_memory_ring* ring, const u64 first_sequence, log_label_lookup get_label, log_sink_callback callback, void* user_data) {
+
+    pthread_mutex_lock(&ring->mutex);
+
+    u64 position = ring->tail;
+    while (position < ring->head) {
+        const u64 offset = position % ring->capacity;
+        const memory_entry* entry = (const memory_entry*)(ring->data + offset);
+        if (entry->length == MEMORY_ENTRY_PADDING) {
+            position += ring->capacity - offset;
+            continue;
+        }
+
+        if (entry->sequence >= first_sequence) {
+            const log_entry out = {
+                .site = logger_get_site(entry->site_id),
+                .thread_id = entry->thread_id,
+                .thread_label = get_label(entry->label_id),
+                .timestamp_ns = entry->timestamp_ns,
+                .sequence = entry->sequence,
+                .text = (const char*)(entry + 1),
+                .length = entry->length,
+            };
+            callback(&out, user_data);
+        }
+        position += memory_entry_size(entry->length);
+    }
+
+    const u64 next_sequence = ring->next_sequence;
+    pthread_mutex_unlock(&ring->mutex);
+    return next_sequence;
+}
+
+
+// ============================================================================================================================================
+// crash ring
+// ============================================================================================================================================
+
+// Keeps the most recent formatted messages of a LOG_SINK_CRASH_RING sink in a file mapped with MAP_SHARED. The kernel writes the
+// pages back to the file even if the process dies, so the tail of the log survives a crash without an fsync per line.
+// The text is a plain byte stream that wraps around the end of [data]. A clean shutdown marks the file as closed, otherwise
+// the next start copies the tail into the regular log (see crash_ring_recover).
+
+#define CRASH_RING_MAGIC        0x31474e4952485343ULL          // "CSHRING1"
+#define CRASH_RING_OPEN         1
+#define CRASH_RING_CLOSED       2
+
+typedef struct {
+    u64                 magic;
+    u64                 capacity;                   // bytes of text following the header
+    _Atomic u64         head;                       // absolute write position, (head % capacity) is the offset inside the text
+    _Atomic u32         state;                      // CRASH_RING_OPEN while a process writes to the file
+    u32                 reserved;
+} crash_ring_header;
+
+struct log_crash_ring {
+    int                 fd;
+    crash_ring_header*  header;                     // start of the mapping
+    char*               data;                       // text, directly after the header
+    u64                 mapping_size;
+};
+
+
+log_crash_ring* crash_ring_create(const char* path, u64 capacity) {
+
+    capacity = (capacity < 4096) ? 4096 : capacity;
+    log_crash_ring* ring = calloc(1, sizeof(log_crash_ring));
+    if (!ring)
+        return NULL;
+
+    ring->mapping_size = sizeof(crash_ring_header) + capacity;
+    ring->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (ring->fd < 0 || ftruncate(ring->fd, (off_t)ring->mapping_size) != 0) {
+        if (ring->fd >= 0)
+            close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, ring->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    ring->header = mapping;
+    ring->data = (char*)mapping + sizeof(crash_ring_header);
+    ring->header->magic = CRASH_RING_MAGIC;
+    ring->header->capacity = capacity;
+    atomic_init(&ring->header->head, 0);
+    atomic_init(&ring->header->state, CRASH_RING_OPEN);
+    return ring;
+}
+
+
+// Marks the file as cleanly closed, nothing is recovered from it on the next start
+void crash_ring_destroy(log_crash_ring* ring) {
+
+    atomic_store(&ring->header->state, CRASH_RING_CLOSED);
+    munmap(ring->header, ring->mapping_size);
+    close(ring->fd);
+    free(ring);
+}
+
+
+// Appends [length] bytes. Lock free (writers reserve their range with a fetch_add), so it can also be used by logger_on_crash()
+void crash_ring_write(log_crash_ring* ring, const char* text, u32 length) {
+
+    const u64 capacity = ring->header->capacity;
+    if (length > capacity) {                                    // only the end of the text fits
+        text += length - capacity;
+        length = (u32)capacity;
+    }
+
+    const u64 position = atomic_fetch_add_explicit(&ring->header->head, length, memory_order_relaxed);
+    const u64 offset = position % capacity;
+    const u64 first = min_u64(length, capacity - offset);
+    memcpy(ring->data + offset, text, first);
+    memcpy(ring->data, text + first, length - first);
+}
+
+
+// Returns the text a crashed run left in the file at [path] (malloc'ed, starting at a line boundary), NULL if the run was shut down cleanly
+char* crash_ring_recover(const char* path, u32* length) {
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    crash_ring_header header;
+    char* text = NULL;
+    if (fstat(fd, &st) == 0 && (u64)st.st_size > sizeof(header) && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+        && header.magic == CRASH_RING_MAGIC && header.capacity == (u64)st.st_size - sizeof(header) && header.capacity <= UINT32_MAX
+        && atomic_load(&header.state) == CRASH_RING_OPEN) {
+
+        const u64 head = atomic_load(&header.head);
+        const u64 size = (head < header.capacity) ? head : header.capacity;
+        text = malloc(size + 1);
+        if (text) {
+            const u64 offset = (head - size) % header.capacity;      // oldest byte still in the ring
+            const u64 first = min_u64(size, header.capacity - offset);
+            b8 success = pread(fd, text, first, (off_t)(sizeof(header) + offset)) == (ssize_t)first;
+            success &= pread(fd, text + first, size - first, (off_t)sizeof(header)) == (ssize_t)(size - first);
+
+            u64 start = 0;
+            if (head > header.capacity)                         // the oldest line was partially overwritten
+                while (start < size && text[start++] != '\n') {}
+
+            if (success && start < size) {
+                memmove(text, text + start, size - start);
+                *length = (u32)(size - start);
+                text[*length] = '\0';
+            } else {
+                free(text);
+                text = NULL;
+            }
+        }
+    }
+    close(fd);
+    return text;
+}
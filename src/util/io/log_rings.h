@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "logger.h"
+
+// In-memory outputs of the logger, internal to it: the memory ring behind LOG_SINK_MEMORY and the file mapped crash ring
+// behind LOG_SINK_CRASH_RING. Not to be confused with the staging rings that carry records to the logger thread.
+
+typedef struct log_memory_ring log_memory_ring;
+typedef struct log_crash_ring log_crash_ring;
+
+// Resolves the thread label ID stored with a memory ring entry, NULL if the thread has no label
+typedef const char* (*log_label_lookup)(const u32 label_id);
+
+
+// ============================================================================================================================================
+// memory ring
+// ============================================================================================================================================
+
+// @brief Creates a ring of [capacity] bytes (rounded down to the entry alignment)
+// @return NULL if out of memory or [capacity] is too small
+log_memory_ring* memory_ring_create(u64 capacity);
+
+void memory_ring_destroy(log_memory_ring* ring);
+
+// @brief Appends a formatted message, drops the oldest entries until it fits. Messages longer than half the ring are cut
+void memory_ring_push(log_memory_ring* ring, const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns, const char* text, u32 length);
+
+// @brief Calls [callback] for every entry with a sequence >= [first_sequence], oldest first
+// @return The sequence of the next entry
+u64 memory_ring_read(log_memory_ring* ring, const u64 first_sequence, log_label_lookup get_label, log_sink_callback callback, void* user_data);
+
+
+// ============================================================================================================================================
+// crash ring
+// ============================================================================================================================================
+
+// @brief Creates (truncates) the file at [path] and maps it, [capacity] bytes of text (at least 4 KiB)
+// @return NULL if the file could not be created or mapped
+log_crash_ring* crash_ring_create(const char* path, u64 capacity);
+
+// @brief Marks the file as cleanly closed, nothing is recovered from it on the next start
+void crash_ring_destroy(log_crash_ring* ring);
+
+// @brief Appends [length] bytes. Lock free, so it can also be used by logger_on_crash()
+void crash_ring_write(log_crash_ring* ring, const char* text, u32 length);
+
+// @brief Returns the text a crashed run left in the file at [path] (malloc'ed, starting at a line boundary), NULL if the run was shut down cleanly
+char* crash_ring_recover(const char* path, u32* length);
@@ -1,201 +1,188 @@
-
+#define _DEFAULT_SOURCE                                             // tm_gmtoff, syscall()
 #define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <errno.h> 
 #include <threads.h>
 #include <limits.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 // #include "util/data_structure/data_types.h"
-#include "util/data_structure/dynamic_string.h"
 #include "util/system.h"
+#include "util/data_structure/concurrent_map.h"
+#include "util/io/serializer_yaml.h"
 
 #include "logger.h"
+#include "log_format.h"
+#include "log_file_writer.h"
+#include "log_rings.h"
 
 
-#define USE_MULTI_THREADING     1
+#ifndef USE_MULTI_THREADING                 // can be set by the build, e.g. for logger_bench_st
+    #define USE_MULTI_THREADING     1
+#endif
 
 
 // ============================================================================================================================================
-// format helper
+// thread labels
 // ============================================================================================================================================
 
-inline static const char *short_filename(const char *path) {
+// Labels are interned: every distinct label string gets a small ID that stays valid until logger_shutdown(), so a record only
+// carries the ID and the logger thread resolves it with an array index. Removing a label only removes the thread -> ID mapping,
+// records still in flight keep pointing at a valid string.
+// The thread -> ID mapping is a concurrent_map, lookups never lock (also not in the crash path). Producers still cache the ID of
+// their own thread in a thread-local slot and only look it up again after [s_label_epoch] changed.
 
-    const char *s1 = strrchr(path, '/');
-    const char *s2 = strrchr(path, '\\');
-    const char *last = NULL;
+#define LOG_MAX_THREAD_LABELS   1024                    // distinct label strings, IDs of further labels are 0 (no label)
 
-    if (s1 && s2) 
-        last = (s1 > s2) ? s1 : s2;
-    else
-        last = s1 ? s1 : s2;
+static concurrent_map           s_thread_labels = {0};                      // thread -> label ID, created by the first registration
+static char*                    s_label_table[LOG_MAX_THREAD_LABELS];       // label ID -> label, entries are never changed once published
+static u32                      s_label_count = 1;                          // ID 0 means "no label"
+static _Atomic u32              s_label_epoch = 1;                          // bumped on every change of [s_thread_labels]
 
-    return last ? last + 1 : path;
-}
+static thread_local u32         t_label_id = 0;
+static thread_local u32         t_label_epoch = 0;
 
+static pthread_mutex_t          s_general_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static const char* c_severity_names[] =       { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR", "FATAL" };
+#if USE_MULTI_THREADING
+    static void staging_prepare_thread();
+#endif
 
 
-const char* log_level_to_string(log_type t) {
+// Returns the ID of [label], adds it to [s_label_table] if it is new
+// CAUTION: caller needs to hold [s_general_mutex]
+static u32 intern_label_locked(const char* label) {
 
-    if ((int)t < 0 || (size_t)t >= sizeof(c_severity_names) / sizeof(c_severity_names[0]))
-        return "UNK";
-    return c_severity_names[(int)t];
-}
+    for (u32 x = 1; x < s_label_count; x++)
+        if (strcmp(s_label_table[x], label) == 0)
+            return x;
 
+    if (s_label_count == LOG_MAX_THREAD_LABELS)
+        return 0;
 
-static const char* c_console_color_table[] = {
-    "\033[90m",                 // TRACE - gray
-    "\033[94m",                 // DEBUG - blue
-    "\033[92m",                 // INFO  - green
-    "\033[93m",                 // WARN  - yellow
-    "\033[91m",                 // ERROR - red
-    "\x1B[1m\x1B[37m\x1B[41m"   // FATAL - bold white on red
-};
+    char* copy = strdup(label);
+    if (!copy)
+        return 0;
 
-static const char*              c_console_rest = "\033[0m";
+    s_label_table[s_label_count] = copy;
+    return s_label_count++;
+}
 
-static const char*              c_default_format = "[$B$T $L] $E $P:$G $C$Z";
 
-static char*                    s_format_current = NULL;
+// Label ID registered for [thread_id], 0 if none. Lock free, also usable from a signal handler
+static inline u32 find_thread_label(const pthread_t thread_id) {
 
+    u64 label_id = 0;
+    return (c_map_find(&s_thread_labels, (u64)thread_id, &label_id) == AT_SUCCESS) ? (u32)label_id : 0;
+}
 
-// ============================================================================================================================================
-// thread label map (simple linked list)
-// ============================================================================================================================================
 
-typedef struct thread_label_node {
-    u64                         thread_id;
-    char*                       label;
-    struct thread_label_node*   next;
-} thread_label_node;
+// Label ID of [thread_id], stamped into every record. Free for the calling thread unless a label changed since its last message
+static u32 get_thread_label_id(const pthread_t thread_id) {
 
-static thread_label_node*       s_thread_labels = NULL;
+    const b8 own_thread = pthread_equal(thread_id, pthread_self());
+    const u32 epoch = atomic_load_explicit(&s_label_epoch, memory_order_acquire);
+    if (own_thread && t_label_epoch == epoch)
+        return t_label_id;
 
-static pthread_mutex_t          s_general_mutex = PTHREAD_MUTEX_INITIALIZER;
+    const u32 label_id = find_thread_label(thread_id);
+    if (own_thread) {
+        t_label_id = label_id;
+        t_label_epoch = epoch;                      // read before the lookup, a change during it makes the next call look again
+    }
+    return label_id;
+}
 
 
-void logger_register_thread_label(pthread_t thread_id, const char* label) {
+// Label of a [get_thread_label_id] result, NULL if the thread has none
+static inline const char* get_thread_label(const u32 label_id)   { return label_id ? s_label_table[label_id] : NULL; }
 
-    // TODO: only print this to the log file
-    // printf("registering thread [%ul] under [%s]\n", thread_id, label);
+
+// Frees the interned labels and the thread -> ID map, only when no record can reference them anymore
+static void free_thread_label_table() {
 
     pthread_mutex_lock(&s_general_mutex);
-    struct thread_label_node* current = s_thread_labels;
-    while (current) {
-        if (current->thread_id == thread_id) {
-            free(current->label);
-            current->label = strdup(label ? label : "");
-            pthread_mutex_unlock(&s_general_mutex);
-            return;
-        }
-        current = current->next;
+    for (u32 x = 1; x < s_label_count; x++) {
+        free(s_label_table[x]);
+        s_label_table[x] = NULL;
     }
-    // not found, append
-    struct thread_label_node* node = malloc(sizeof(*node));
-    node->thread_id = thread_id;
-    node->label = strdup(label ? label : "");
-    node->next = s_thread_labels;
-    s_thread_labels = node;
+    s_label_count = 1;
+    c_map_free(&s_thread_labels);
+    atomic_fetch_add(&s_label_epoch, 1);
     pthread_mutex_unlock(&s_general_mutex);
 }
 
 
-const char* lookup_thread_label(pthread_t thread_id) {
+void logger_register_thread_label(pthread_t thread_id, const char* label) {
 
-    struct thread_label_node* n = s_thread_labels;
-    while (n) {
-        if (n->thread_id == thread_id) {
+    // TODO: only print this to the log file
+    // printf("registering thread [%ul] under [%s]\n", thread_id, label);
 
-            pthread_mutex_unlock(&s_general_mutex);
-            return n->label;
-        }
-        n = n->next;
+    pthread_mutex_lock(&s_general_mutex);
+    if (atomic_load(&s_thread_labels.table) == NULL && c_map_init(&s_thread_labels, 16) != AT_SUCCESS) {
+        pthread_mutex_unlock(&s_general_mutex);
+        return;
     }
-    return NULL;
+    const u32 label_id = intern_label_locked(label ? label : "");
+    pthread_mutex_unlock(&s_general_mutex);
+
+    if (c_map_insert(&s_thread_labels, (u64)thread_id, label_id) != AT_SUCCESS)
+        return;
+    atomic_fetch_add(&s_label_epoch, 1);
+
+#if USE_MULTI_THREADING
+    if (pthread_equal(thread_id, pthread_self()))      // registered threads get their staging ring up front, not on their first LOG
+        staging_prepare_thread();
+#endif
 }
 
 
 void logger_remove_thread_label_by_id(pthread_t thread_id) {
-    
-    pthread_mutex_lock(&s_general_mutex);
-    thread_label_node *current = s_thread_labels;
-    thread_label_node *prev = NULL;
-    
-    while (current) {
-        if (current->thread_id == thread_id) {
-            // Found the node to remove
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                s_thread_labels = current->next;
-            }
-            
-            free(current->label);
-            free(current);
-            break;
-        }
-        
-        prev = current;
-        current = current->next;
-    }
-    
-    pthread_mutex_unlock(&s_general_mutex);
+
+    // the interned label stays valid for records in flight
+    if (c_map_erase(&s_thread_labels, (u64)thread_id) == AT_SUCCESS)
+        atomic_fetch_add(&s_label_epoch, 1);
 }
 
 
 void logger_remove_thread_label_by_label(const char* label) {
-    
+
     if (!label) return;
-    pthread_mutex_lock(&s_general_mutex);
-    
-    thread_label_node *current = s_thread_labels;
-    thread_label_node *prev = NULL;
-    
-    while (current) {
-        if (strcmp(current->label, label) == 0) {
-            // Found the node to remove
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                s_thread_labels = current->next;
-            }
-            
-            free(current->label);
-            free(current);
+
+    pthread_mutex_lock(&s_general_mutex);               // guards [s_label_table]
+    size_t iterator = 0;
+    u64 thread_id, label_id;
+    while (c_map_next(&s_thread_labels, &iterator, &thread_id, &label_id)) {
+        if (label_id && strcmp(s_label_table[label_id], label) == 0) {
+            // Found the thread to remove, the interned label stays valid for records in flight
+            c_map_erase(&s_thread_labels, thread_id);
+            atomic_fetch_add(&s_label_epoch, 1);
             break;
         }
-        
-        prev = current;
-        current = current->next;
     }
-    
     pthread_mutex_unlock(&s_general_mutex);
 }
 
 
 void logger_remove_all_thread_labels() {
-    
-    pthread_mutex_lock(&s_general_mutex);
-    thread_label_node *current = s_thread_labels;
-    while (current) {
-        thread_label_node *next = current->next;
-        free(current->label);
-        free(current);
-        current = next;
-    }
-    
-    s_thread_labels = NULL;
-    pthread_mutex_unlock(&s_general_mutex);
+
+    if (c_map_clear(&s_thread_labels) == AT_SUCCESS)
+        atomic_fetch_add(&s_label_epoch, 1);
 }
 
 
@@ -203,528 +190,1925 @@ void logger_remove_all_thread_labels() {
 // multi threading
 // ============================================================================================================================================
 
-#define STR_LEN 512                         // maximum string length (used for file/function name)
-#define MSG_LEN 32000                       // maximum log message length (should never be needed, but ...)
+#define INLINE_MSG_LEN 512                  // messages shorter than this are formatted once on the stack and copied into the ring
+
+// Every record is a fixed header followed by the message bytes (including '\0') or, for deferred records, the captured arguments.
+// Severity, file, function, line and format are part of the static [log_site] and only referenced by ID.
+typedef struct {
+
+    _Atomic u64     commit;                 // absolute ring position + 1 once the record is fully written, 0 while the producer is still writing
+    u32             size;                   // total size of the record inside the ring (header + payload, aligned to LOG_RECORD_ALIGNMENT)
+    u32             message_len;            // length of the message excluding '\0' (or of the argument payload if [deferred]), LOG_RECORD_PADDING marks filler at the end of the ring
+    u32             site_id;                // index into the [log_sites] section
+    u32             label_id;               // thread label (see get_thread_label_id)
+    b8              deferred;               // payload holds the raw arguments for the format of the site
+    pthread_t       thread_id;              // as provided by (u64)pthread_self()
+    u64             timestamp_ns;           // wall-clock time of the LOG call (see get_system_time_ns)
+} log_record;
+
+#define LOG_RECORD_PADDING                  UINT32_MAX
+
+#define LOG_RECORD_ALIGNMENT                64              // records start on their own cache line, also guarantees room for a padding header at the end of the ring
+
+STATIC_ASSERT(sizeof(log_record) <= LOG_RECORD_ALIGNMENT, "[log_record] header needs to fit into the remaining space at the end of the ring");
+
+static inline const char* log_record_message(const log_record* record)     { return (const char*)(record + 1); }
+
+
+// Overflow policy of the ring (see logger_set_overflow_policy), read by producers without locking
+static _Atomic u32              s_overflow_mode = LOGGER_OVERFLOW_DROP_BELOW_LEVEL;
+static _Atomic u32              s_overflow_min_level = LOG_TYPE_WARN;
+static _Atomic u64              s_high_water = 0;                   // bytes, set by logger_set_overflow_policy()
+
+static _Atomic u64              s_dropped[LOG_TYPE_FATAL + 1];      // per severity
+
+static _Atomic b8               s_crashed = false;                  // set by logger_on_crash(), messages are written directly from then on
+
 
 #if USE_MULTI_THREADING
 
+    static _Atomic u64 s_dropped_total;         // sum of [s_dropped], cheap check for new drops
+
     static pthread_t s_logger_thread;           // logger thread
-    
 
-    typedef struct {
-        
-        log_type    type;
-        pthread_t   thread_id;                  // as provided by (u64)pthread_self()
-        char        file_name[STR_LEN];         // as provided by __FILE__
-        char        function_name[STR_LEN];     // as provided by __FUNCTION__
-        int         line;                       // as provided by __LINE__
-        char        message[MSG_LEN];           // already formatted to contain the values of the variable at the time the user called LOG()
-    } log_msg;
-
-    // Circular buffer for log_msg
+    // Hand-off between the logger thread and logger_on_crash(): the logger thread stops at the next record or sink write once
+    // [s_crashed] is set, notes where it stopped and sets [s_crash_ack]. The crash path only touches the rings and file writers after that.
+    // [s_logger_record] is published before a record is processed, so a crash of the logger thread itself knows which record it was in
+    static _Atomic b8       s_crash_ack = false;
+    static const void*      s_logger_record = NULL;         // record the logger thread is processing, NULL between records
+    static u32              s_crash_stopped_sink = UINT32_MAX;  // first sink [s_logger_record] was not written to, UINT32_MAX = none left
+
+    #define LOG_RING_CAPACITY       (1 << 18)   // 256 KiB per thread, needs to be a power of two and much bigger than the largest record
+    #define LOG_MAX_STAGING_RINGS   256         // threads beyond this share the fallback ring
+
+
+    // Byte oriented ring buffer holding variable-length [log_record]s. Every logging thread owns one (single producer), only the
+    // fallback ring is shared by several producers, which is why [head] is still advanced with an (uncontended) CAS.
+    // Producers publish a record through its [commit] field, the consumer processes records in place and releases them by advancing [tail].
+    // [head] and [tail] are absolute positions that are never wrapped, (position & (capacity -1)) is the offset inside [data].
     typedef struct {
 
-        log_msg *items;                         // array of items
-        size_t capacity;                        // max number of items
-        size_t head;                            // index of oldest item
-        size_t tail;                            // index to write next item
-        size_t count;                           // current number of items
-        pthread_mutex_t mutex;
-        pthread_cond_t not_full;                // signal producers when space available
-        pthread_cond_t contains;                // signal logger that messages are ready for processing
-        int shutdown;                           // set to 1 to tell threads to quit
-    } log_msg_buffer;
+        u8*                     data;
+        u64                     capacity;
+        alignas(64) _Atomic u64 head;           // next position to reserve (producers)
+        alignas(64) _Atomic u64 tail;           // oldest position not yet released (consumer)
+        alignas(64) _Atomic u32 waiting_producers;
+        _Atomic b8              abandoned;      // owning thread exited, the consumer frees the ring once it is drained
+        pthread_mutex_t         mutex;          // only used to sleep while the ring is full
+        pthread_cond_t          not_full;       // signal producers when space available
+    } log_ring;
 
-    static log_msg_buffer   s_log_msg_buffer;
 
+    // Registry of all staging rings, drained by the logger thread. Slot 0 holds the fallback ring shared by threads
+    // that could not get their own. Slots are only written under [mutex], the consumer reads them without locking.
+    static struct {
 
-    // Initialize buffer
-    int buffer_init(log_msg_buffer* b, size_t capacity) {
-        
-        if (!b || capacity == 0)return EINVAL;
+        _Atomic(log_ring*)      rings[LOG_MAX_STAGING_RINGS];
+        _Atomic u32             ring_count;     // slots in use, including freed slots (NULL) that can be reused
+        _Atomic b8              active;         // logger thread is running, new threads may register
+        _Atomic b8              shutdown;       // set to true to tell threads to quit
+        _Atomic b8              consumer_sleeping;
+        _Atomic u32             generation;     // bumped by logger_shutdown(), invalidates the thread-local ring pointers
+        pthread_mutex_t         mutex;          // registration and sleeping of the consumer, never taken by a producer while the consumer is busy
+        pthread_cond_t          contains;       // signal logger that messages are ready for processing (CLOCK_MONOTONIC)
+        pthread_key_t           thread_exit_key;
+    } s_staging = { .mutex = PTHREAD_MUTEX_INITIALIZER };
 
-        b->items = calloc(capacity, sizeof(log_msg));
-        if (!b->items) return ENOMEM;
+    static pthread_once_t           s_staging_once = PTHREAD_ONCE_INIT;
 
-        b->capacity = capacity;
-        b->head = b->tail = b->count = 0;
-        b->shutdown = 0;
+    static thread_local log_ring*   t_staging_ring = NULL;
+    static thread_local u32         t_staging_generation = 0;
 
-        // try to init the pthread vars
-        if (pthread_mutex_init(&b->mutex, NULL) != 0) { 
-            free(b->items);
-            return -1;
+
+    // Create a ring of [capacity] bytes (power of two), NULL on failure
+    static log_ring* ring_create(const u64 capacity) {
+
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) return NULL;
+
+        log_ring* r = aligned_alloc(alignof(log_ring), sizeof(log_ring));
+        if (!r) return NULL;
+
+        r->data = calloc(capacity, 1);              // zeroed memory: a header reads as "not committed" until a producer publishes it
+        if (!r->data) {
+            free(r);
+            return NULL;
         }
-        
-        if (pthread_cond_init(&b->not_full, NULL) != 0) { 
-            pthread_mutex_destroy(&b->mutex); 
-            free(b->items); 
-            return -1;
+
+        r->capacity = capacity;
+        atomic_init(&r->head, 0);
+        atomic_init(&r->tail, 0);
+        atomic_init(&r->waiting_producers, 0);
+        atomic_init(&r->abandoned, false);
+
+        // try to init the pthread vars
+        if (pthread_mutex_init(&r->mutex, NULL) != 0) {
+            free(r->data);
+            free(r);
+            return NULL;
         }
 
-        if (pthread_cond_init(&b->contains, NULL) != 0) { 
-            pthread_cond_destroy(&b->not_full); 
-            pthread_mutex_destroy(&b->mutex); 
-            free(b->items); 
-            return -1;
+        if (pthread_cond_init(&r->not_full, NULL) != 0) {
+            pthread_mutex_destroy(&r->mutex);
+            free(r->data);
+            free(r);
+            return NULL;
         }
-        return 0;
+        return r;
     }
 
-    // Destroy buffer
-    void buffer_destroy(log_msg_buffer* b) {
-        
-        if (!b) return;
-        pthread_cond_destroy(&b->contains);
-        pthread_cond_destroy(&b->not_full);
-        pthread_mutex_destroy(&b->mutex);
-        free(b->items);
+    // Destroy ring
+    static void ring_destroy(log_ring* r) {
+
+        if (!r) return;
+        pthread_cond_destroy(&r->not_full);
+        pthread_mutex_destroy(&r->mutex);
+        free(r->data);
+        free(r);
+    }
+
+    // Wake the consumer if it went to sleep. The mutex makes sure the signal can not slip in between its last check and the wait.
+    static inline void staging_wake_consumer() {
+
+        if (!atomic_load(&s_staging.consumer_sleeping)) return;
+        pthread_mutex_lock(&s_staging.mutex);
+        pthread_cond_signal(&s_staging.contains);
+        pthread_mutex_unlock(&s_staging.mutex);
+    }
+
+    static inline void count_dropped_message(const log_type type) {
+
+        atomic_fetch_add_explicit(&s_dropped[type], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_dropped_total, 1, memory_order_relaxed);
     }
 
-    // Producer pushes an item; blocks if buffer is full. Returns 0 on success, -1 on shutdown.
-    int buffer_push(log_msg_buffer* b, const log_msg* item) {
+    // Bytes currently reserved (committed or not)
+    static inline u64 ring_used(log_ring* r) {
 
-        int err = 0;
-        pthread_mutex_lock(&b->mutex);
-        while (b->count == b->capacity && !b->shutdown) {
-            pthread_cond_wait(&b->not_full, &b->mutex); // wait until space
+        return atomic_load(&r->head) - atomic_load(&r->tail);
+    }
+
+    // Producer reserves [size] bytes for a message of severity [type]. If the ring is above the high-water mark or full, the overflow policy
+    // decides whether the producer waits or the message is dropped. Returns the header to fill in, or NULL if dropped / on shutdown.
+    // A record never wraps around the end of the ring, if the remaining space is too small it is filled with a padding record.
+    // [position] receives the absolute position of the record, needed for [ring_commit]
+    static log_record* ring_reserve(log_ring* r, u32 size, u64* position, const log_type type) {
+
+        size = (size + LOG_RECORD_ALIGNMENT - 1) & ~(u32)(LOG_RECORD_ALIGNMENT - 1);
+        const u64 mask = r->capacity - 1;
+        u64 pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        u64 total;
+        for (;;) {
+
+            if (atomic_load_explicit(&s_staging.shutdown, memory_order_relaxed))
+                return NULL;
+
+            const u64 contiguous = r->capacity - (pos & mask);
+            total = (size <= contiguous) ? size : contiguous + size;
+
+            const u64 used = pos + total - atomic_load(&r->tail);
+            if (used > atomic_load_explicit(&s_high_water, memory_order_relaxed)) {   // slow path, apply the overflow policy
+                const u32 mode = atomic_load_explicit(&s_overflow_mode, memory_order_relaxed);
+                const b8 full = (used > r->capacity);
+                if ((mode == LOGGER_OVERFLOW_DROP_BELOW_LEVEL && type < atomic_load_explicit(&s_overflow_min_level, memory_order_relaxed))
+                    || (full && (mode == LOGGER_OVERFLOW_DROP_NEWEST || mode == LOGGER_OVERFLOW_DROP_OLDEST))) {
+                    count_dropped_message(type);
+                    return NULL;
+                }
+            }
+
+            if (used > r->capacity) {           // full, wait until the consumer released enough space
+                atomic_fetch_add(&r->waiting_producers, 1);
+                pthread_mutex_lock(&r->mutex);
+                while (pos + total - atomic_load(&r->tail) > r->capacity && !atomic_load(&s_staging.shutdown))
+                    pthread_cond_wait(&r->not_full, &r->mutex);
+                pthread_mutex_unlock(&r->mutex);
+                atomic_fetch_sub(&r->waiting_producers, 1);
+                pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+                continue;
+            }
+
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + total, memory_order_acquire, memory_order_relaxed))
+                break;
         }
-        if (b->shutdown) {
-            err = -1;
-            goto out;
+
+        if (total != size) {                    // fill the end of the ring and start the record at offset 0
+            log_record* padding = (log_record*)(r->data + (pos & mask));
+            padding->size = (u32)(total - size);
+            padding->message_len = LOG_RECORD_PADDING;
+            atomic_store(&padding->commit, pos + 1);
+            pos += total - size;
         }
-        // copy item into buffer at tail
-        b->items[b->tail] = *item; // struct copy (safe because str is fixed-length array)
-        b->tail = (b->tail + 1) % b->capacity;
-        b->count++;
 
-        pthread_cond_signal(&b->contains);  // notify logger that a new message is present
-    out:
-        pthread_mutex_unlock(&b->mutex);
-        return err;
+        log_record* record = (log_record*)(r->data + (pos & mask));
+        record->size = size;
+        *position = pos;
+        return record;
     }
 
-    // Consumer pops an item; blocks if buffer is empty. Returns 0 on success, -1 on shutdown.
-    static int buffer_pop(log_msg_buffer* b, log_msg* out) {
+    // Producer publishes a record that was filled in after [ring_reserve]
+    static inline void ring_commit(log_record* record, const u64 position) {
 
-        int err = 0;
-        pthread_mutex_lock(&b->mutex);
-        while (b->count == 0 && !b->shutdown)
-            pthread_cond_wait(&b->contains, &b->mutex);     // wait until items available
-        
-        if (b->shutdown && b->count == 0) {
-            err = -1;
-            goto out;
-        }
-        // copy item from buffer at head
-        *out = b->items[b->head]; // struct copy
-        b->head = (b->head + 1) % b->capacity;
-        b->count--;
-        
-        pthread_cond_signal(&b->not_full); // notify producers that space is available
-    out:
-        pthread_mutex_unlock(&b->mutex);
-        return err;
+        atomic_store(&record->commit, position + 1);
+        staging_wake_consumer();
     }
 
+    // Consumer has nothing left to process (no record is reserved or committed)
+    static inline b8 ring_empty(log_ring* r) {
 
-    void process_log_message_v(const log_msg* message);
+        return atomic_load(&r->head) == atomic_load_explicit(&r->tail, memory_order_relaxed);
+    }
 
-#else
+    // Record at [tail] if it is committed (may be a padding record), NULL otherwise
+    static inline log_record* ring_front(log_ring* r) {
 
-    void process_log_message_v(log_type type, pthread_t thread_id, const char* file_name, const char* function_name, int line, const char* formatted_message);
+        const u64 tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        log_record* record = (log_record*)(r->data + (tail & (r->capacity - 1)));
+        return (atomic_load_explicit(&record->commit, memory_order_acquire) == tail + 1) ? record : NULL;
+    }
 
-#endif
+    // Consumer releases a record returned by [staging_next]. The bytes are zeroed so any header that lands here in the next lap reads as "not committed".
+    static void ring_release(log_ring* r, log_record* record) {
 
+        const u32 size = record->size;
+        memset(record, 0, size);
+        atomic_store(&r->tail, atomic_load_explicit(&r->tail, memory_order_relaxed) + size);
 
-// ============================================================================================================================================
-// data
-// ============================================================================================================================================
+        if (atomic_load(&r->waiting_producers) > 0) {          // notify producers that space is available
+            pthread_mutex_lock(&r->mutex);
+            pthread_cond_broadcast(&r->not_full);
+            pthread_mutex_unlock(&r->mutex);
+        }
+    }
 
-static b8                       s_log_to_console = false;
 
-static char*                    s_log_file_path = NULL;
+    // pthread key destructor, runs when a thread that owns a staging ring exits
+    static void staging_thread_exit(void* ring) {
 
-#define FILE_BUFFER_SIZE        64000
+        pthread_mutex_lock(&s_staging.mutex);
+        if (ring == t_staging_ring && t_staging_generation == atomic_load(&s_staging.generation))   // otherwise the ring was already freed by logger_shutdown()
+            atomic_store(&((log_ring*)ring)->abandoned, true);
+        pthread_mutex_unlock(&s_staging.mutex);
+    }
 
-static char                     s_file_buffer[FILE_BUFFER_SIZE] = {0};          // buffer fully formatted messages here before writing to file
+    static void staging_create_key() { pthread_key_create(&s_staging.thread_exit_key, staging_thread_exit); }
 
-static pthread_mutex_t          s_file_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+    // Creates the registry and the fallback ring, called by logger_init() before the logger thread starts
+    static b8 staging_init() {
 
+        pthread_once(&s_staging_once, staging_create_key);
 
-// ============================================================================================================================================
-// private functions
-// ============================================================================================================================================
+        log_ring* fallback = ring_create(LOG_RING_CAPACITY);
+        if (!fallback)
+            return false;
 
-// CAUTION: !!! need to manually manage the mutex [s_file_buffer_mutex] !!!
-// normal one would add the mutex protection in the function, but this function is only used in two location and both have spatial circumstances
-bool flush_log_msg_buffer(const char* log_msg) {
-    
-    if (s_log_file_path == NULL)
-        return false;
+        pthread_condattr_t contains_attr;                   // [contains] is waited on with a CLOCK_MONOTONIC deadline
+        pthread_condattr_init(&contains_attr);
+        pthread_condattr_setclock(&contains_attr, CLOCK_MONOTONIC);
+        const int result = pthread_cond_init(&s_staging.contains, &contains_attr);
+        pthread_condattr_destroy(&contains_attr);
+        if (result != 0) {
+            ring_destroy(fallback);
+            return false;
+        }
 
+        pthread_mutex_lock(&s_staging.mutex);
+        atomic_store(&s_staging.rings[0], fallback);
+        atomic_store(&s_staging.ring_count, 1);
+        atomic_store(&s_staging.shutdown, false);
+        atomic_store(&s_staging.consumer_sleeping, false);
+        atomic_store(&s_staging.active, true);
+        pthread_mutex_unlock(&s_staging.mutex);
+        return true;
+    }
 
-    FILE* fp = fopen(s_log_file_path, "a");
-    if (fp == NULL)
-        BREAK_POINT();          // logger failed to create log file
+    // Tells producers and the consumer to quit, the logger thread drains every ring before it exits
+    static void staging_request_shutdown() {
+
+        pthread_mutex_lock(&s_staging.mutex);
+        atomic_store(&s_staging.active, false);
+        atomic_store(&s_staging.shutdown, true);
+        pthread_cond_broadcast(&s_staging.contains);
+
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            log_ring* r = atomic_load(&s_staging.rings[x]);
+            if (!r) continue;
+            pthread_mutex_lock(&r->mutex);
+            pthread_cond_broadcast(&r->not_full);
+            pthread_mutex_unlock(&r->mutex);
+        }
+        pthread_mutex_unlock(&s_staging.mutex);
+    }
 
-    // TODO: dump content of buffer
-    fprintf(fp, "%s", s_file_buffer);
-    memset(s_file_buffer, '\0', sizeof(s_file_buffer));
+    // Frees every ring after the logger thread exited. Threads that still hold a ring pointer notice the new generation and register again
+    static void staging_destroy() {
 
-    if (log_msg)                            // log provided message if exist
-        fprintf(fp, "%s", log_msg);
+        pthread_mutex_lock(&s_staging.mutex);
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            ring_destroy(atomic_load(&s_staging.rings[x]));
+            atomic_store(&s_staging.rings[x], NULL);
+        }
+        atomic_store(&s_staging.ring_count, 0);
+        atomic_fetch_add(&s_staging.generation, 1);
+        pthread_mutex_unlock(&s_staging.mutex);
+        pthread_cond_destroy(&s_staging.contains);
+    }
 
-    fclose(fp);
-    return true;
-}
+    // Slow path of [staging_ring_of_thread], creates the ring of the calling thread or falls back to the shared ring
+    static log_ring* staging_register_thread() {
 
+        log_ring* ring = ring_create(LOG_RING_CAPACITY);
 
-#if USE_MULTI_THREADING           // give message to buffer and let logger-thread perform processing
+        pthread_mutex_lock(&s_staging.mutex);
+        if (!atomic_load(&s_staging.active)) {              // shut down in the meantime
+            pthread_mutex_unlock(&s_staging.mutex);
+            ring_destroy(ring);
+            return NULL;
+        }
 
-    // thread function that waits for messages in the s_lg_msg_buffer and then processes them using the multithread version of [process_log_message_v]
-    static void* logger_thread_func(void* arg) {
-        (void)arg;
-        
-        while (1) {
-            log_msg msg;
-            if (buffer_pop(&s_log_msg_buffer, &msg) == -1) {
-                break; // shutdown requested
-            }
-            
-            // Process the message
-            process_log_message_v(&msg);
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        u32 slot = 1;
+        while (slot < ring_count && atomic_load(&s_staging.rings[slot]))
+            slot++;
+
+        if (ring && slot < LOG_MAX_STAGING_RINGS) {
+            atomic_store(&s_staging.rings[slot], ring);
+            if (slot == ring_count)
+                atomic_store(&s_staging.ring_count, ring_count + 1);
+            pthread_setspecific(s_staging.thread_exit_key, ring);
+        } else {                                            // out of memory or slots
+            ring_destroy(ring);
+            ring = atomic_load(&s_staging.rings[0]);
+            pthread_setspecific(s_staging.thread_exit_key, NULL);
         }
-        
-        return NULL;
+
+        t_staging_ring = ring;
+        t_staging_generation = atomic_load(&s_staging.generation);
+        pthread_mutex_unlock(&s_staging.mutex);
+        return ring;
     }
 
-#endif
+    // Staging ring of the calling thread, created on first use. NULL if the logger is not running
+    static inline log_ring* staging_ring_of_thread() {
 
+        if (t_staging_ring && t_staging_generation == atomic_load_explicit(&s_staging.generation, memory_order_relaxed))
+            return t_staging_ring;
 
-// ============================================================================================================================================
-// LOGGER
-// ============================================================================================================================================
+        if (!atomic_load(&s_staging.active))
+            return NULL;
 
+        return staging_register_thread();
+    }
 
-b8 logger_init(const char* log_msg_format, const b8 log_to_console, const char* log_dir, const char* log_file_name, const b8 use_append_mode) {
+    // Creates the staging ring of the calling thread now, instead of on its first LOG
+    static void staging_prepare_thread()                { staging_ring_of_thread(); }
 
-    s_log_to_console = log_to_console;
-    logger_set_format(log_msg_format);
+    // Consumer picks the committed record with the oldest timestamp from the front of all rings, NULL if there is none.
+    // Padding records are released on the way and drained rings of exited threads are freed.
+    static log_record* staging_next(log_ring** ring) {
 
-    char exec_path[PATH_MAX] = {0};
-    if (get_executable_path(exec_path, sizeof(exec_path))) return false;
+        log_record* next = NULL;
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
 
-    char file_path[PATH_MAX];
-    memset(file_path, '\0', sizeof(file_path));
-    snprintf(file_path, sizeof(file_path), "%s/%s", exec_path, log_dir);
-    // printf("log path: %s\n", file_path);
+            log_ring* r = atomic_load_explicit(&s_staging.rings[x], memory_order_acquire);
+            if (!r) continue;
 
-    if (mkdir(file_path, 0777) && errno != EEXIST)
-        BREAK_POINT();
+            log_record* record;
+            while ((record = ring_front(r)) && record->message_len == LOG_RECORD_PADDING)
+                ring_release(r, record);
 
-    memset(file_path, '\0', sizeof(file_path));
-    snprintf(file_path, sizeof(file_path), "%s/%s/%s.log", exec_path, log_dir, log_file_name);
-    s_log_file_path = strdup(file_path);
-    ASSERT_SS(s_log_file_path)
+            if (!record) {
+                if (atomic_load(&r->abandoned) && ring_empty(r)) {      // the owner is gone and will never write again
+                    pthread_mutex_lock(&s_staging.mutex);
+                    atomic_store(&s_staging.rings[x], NULL);
+                    pthread_mutex_unlock(&s_staging.mutex);
+                    ring_destroy(r);
+                }
+                continue;
+            }
+
+            if (!next || record->timestamp_ns < next->timestamp_ns) {
+                next = record;
+                *ring = r;
+            }
+        }
+        return next;
+    }
 
-    system_time st = get_system_time();
-    FILE* fp = fopen(s_log_file_path, (use_append_mode) ? "a" : "w");
-    ASSERT_SS(fp)
+    // Any ring holds a committed record (caller holds [s_staging.mutex])
+    static b8 staging_has_record() {
 
-    fprintf(fp, "=====================================================================================================\n");
-    fprintf(fp, "Log initalized at [%04d/%02d/%02d %02d:%02d:%02d] with format: %s\n", st.year, st.month, st.day, st.hour, st.minute, st.second, s_format_current);
-    fprintf(fp, "-----------------------------------------------------------------------------------------------------\n");
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            log_ring* r = atomic_load(&s_staging.rings[x]);
+            if (r && ring_front(r))
+                return true;
+        }
+        return false;
+    }
 
-    fclose(fp);
+    // Consumer is done once shutdown was requested and every ring is drained
+    static b8 staging_finished() {
 
-#if USE_MULTI_THREADING
+        if (!atomic_load(&s_staging.shutdown))
+            return false;
 
-    ASSERT_SS(!buffer_init(&s_log_msg_buffer, 32));          // use 32 for now
-    ASSERT_SS(pthread_create(&s_logger_thread, NULL, logger_thread_func, NULL) == 0);
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            log_ring* r = atomic_load(&s_staging.rings[x]);
+            if (r && !ring_empty(r))
+                return false;
+        }
+        return true;
+    }
+
+    // Consumer sleeps until a record is committed to any ring, shutdown is requested or [deadline_ns] (CLOCK_MONOTONIC, 0 = no deadline) passed
+    static void staging_wait(const u64 deadline_ns) {
+
+        const struct timespec deadline = { .tv_sec = (time_t)(deadline_ns / 1000000000ULL), .tv_nsec = (long)(deadline_ns % 1000000000ULL) };
+        b8 timed_out = false;
+        atomic_store(&s_staging.consumer_sleeping, true);
+        pthread_mutex_lock(&s_staging.mutex);
+        while (!staging_has_record() && !atomic_load(&s_staging.shutdown) && !atomic_load(&s_crashed) && !timed_out) {      // wait until items available
+            if (deadline_ns)
+                timed_out = (pthread_cond_timedwait(&s_staging.contains, &s_staging.mutex, &deadline) == ETIMEDOUT);
+            else
+                pthread_cond_wait(&s_staging.contains, &s_staging.mutex);
+        }
+        pthread_mutex_unlock(&s_staging.mutex);
+        atomic_store(&s_staging.consumer_sleeping, false);
+    }
 
 #endif
 
-    return true;
-}
+void process_log_message_v(const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns, const char* message, const u8* fields);
+static void crash_log_va(const log_site* site, const pthread_t thread_id, const u64 timestamp_ns, const char* format, va_list ap);
 
 
-void logger_shutdown() {
+// ============================================================================================================================================
+// log sites
+// ============================================================================================================================================
 
-#if USE_MULTI_THREADING
-    /* Signal shutdown to all waiters (consumers & producers) */
-    pthread_mutex_lock(&s_log_msg_buffer.mutex);
-    s_log_msg_buffer.shutdown = 1;
-    pthread_cond_broadcast(&s_log_msg_buffer.contains);
-    pthread_cond_broadcast(&s_log_msg_buffer.not_full);
-    pthread_mutex_unlock(&s_log_msg_buffer.mutex);
+// Begin and end of the [log_sites] section, provided by the linker. Weak so a program without any call site still links
+extern log_site* const __start_log_sites[] __attribute__((weak));
+extern log_site* const __stop_log_sites[] __attribute__((weak));
 
-    /* Don't try to join ourselves (would deadlock). If thread wasn't created, skip. */
-    if (!pthread_equal(pthread_self(), s_logger_thread)) {
-        pthread_join(s_logger_thread, NULL);
-    }
 
-    buffer_destroy(&s_log_msg_buffer);
-    logger_remove_all_thread_labels();
-#endif
+u32 logger_get_site_count() {
+
+    return (u32)(__stop_log_sites - __start_log_sites);
+}
+
 
+const log_site* logger_get_site(const u32 id) {
 
-    system_time st = get_system_time();
-    dyn_str out;
-    ds_init(&out);
+    return (id < logger_get_site_count()) ? __start_log_sites[id] : NULL;
+}
 
-    ds_append_str(&out, "-----------------------------------------------------------------------------------------------------\n");
-    ds_append_fmt(&out, NULL, "Closing Log at [%04d/%02d/%02d %02d:%02d:%02d]\n", st.year, st.month, st.day, st.hour, st.minute, st.second);
-    ds_append_str(&out, "=====================================================================================================\n");
 
-    // mutex management not needed as the only other thread working on the same buffer joint just befor
-    ASSERT_SS(flush_log_msg_buffer(out.data))
+// Assigns IDs and precomputes the per-site data used when processing records
+static void init_log_sites() {
 
-    ds_free(&out);
+    const u32 site_count = logger_get_site_count();
+    for (u32 x = 0; x < site_count; x++) {
 
-    // Free allocated resources
-    free(s_log_file_path);
-    free(s_format_current);
-    s_log_file_path = NULL;
-    s_format_current = NULL;
+        log_site* site = __start_log_sites[x];
+        site->id = x;
+        site->short_file_name = short_filename(site->file_name);
+        if (!site->parsed_format && (USE_MULTI_THREADING || site->field_names))
+            site->parsed_format = parse_site_format(site);
+    }
 }
 
 
-void logger_set_format(const char* new_format) {
+static void free_log_sites() {
 
-    pthread_mutex_lock(&s_general_mutex);
-    free(s_format_current);
-    if (new_format)
-        s_format_current = strdup(new_format);
-    else
-        s_format_current = strdup(c_default_format);
-        
-    ASSERT(s_format_current, "", "something went wrong when duplicating the string")
-    pthread_mutex_unlock(&s_general_mutex);
+    const u32 site_count = logger_get_site_count();
+    for (u32 x = 0; x < site_count; x++) {
+
+        log_site* site = __start_log_sites[x];
+        free((void*)site->parsed_format);
+        site->parsed_format = NULL;
+    }
 }
 
 
 // ============================================================================================================================================
-// message formatter
+// runtime filter
 // ============================================================================================================================================
 
-#if USE_MULTI_THREADING           // give message to buffer and let logger-thread perform processing
+// The [enabled] flag of every site caches the result of the filter, so a filtered LOG costs one relaxed load at the call site.
+// Changing the level or a module override recomputes the flags of all sites, which is rare and never on a hot path.
 
-    // for multithreading that uses a [log_msg] as param
-    void process_log_message_v(const log_msg* message) {
-        
-        if (strlen(message->message) == 0)      // skip empty messages
-            return;
+#define LOG_MAX_MODULE_LEVELS   64
 
-        system_time st = get_system_time();
-
-        // build formatted output according to s_format_current
-        pthread_mutex_lock(&s_general_mutex);
-        const char* fmt = s_format_current ? s_format_current : c_default_format;
-
-        dyn_str out;
-        ds_init(&out);
-
-        size_t fmt_len = strlen(fmt);
-        for (size_t i = 0; i < fmt_len; ++i) {
-            char c = fmt[i];
-            if (c == '$') {
-                if (i + 1 >= fmt_len) break;
-                char cmd = fmt[++i];
-                switch (cmd) {
-                    case 'B': ds_append_str(&out, c_console_color_table[(int)message->type]); break;                    // color begin
-                    case 'E': ds_append_str(&out, c_console_rest); break;                                               // color end
-                    case 'C': ds_append_str(&out, message->message); break;                                             // message content
-                    case 'L': ds_append_str(&out, log_level_to_string(message->type)); break;                           // severity
-                    case 'Z': ds_append_char(&out, '\n'); break;                                                        // newline
-                    case 'Q': {                                                                                         // thread id or label
-                        const char* label = lookup_thread_label(message->thread_id);
-                        if (label)  ds_append_str(&out, label);
-                        else        ds_append_fmt(&out, NULL, TYPE_FORMAT(message->thread_id), message->thread_id);
-                    } break;
-                    case 'F': ds_append_str(&out, message->function_name); break;                                       // function
-                    case 'A': ds_append_str(&out, message->file_name); break;                                           // file
-                    case 'I': ds_append_str(&out, short_filename(message->file_name)); break;                           // short file
-                    case 'G': ds_append_fmt(&out, NULL, "%d", message->line); break;                                    // line
-                    
-                    case 'T': ds_append_fmt(&out, NULL, "%02d:%02d:%02d", st.hour, st.minute, st.second); break;        // time component
-                    case 'H': ds_append_fmt(&out, NULL, "%02d", st.hour); break;                                        // time component
-                    case 'M': ds_append_fmt(&out, NULL, "%02d", st.minute); break;                                      // time component
-                    case 'S': ds_append_fmt(&out, NULL, "%02d", st.second); break;                                      // time component
-                    case 'J': ds_append_fmt(&out, NULL, "%03d", st.millisec); break;                                    // time component
-
-                    case 'N': ds_append_fmt(&out, NULL, "%04d/%02d/%02d", st.year, st.month, st.day); break;            // date component
-                    case 'Y': ds_append_fmt(&out, NULL, "%04d", st.year); break;                                        // date component
-                    case 'O': ds_append_fmt(&out, NULL, "%02d", st.month); break;                                       // date component
-                    case 'D': ds_append_fmt(&out, NULL, "%02d", st.day); break;                                         // date component
-
-                    default:                                                                                            // unknown %% - treat literally (append '$' and the char)
-                        ds_append_char(&out, '$');
-                        ds_append_char(&out, cmd);
-                        break;
-                }
-            } else {
-                ds_append_char(&out, c);
-            }
-        }
+typedef struct {
+    char*                       module;             // matched against the file path of a site
+    size_t                      length;
+    log_type                    level;
+} module_level;
 
-        // ensure final message ends with newline
-        if (out.len == 0 || out.data[out.len - 1] != '\n') ds_append_char(&out, '\n');
+static module_level             s_module_levels[LOG_MAX_MODULE_LEVELS];
+static u32                      s_module_level_count = 0;
+static log_type                 s_log_level = LOG_TYPE_TRACE;
+static pthread_mutex_t          s_filter_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
-        // route to stdout or stderr depending on severity
-        if (s_log_to_console) {
-            if ((int)message->type < LOG_TYPE_WARN) {
-                fputs(out.data, stdout);
-                fflush(stdout);
-            } else {
-                fputs(out.data, stderr);
-                fflush(stderr);
-            }
+// Level that applies to [site], the longest matching module wins
+// CAUTION: caller needs to hold [s_filter_mutex]
+static log_type site_level_locked(const log_site* site) {
+
+    log_type level = s_log_level;
+    size_t best_length = 0;
+    for (u32 x = 0; x < s_module_level_count; x++) {
+        const module_level* entry = &s_module_levels[x];
+        if (entry->length > best_length && strstr(site->file_name, entry->module)) {
+            level = entry->level;
+            best_length = entry->length;
         }
+    }
+    return level;
+}
 
 
-        const size_t msg_length = strlen(out.data);
-        
-        pthread_mutex_lock(&s_file_buffer_mutex);       // use mutex outside here because of strlen()
-        const size_t remaining_buffer_size = sizeof(s_file_buffer) - strlen(s_file_buffer) -1;
-        if (remaining_buffer_size > msg_length)
-            strcat(s_file_buffer, out.data);              // save because ensured size
-        else
-            flush_log_msg_buffer(out.data);      // flush all buffered messages and current message
-        pthread_mutex_unlock(&s_file_buffer_mutex);
+// CAUTION: caller needs to hold [s_filter_mutex]
+static inline void update_site_locked(log_site* site) {
 
+    atomic_store_explicit(&site->enabled, !site->disabled && site->type >= site_level_locked(site), memory_order_relaxed);
+}
 
-        ds_free(&out);
-        pthread_mutex_unlock(&s_general_mutex);
-    }
 
-#else
+// CAUTION: caller needs to hold [s_filter_mutex]
+static void update_all_sites_locked() {
 
-    // ----------------- main formatter - expects the message text to be already formatted -----------------
-    void process_log_message_v(log_type type, pthread_t thread_id, const char* file_name, const char* function_name, int line, const char* formatted_message) {
-        
-        if (!formatted_message)
-            formatted_message = "";
-
-        system_time st = get_system_time();
-
-        // build formatted output according to s_format_current
-        pthread_mutex_lock(&s_general_mutex);
-        const char* fmt = s_format_current ? s_format_current : c_default_format;
-
-        dyn_str out;
-        ds_init(&out);
-
-        size_t fmt_len = strlen(fmt);
-        for (size_t i = 0; i < fmt_len; ++i) {
-            char c = fmt[i];
-            if (c == '$') {
-                if (i + 1 >= fmt_len) break;
-                char cmd = fmt[++i];
-                switch (cmd) {
-                    case 'B': ds_append_str(&out, c_console_color_table[(int)type]); break;                           // color begin
-                    case 'E': ds_append_str(&out, c_console_rest); break;                                             // color end
-                    case 'C': ds_append_str(&out, formatted_message); break;                                        // message content
-                    case 'L': ds_append_str(&out, log_level_to_string(type)); break;                                // severity
-                    case 'Z': ds_append_char(&out, '\n'); break;                                                    // newline
-                    case 'Q': {                                                                                     // thread id or label
-                        const char* label = lookup_thread_label(thread_id);
-                        if (label)  ds_append_str(&out, label);
-                        else        ds_append_fmt(&out, "%lu", thread_id);
-                    } break;
-                    case 'F': ds_append_str(&out, function_name ? function_name : ""); break;                       // function
-                    case 'P': ds_append_str(&out, function_name); break;                                            // short function
-                    case 'A': ds_append_str(&out, file_name ? file_name : ""); break;                               // file
-                    case 'I': ds_append_str(&out, short_filename(file_name ? file_name : "")); break;               // short file
-                    case 'G': ds_append_fmt(&out, "%d", line); break;                                               // line
-                    
-                    case 'T': ds_append_fmt(&out, "%02d:%02d:%02d", st.hour, st.minute, st.second); break;          // time component
-                    case 'H': ds_append_fmt(&out, "%02d", st.hour); break;                                          // time component
-                    case 'M': ds_append_fmt(&out, "%02d", st.minute); break;                                        // time component
-                    case 'S': ds_append_fmt(&out, "%02d", st.second); break;                                        // time component
-                    case 'J': ds_append_fmt(&out, "%03d", st.millisec); break;                                      // time component
-
-                    case 'N': ds_append_fmt(&out, "%04d/%02d/%02d", st.year, st.month, st.day); break;              // date component
-                    case 'Y': ds_append_fmt(&out, "%04d", st.year); break;                                          // date component
-                    case 'O': ds_append_fmt(&out, "%02d", st.month); break;                                         // date component
-                    case 'D': ds_append_fmt(&out, "%02d", st.day); break;                                           // date component
-
-                    default:                                                                                        // unknown %% - treat literally (append '$' and the char)
-                        ds_append_char(&out, '$');
-                        ds_append_char(&out, cmd);
-                        break;
-                }
-            } else {
-                ds_append_char(&out, c);
-            }
-        }
+    const u32 site_count = logger_get_site_count();
+    for (u32 x = 0; x < site_count; x++)
+        update_site_locked(__start_log_sites[x]);
+}
 
-        // ensure final message ends with newline
-        if (out.len == 0 || out.data[out.len - 1] != '\n') ds_append_char(&out, '\n');
 
+// CAUTION: caller needs to hold [s_filter_mutex]
+static void clear_module_levels_locked() {
 
-        // route to stdout or stderr depending on severity
-        if (s_log_to_console) {
-            if ((int)type < LOG_TYPE_WARN) {
-                fputs(out.data, stdout);
-                fflush(stdout);
-            } else {
-                fputs(out.data, stderr);
-                fflush(stderr);
-            }
-        }
+    for (u32 x = 0; x < s_module_level_count; x++)
+        free(s_module_levels[x].module);
+    s_module_level_count = 0;
+}
 
 
-        const size_t msg_length = strlen(out.data);
-        const size_t remaining_buffer_size = sizeof(s_file_buffer) - strlen(s_file_buffer) -1;
-        if (remaining_buffer_size > msg_length)
-            strcat(s_file_buffer, out.data);              // save because ensured size
-        else
-            flush_log_msg_buffer(out.data);      // flush all buffered messages and current message
+// Accepts a level name ("trace" ... "fatal", case insensitive) or its number
+static b8 parse_log_level(const char* text, const size_t length, log_type* level) {
 
+    static const char* names[] = { "trace", "debug", "info", "warn", "error", "fatal" };
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++) {
+        if (length == strlen(names[x]) && strncasecmp(text, names[x], length) == 0) {
+            *level = (log_type)x;
+            return true;
+        }
+    }
 
-        ds_free(&out);
-        pthread_mutex_unlock(&s_general_mutex);
+    if (length == 1 && text[0] >= '0' && text[0] <= '0' + LOG_TYPE_FATAL) {
+        *level = (log_type)(text[0] - '0');
+        return true;
     }
+    return false;
+}
 
-#endif
 
+i32 logger_set_site_enabled(const u32 id, const b8 enabled) {
 
-void log_message(log_type type, pthread_t thread_id, const char* file_name, const char* function_name, const int line, const char* message, ...) {
+    if (id >= logger_get_site_count())
+        return AT_INVALID_ARGUMENT;
 
-    if (strlen(message) == 0)
-        return;                                             // skip all empty log messages
-    
-    // use fixed size stack buffer (this forces a max log message length, but much faster than dynamic heap allocation)
-    char loc_message[MSG_LEN];
-    memset(&loc_message, 0, sizeof(loc_message));
+    pthread_mutex_lock(&s_filter_mutex);
+    log_site* site = __start_log_sites[id];
+    site->disabled = !enabled;
+    update_site_locked(site);
+    pthread_mutex_unlock(&s_filter_mutex);
+    return AT_SUCCESS;
+}
 
-    // Format the user message first (variable args)
-    va_list ap;
-    va_start(ap, message);
-    vsnprintf(loc_message, sizeof(loc_message), message, ap);
-    va_end(ap);
 
-#if USE_MULTI_THREADING                                     // give message to buffer and let logger-thread perform processing
+void logger_set_level(const log_type level) {
+
+    pthread_mutex_lock(&s_filter_mutex);
+    s_log_level = (level > LOG_TYPE_FATAL) ? LOG_TYPE_FATAL : level;
+    update_all_sites_locked();
+    pthread_mutex_unlock(&s_filter_mutex);
+}
 
-    log_msg current_msg;
-    memset(&current_msg, 0, sizeof(current_msg));           // Initialize to zero
 
-    current_msg.type = type;
-    current_msg.thread_id = thread_id;
-    current_msg.line = line;
-    // Use strncpy to prevent buffer overflows
-    strncpy(current_msg.file_name, file_name, sizeof(current_msg.file_name) - 1);
-    strncpy(current_msg.function_name, function_name, sizeof(current_msg.function_name) - 1);
-    strncpy(current_msg.message, loc_message, sizeof(current_msg.message) - 1);
+log_type logger_get_level() {
 
-    buffer_push(&s_log_msg_buffer, &current_msg);
+    pthread_mutex_lock(&s_filter_mutex);
+    const log_type level = s_log_level;
+    pthread_mutex_unlock(&s_filter_mutex);
+    return level;
+}
 
-#else                                                       // direct processing in calling thread
 
-    process_log_message_v(type, thread_id, file_name, function_name, line, loc_message);        // call the formatter that understands s_format_current
+i32 logger_set_module_level(const char* module, const log_type level) {
 
-#endif
+    if (!module || module[0] == '\0' || level > LOG_TYPE_FATAL)
+        return AT_INVALID_ARGUMENT;
 
+    pthread_mutex_lock(&s_filter_mutex);
+    u32 index = 0;
+    while (index < s_module_level_count && strcmp(s_module_levels[index].module, module) != 0)
+        index++;
+
+    if (index == s_module_level_count) {        // new module
+        char* copy = (index < LOG_MAX_MODULE_LEVELS) ? strdup(module) : NULL;
+        if (!copy) {
+            pthread_mutex_unlock(&s_filter_mutex);
+            return (index < LOG_MAX_MODULE_LEVELS) ? AT_MEMORY_ERROR : AT_RANGE_ERROR;
+        }
+        s_module_levels[index].module = copy;
+        s_module_levels[index].length = strlen(copy);
+        s_module_level_count++;
+    }
+
+    s_module_levels[index].level = level;
+    update_all_sites_locked();
+    pthread_mutex_unlock(&s_filter_mutex);
+    return AT_SUCCESS;
+}
+
+
+i32 logger_remove_module_level(const char* module) {
+
+    if (!module)
+        return AT_INVALID_ARGUMENT;
+
+    pthread_mutex_lock(&s_filter_mutex);
+    for (u32 x = 0; x < s_module_level_count; x++) {
+        if (strcmp(s_module_levels[x].module, module) != 0)
+            continue;
+
+        free(s_module_levels[x].module);
+        s_module_levels[x] = s_module_levels[--s_module_level_count];
+        update_all_sites_locked();
+        pthread_mutex_unlock(&s_filter_mutex);
+        return AT_SUCCESS;
+    }
+    pthread_mutex_unlock(&s_filter_mutex);
+    return AT_INVALID_ARGUMENT;
+}
+
+
+u32 logger_get_module_levels(const char** modules, log_type* levels, const u32 max_count) {
+
+    pthread_mutex_lock(&s_filter_mutex);
+    const u32 count = (s_module_level_count < max_count) ? s_module_level_count : max_count;
+    for (u32 x = 0; x < count; x++) {
+        modules[x] = s_module_levels[x].module;
+        levels[x] = s_module_levels[x].level;
+    }
+    const u32 total = s_module_level_count;
+    pthread_mutex_unlock(&s_filter_mutex);
+    return total;
 }
+
+
+// Replaces level and module overrides, empty strings keep the current ones. [module_levels] is a list of "<module>=<level>" separated by spaces or commas
+static void apply_filter_settings(const char* level_text, const char* module_levels) {
+
+    pthread_mutex_lock(&s_filter_mutex);
+    log_type level;
+    if (level_text[0] != '\0' && parse_log_level(level_text, strlen(level_text), &level))
+        s_log_level = level;
+
+    if (module_levels[0] != '\0')
+        clear_module_levels_locked();
+    const char* c = module_levels;
+    while (*c) {
+        c += strspn(c, " ,\t");
+        const size_t length = strcspn(c, " ,\t");
+        const char* separator = memchr(c, '=', length);
+        if (separator && separator != c && s_module_level_count < LOG_MAX_MODULE_LEVELS
+            && parse_log_level(separator + 1, length - (size_t)(separator + 1 - c), &level)) {
+            char* module = strndup(c, (size_t)(separator - c));
+            if (module) {
+                s_module_levels[s_module_level_count++] = (module_level){ .module = module, .length = strlen(module), .level = level };
+            }
+        }
+        c += length;
+    }
+
+    update_all_sites_locked();
+    pthread_mutex_unlock(&s_filter_mutex);
+}
+
+
+// ============================================================================================================================================
+// data
+// ============================================================================================================================================
+
+static const char*              c_default_format = "[$B$T $L] $E $P:$G $C$Z";
+
+static char*                    s_format = NULL;                // format of every sink without its own format (see logger_set_format)
+
+static logger_flush_policy      s_flush_policy = LOGGER_DEFAULT_FLUSH_POLICY;       // used for every file sink
+
+static logger_rotation_policy   s_rotation_policy = LOGGER_DEFAULT_ROTATION_POLICY; // used for the file sink of logger_init()
+
+static u32                      s_crash_ring_size = 0;          // crash ring of logger_init(), 0 = none
+
+static log_output_format        s_output_format = LOG_OUTPUT_TEXT;  // file sink of logger_init()
+
+
+// ============================================================================================================================================
+// sinks
+// ============================================================================================================================================
+
+// The active [log_sink_set] is immutable and swapped RCU-style: readers only bump [s_sink_readers], a writer (serialized by [s_sink_mutex])
+// publishes a new set and frees the old one after all readers that could still see it are gone. Sinks themselves are shared between sets.
+// Sinks with the same format and color mode (or the same structured output) share a format slot, so every message is rendered once per distinct format.
+
+typedef struct {
+    u32                 id;
+    log_sink_type       type;
+    _Atomic log_type    min_level;
+    char*               format;                     // own format, NULL to use [s_format]
+    b8                  use_colors;
+    log_output_format   output;
+    b8                  console_pending;            // data written to stdout since the last fflush (logger thread only)
+    log_file_writer*    file;                       // LOG_SINK_FILE and LOG_SINK_ROTATING_FILE
+    log_memory_ring*    memory;                     // LOG_SINK_MEMORY
+    log_crash_ring*     crash;                      // LOG_SINK_CRASH_RING
+    log_sink_callback   callback;                   // LOG_SINK_CALLBACK
+    void*               user_data;
+} log_sink;
+
+typedef struct {
+    b8                  uses_time;                  // any program uses a time/date field
+    u32                 sink_count;
+    log_sink*           sinks[LOGGER_MAX_SINKS];
+    u32                 sink_slots[LOGGER_MAX_SINKS];           // index into [programs] for every sink
+    u32                 program_count;
+    format_program*     programs[LOGGER_MAX_SINKS];
+} log_sink_set;
+
+static _Atomic(log_sink_set*)   s_sink_set = NULL;
+static _Atomic u32              s_sink_readers = 0;
+static pthread_mutex_t          s_sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static u32                      s_next_sink_id = 1;
+
+
+static inline const log_sink_set* sink_set_acquire() {
+
+    atomic_fetch_add(&s_sink_readers, 1);
+    return atomic_load(&s_sink_set);
+}
+
+
+static inline void sink_set_release() {
+
+    atomic_fetch_sub_explicit(&s_sink_readers, 1, memory_order_release);
+}
+
+
+static void free_sink_set(log_sink_set* set) {
+
+    if (!set) return;
+    for (u32 x = 0; x < set->program_count; x++)
+        free_format_program(set->programs[x]);
+    free(set);
+}
+
+
+// Compiles the programs for [sinks] and publishes the new set, the old one is freed once no reader can still use it.
+// CAUTION: caller needs to hold [s_sink_mutex]
+static i32 publish_sink_set(log_sink* const* sinks, const u32 sink_count) {
+
+    log_sink_set* set = NULL;
+    if (sink_count > 0) {
+        set = calloc(1, sizeof(log_sink_set));
+        if (!set)
+            return AT_MEMORY_ERROR;
+
+        for (u32 x = 0; x < sink_count; x++) {
+            const char* format = sinks[x]->format ? sinks[x]->format : (s_format ? s_format : c_default_format);
+
+            const log_output_format output = sinks[x]->output;
+            u32 slot = 0;
+            while (slot < set->program_count && (set->programs[slot]->output != output
+                || (output == LOG_OUTPUT_TEXT && (strcmp(set->programs[slot]->format, format) != 0 || set->programs[slot]->use_colors != sinks[x]->use_colors))))
+                slot++;
+
+            if (slot == set->program_count) {
+                set->programs[slot] = compile_format(format, sinks[x]->use_colors, output);
+                if (!set->programs[slot]) {
+                    free_sink_set(set);
+                    return AT_FORMAT_ERROR;
+                }
+                set->uses_time |= set->programs[slot]->uses_time;
+                set->program_count++;
+            }
+
+            set->sinks[x] = sinks[x];
+            set->sink_slots[x] = slot;
+        }
+        set->sink_count = sink_count;
+    }
+
+    log_sink_set* old = atomic_exchange(&s_sink_set, set);
+    while (atomic_load(&s_sink_readers) != 0)                   // grace period
+        sched_yield();
+
+    free_sink_set(old);
+    return AT_SUCCESS;
+}
+
+
+static void destroy_sink(log_sink* sink) {
+
+    if (sink->file) {
+        if (sink->output == LOG_OUTPUT_TEXT)
+            file_writer_write_banner(sink->file, NULL);
+        file_writer_destroy(sink->file);
+    }
+    if (sink->memory)
+        memory_ring_destroy(sink->memory);
+    if (sink->crash)
+        crash_ring_destroy(sink->crash);
+    if (sink->type == LOG_SINK_CONSOLE)
+        fflush(stdout);
+    free(sink->format);
+    free(sink);
+}
+
+
+// Copies the messages a crashed run left in the crash ring at [path] into every file sink with the same [output]
+// CAUTION: caller needs to hold [s_sink_mutex]
+static void recover_crash_ring_locked(const char* path, const log_output_format output) {
+
+    u32 length;
+    char* text = crash_ring_recover(path, &length);
+    if (!text)
+        return;
+
+    static const char begin[] = "------------------------------ messages recovered from the crash ring of the previous run ------------------------------\n";
+    static const char end[] =   "------------------------------------------- end of recovered messages -------------------------------------------\n";
+    const log_sink_set* set = atomic_load(&s_sink_set);        // can not change while [s_sink_mutex] is held
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        log_file_writer* file = set->sinks[x]->file;
+        if (!file || set->sinks[x]->output != output)
+            continue;
+
+        if (output == LOG_OUTPUT_TEXT)                          // JSON lines stay parseable without markers
+            file_writer_write(file, begin, sizeof(begin) - 1, LOG_TYPE_TRACE, 0);
+        file_writer_write(file, text, length, LOG_TYPE_TRACE, 0);
+        if (output == LOG_OUTPUT_TEXT)
+            file_writer_write(file, end, sizeof(end) - 1, LOG_TYPE_TRACE, 0);
+        file_writer_flush(file);
+    }
+    free(text);
+}
+
+
+static log_sink* create_sink(const log_sink_config* config) {
+
+    log_sink* sink = calloc(1, sizeof(log_sink));
+    if (!sink)
+        return NULL;
+
+    sink->type = config->type;
+    atomic_init(&sink->min_level, config->min_level);
+    sink->use_colors = config->use_colors;
+    sink->output = config->output;
+    sink->format = config->format ? strdup(config->format) : NULL;
+    if (config->format && !sink->format) {
+        free(sink);
+        return NULL;
+    }
+
+    b8 success = true;
+    switch (config->type) {
+        case LOG_SINK_CONSOLE:
+            sink->use_colors = config->use_colors && isatty(STDOUT_FILENO) && isatty(STDERR_FILENO);
+            break;
+
+        case LOG_SINK_FILE:
+        case LOG_SINK_ROTATING_FILE: {
+            const b8 rotating = (config->type == LOG_SINK_ROTATING_FILE);
+            sink->file = file_writer_create(config->file_path, config->use_append_mode, s_flush_policy, rotating ? config->rotation : LOGGER_DEFAULT_ROTATION_POLICY,
+                config->output == LOG_OUTPUT_BINARY);
+            success = (sink->file != NULL);
+            if (success && config->output == LOG_OUTPUT_TEXT)
+                file_writer_write_banner(sink->file, sink->format ? sink->format : (s_format ? s_format : c_default_format));
+        } break;
+
+        case LOG_SINK_MEMORY:
+            sink->memory = memory_ring_create(config->memory_size ? config->memory_size : LOGGER_DEFAULT_MEMORY_SINK_SIZE);
+            success = (sink->memory != NULL);
+            break;
+
+        case LOG_SINK_CALLBACK:
+            sink->callback = config->callback;
+            sink->user_data = config->user_data;
+            break;
+
+        case LOG_SINK_CRASH_RING:
+            recover_crash_ring_locked(config->file_path, config->output);      // before the file is reused
+            sink->crash = crash_ring_create(config->file_path, config->memory_size ? config->memory_size : LOGGER_DEFAULT_CRASH_RING_SIZE);
+            success = (sink->crash != NULL);
+            break;
+    }
+
+    if (!success) {
+        free(sink->format);
+        free(sink);
+        return NULL;
+    }
+    return sink;
+}
+
+
+// Hands one rendered message to [sink]
+static void sink_write(log_sink* sink, const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns, const format_buffer* out) {
+
+    switch (sink->type) {
+        case LOG_SINK_CONSOLE:                                  // route to stdout or stderr depending on severity
+            if ((int)site->type < LOG_TYPE_WARN) {
+                fwrite(out->data, 1, out->len, stdout);
+#if USE_MULTI_THREADING
+                sink->console_pending = true;                   // flushed once the logger thread runs out of work
+#else
+                fflush(stdout);
+#endif
+            } else {
+                if (sink->console_pending) {                    // keep the order of stdout and stderr
+                    fflush(stdout);
+                    sink->console_pending = false;
+                }
+                fwrite(out->data, 1, out->len, stderr);
+                fflush(stderr);
+            }
+            break;
+
+        case LOG_SINK_FILE:
+        case LOG_SINK_ROTATING_FILE:
+            file_writer_write(sink->file, out->data, out->len, site->type, timestamp_ns);
+            break;
+
+        case LOG_SINK_MEMORY:
+            memory_ring_push(sink->memory, site, thread_id, label_id, timestamp_ns, out->data, out->len);
+            break;
+
+        case LOG_SINK_CALLBACK: {
+            const log_entry entry = { .site = site, .thread_id = thread_id, .thread_label = get_thread_label(label_id), .timestamp_ns = timestamp_ns, .text = out->data, .length = out->len };
+            sink->callback(&entry, sink->user_data);
+        } break;
+
+        case LOG_SINK_CRASH_RING:
+            crash_ring_write(sink->crash, out->data, out->len);
+            break;
+    }
+}
+
+
+#if USE_MULTI_THREADING
+
+// Returns the earliest CLOCK_MONOTONIC time at which a sink has to write buffered data, 0 if nothing is buffered
+static u64 sinks_deadline() {
+
+    u64 deadline_ns = 0;
+    const log_sink_set* set = sink_set_acquire();
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        if (!set->sinks[x]->file)
+            continue;
+
+        const u64 sink_deadline_ns = file_writer_deadline(set->sinks[x]->file);
+        if (sink_deadline_ns && (!deadline_ns || sink_deadline_ns < deadline_ns))
+            deadline_ns = sink_deadline_ns;
+    }
+    sink_set_release();
+    return deadline_ns;
+}
+
+
+// Called by the logger thread when it has nothing to do: flushes the console and every file whose interval elapsed
+static void sinks_flush_idle() {
+
+    const u64 now_ns = monotonic_ns();
+    const log_sink_set* set = sink_set_acquire();
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        log_sink* sink = set->sinks[x];
+        if (sink->console_pending) {
+            fflush(stdout);
+            sink->console_pending = false;
+        }
+
+        if (sink->file) {
+            const u64 deadline_ns = file_writer_deadline(sink->file);
+            if (deadline_ns && deadline_ns <= now_ns)
+                file_writer_flush(sink->file);
+        }
+    }
+    sink_set_release();
+}
+
+#endif
+
+
+static void sinks_flush_all() {
+
+    const log_sink_set* set = sink_set_acquire();
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        if (set->sinks[x]->type == LOG_SINK_CONSOLE)
+            fflush(stdout);
+        if (set->sinks[x]->file)
+            file_writer_flush(set->sinks[x]->file);
+    }
+    sink_set_release();
+}
+
+
+// ============================================================================================================================================
+// private functions
+// ============================================================================================================================================
+
+#if USE_MULTI_THREADING           // give message to buffer and let logger-thread perform processing
+
+    // Internal call site that reports dropped messages, registered like every LOG_* call site so it can be filtered and resolved by ID
+    static const u8 c_dropped_site_arg_types[] = { LOG_ARG_STR, LOG_ARG_END };
+    static log_site s_dropped_site = {
+        .type = LOG_TYPE_WARN, .line = __LINE__, .file_name = __FILE__, .function_name = "logger_thread_func",
+        .format = "%s", .arg_types = c_dropped_site_arg_types, .enabled = true,
+    };
+    static log_site* const s_dropped_site_slot __attribute__((used, section("log_sites"))) = &s_dropped_site;
+
+
+    // Emits one message for all drops since the last report
+    static void report_dropped_messages() {
+
+        static u64 s_reported[LOG_TYPE_FATAL + 1];          // only used by the logger thread
+        u64 counts[LOG_TYPE_FATAL + 1];
+        u64 total = 0;
+        for (u32 x = 0; x <= LOG_TYPE_FATAL; x++) {
+            const u64 dropped = atomic_load_explicit(&s_dropped[x], memory_order_relaxed);
+            counts[x] = dropped - s_reported[x];
+            s_reported[x] = dropped;
+            total += counts[x];
+        }
+        if (total == 0 || !atomic_load_explicit(&s_dropped_site.enabled, memory_order_relaxed))
+            return;
+
+        char message[256];
+        size_t len = (size_t)snprintf(message, sizeof(message), "%llu messages dropped because the log queue was full (", (unsigned long long)total);
+        for (u32 x = 0; x <= LOG_TYPE_FATAL && len < sizeof(message); x++) {
+            if (counts[x] == 0)
+                continue;
+            const char* level = log_level_to_string((log_type)x);
+            len += (size_t)snprintf(message + len, sizeof(message) - len, "%s%.*s: %llu", (message[len - 1] == '(') ? "" : ", ",
+                (int)strcspn(level, " "), level, (unsigned long long)counts[x]);
+        }
+        if (len < sizeof(message) - 1)
+            snprintf(message + len, sizeof(message) - len, ")");
+
+        process_log_message_v(&s_dropped_site, pthread_self(), get_thread_label_id(pthread_self()), get_system_time_ns(), message, NULL);
+    }
+
+
+    // thread function that drains the staging rings of all threads. The fronts of the rings are merged by timestamp,
+    // every record is processed in place using [process_log_message_v]
+    static void* logger_thread_func(void* arg) {
+        (void)arg;
+        
+        while (1) {
+            if (atomic_load(&s_crashed))                    // hand the rings and the file writers over to the crash path
+                break;
+
+            log_ring* ring = NULL;
+            log_record* record = staging_next(&ring);
+            if (!record) {
+                if (staging_finished())
+                    break; // shutdown requested and everything is processed
+
+                sinks_flush_idle();                         // batch console output until there is nothing left to do
+                staging_wait(sinks_deadline());             // wake up in time for the interval flush if data is buffered
+                continue;
+            }
+
+            s_logger_record = record;
+            atomic_signal_fence(memory_order_seq_cst);      // visible to logger_on_crash() if this thread crashes while processing it
+
+            const log_site* site = __start_log_sites[record->site_id];
+            if (atomic_load_explicit(&s_overflow_mode, memory_order_relaxed) == LOGGER_OVERFLOW_DROP_OLDEST
+                && ring_used(ring) > atomic_load_explicit(&s_high_water, memory_order_relaxed))
+                count_dropped_message(site->type);          // catch up by discarding the oldest records unformatted
+            else if (record->deferred && site->field_names)  // LOG_KV: the message is literal, the payload holds the fields
+                process_log_message_v(site, record->thread_id, record->label_id, record->timestamp_ns, site->format, (const u8*)(record + 1));
+            else if (record->deferred) {                    // format the captured arguments first
+                static char message[MSG_LEN];               // only used by the logger thread
+                render_log_args(site, (const u8*)(record + 1), message, sizeof(message));
+                process_log_message_v(site, record->thread_id, record->label_id, record->timestamp_ns, message, NULL);
+            } else
+                process_log_message_v(site, record->thread_id, record->label_id, record->timestamp_ns, log_record_message(record), NULL);
+
+            if (s_crash_stopped_sink != UINT32_MAX)         // stopped before a sink, the crash path writes the rest of [s_logger_record]
+                break;
+
+            ring_release(ring, record);
+            atomic_signal_fence(memory_order_seq_cst);      // a released record is not drained again, so it is forgotten only afterwards
+            s_logger_record = NULL;
+
+            static u64 s_reported_total = 0;
+            if (atomic_load_explicit(&s_dropped_total, memory_order_relaxed) != s_reported_total
+                && ring_used(ring) <= atomic_load_explicit(&s_high_water, memory_order_relaxed) / 2) {         // pressure subsided
+                s_reported_total = atomic_load_explicit(&s_dropped_total, memory_order_relaxed);
+                report_dropped_messages();
+            }
+        }
+
+        if (atomic_load(&s_crashed))
+            atomic_store(&s_crash_ack, true);
+        return NULL;
+    }
+
+#endif
+
+
+// ============================================================================================================================================
+// LOGGER
+// ============================================================================================================================================
+
+
+b8 logger_init(const char* log_msg_format, const b8 log_to_console, const char* log_dir, const char* log_file_name, const b8 use_append_mode) {
+
+    logger_set_format(log_msg_format);
+    init_log_sites();
+
+    char exec_path[PATH_MAX] = {0};
+    if (get_executable_path(exec_path, sizeof(exec_path))) return false;
+
+    char file_path[PATH_MAX];
+    memset(file_path, '\0', sizeof(file_path));
+    snprintf(file_path, sizeof(file_path), "%s/%s", exec_path, log_dir);
+    // printf("log path: %s\n", file_path);
+
+    if (mkdir(file_path, 0777) && errno != EEXIST)
+        BREAK_POINT();
+
+    static const char* c_extensions[] = { "log", "jsonl", "logbin" };           // indexed by log_output_format
+    memset(file_path, '\0', sizeof(file_path));
+    snprintf(file_path, sizeof(file_path), "%s/%s/%s.%s", exec_path, log_dir, log_file_name, c_extensions[s_output_format]);
+
+    const b8 rotating = (s_rotation_policy.max_file_size || s_rotation_policy.interval_s);
+    if (log_to_console)
+        ASSERT_SS(logger_add_sink(&(log_sink_config){ .type = LOG_SINK_CONSOLE, .min_level = LOG_TYPE_TRACE, .use_colors = true }, NULL) == AT_SUCCESS)
+    ASSERT_SS(logger_add_sink(&(log_sink_config){ .type = rotating ? LOG_SINK_ROTATING_FILE : LOG_SINK_FILE, .min_level = LOG_TYPE_TRACE,
+        .file_path = file_path, .use_append_mode = use_append_mode, .rotation = s_rotation_policy, .output = s_output_format }, NULL) == AT_SUCCESS)
+
+    if (s_crash_ring_size) {                // also recovers the messages of a crashed previous run into the file sink (text or JSON, a binary file gets none)
+        snprintf(file_path, sizeof(file_path), "%s/%s/%s.crash", exec_path, log_dir, log_file_name);
+        ASSERT_SS(logger_add_sink(&(log_sink_config){ .type = LOG_SINK_CRASH_RING, .min_level = LOG_TYPE_TRACE, .file_path = file_path,
+            .memory_size = s_crash_ring_size, .output = (s_output_format == LOG_OUTPUT_JSON) ? LOG_OUTPUT_JSON : LOG_OUTPUT_TEXT }, NULL) == AT_SUCCESS)
+    }
+
+#if USE_MULTI_THREADING
+
+    ASSERT_SS(staging_init());
+    if (atomic_load(&s_high_water) == 0)    // no policy set yet
+        logger_set_overflow_policy(LOGGER_DEFAULT_OVERFLOW_POLICY);
+    ASSERT_SS(pthread_create(&s_logger_thread, NULL, logger_thread_func, NULL) == 0);
+
+#endif
+
+    return true;
+}
+
+
+void logger_shutdown() {
+
+#if USE_MULTI_THREADING
+    if (!atomic_load(&s_staging.active)) return;        // not initialized or already shut down
+
+    /* Signal shutdown to all waiters (consumers & producers) */
+    staging_request_shutdown();
+
+    /* Don't try to join ourselves (would deadlock). If thread wasn't created, skip. */
+    if (!pthread_equal(pthread_self(), s_logger_thread)) {
+        pthread_join(s_logger_thread, NULL);
+    }
+
+    staging_destroy();
+#endif
+    logger_remove_all_thread_labels();
+    free_thread_label_table();              // no record references a label anymore
+    free_log_sites();
+
+    // close all sinks (writes the closing banner of the log files)
+    pthread_mutex_lock(&s_sink_mutex);
+    log_sink_set* set = atomic_load(&s_sink_set);
+    log_sink* sinks[LOGGER_MAX_SINKS];
+    const u32 sink_count = set ? set->sink_count : 0;
+    if (set)
+        memcpy(sinks, set->sinks, sink_count * sizeof(log_sink*));
+    publish_sink_set(NULL, 0);
+    for (u32 x = 0; x < sink_count; x++)
+        destroy_sink(sinks[x]);
+
+    // Free allocated resources
+    free(s_format);
+    s_format = NULL;
+    pthread_mutex_unlock(&s_sink_mutex);
+
+    housekeeping_shutdown();
+}
+
+
+i32 logger_add_sink(const log_sink_config* config, u32* sink_id) {
+
+    VALIDATE(config && config->type <= LOG_SINK_CRASH_RING && config->min_level <= LOG_TYPE_FATAL, return AT_INVALID_ARGUMENT, "", "Invalid sink config")
+    VALIDATE((config->type != LOG_SINK_FILE && config->type != LOG_SINK_ROTATING_FILE && config->type != LOG_SINK_CRASH_RING) || config->file_path, return AT_INVALID_ARGUMENT, "", "File sinks need a file path")
+    VALIDATE(config->type != LOG_SINK_CALLBACK || config->callback, return AT_INVALID_ARGUMENT, "", "Callback sinks need a callback")
+    VALIDATE(config->output <= LOG_OUTPUT_BINARY, return AT_INVALID_ARGUMENT, "", "Invalid output format")
+    VALIDATE(config->output != LOG_OUTPUT_BINARY || config->type == LOG_SINK_FILE || config->type == LOG_SINK_ROTATING_FILE || config->type == LOG_SINK_CALLBACK,
+        return AT_INVALID_ARGUMENT, "", "Binary output is only supported by file and callback sinks")
+
+    pthread_mutex_lock(&s_sink_mutex);
+
+    const log_sink_set* set = atomic_load(&s_sink_set);
+    const u32 sink_count = set ? set->sink_count : 0;
+    if (sink_count >= LOGGER_MAX_SINKS) {
+        pthread_mutex_unlock(&s_sink_mutex);
+        return AT_RANGE_ERROR;
+    }
+
+    log_sink* sink = create_sink(config);
+    if (!sink) {
+        pthread_mutex_unlock(&s_sink_mutex);
+        return (config->type == LOG_SINK_FILE || config->type == LOG_SINK_ROTATING_FILE || config->type == LOG_SINK_CRASH_RING) ? AT_IO_ERROR : AT_MEMORY_ERROR;
+    }
+    sink->id = s_next_sink_id++;
+
+    log_sink* sinks[LOGGER_MAX_SINKS];
+    if (set)
+        memcpy(sinks, set->sinks, sink_count * sizeof(log_sink*));
+    sinks[sink_count] = sink;
+
+    const i32 result = publish_sink_set(sinks, sink_count + 1);
+    if (result != AT_SUCCESS)
+        destroy_sink(sink);
+    else if (sink_id)
+        *sink_id = sink->id;
+
+    pthread_mutex_unlock(&s_sink_mutex);
+    return result;
+}
+
+
+i32 logger_remove_sink(const u32 sink_id) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+
+    const log_sink_set* set = atomic_load(&s_sink_set);
+    log_sink* sinks[LOGGER_MAX_SINKS];
+    log_sink* removed = NULL;
+    u32 sink_count = 0;
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        if (set->sinks[x]->id == sink_id)
+            removed = set->sinks[x];
+        else
+            sinks[sink_count++] = set->sinks[x];
+    }
+
+    i32 result = AT_INVALID_ARGUMENT;
+    if (removed) {
+        result = publish_sink_set(sinks, sink_count);
+        if (result == AT_SUCCESS)                               // no reader can see the sink anymore
+            destroy_sink(removed);
+    }
+
+    pthread_mutex_unlock(&s_sink_mutex);
+    return result;
+}
+
+
+i32 logger_set_sink_level(const u32 sink_id, const log_type min_level) {
+
+    VALIDATE(min_level <= LOG_TYPE_FATAL, return AT_INVALID_ARGUMENT, "", "Invalid log level")
+
+    i32 result = AT_INVALID_ARGUMENT;
+    const log_sink_set* set = sink_set_acquire();
+    for (u32 x = 0; set && x < set->sink_count; x++) {
+        if (set->sinks[x]->id != sink_id)
+            continue;
+
+        atomic_store_explicit(&set->sinks[x]->min_level, min_level, memory_order_relaxed);
+        result = AT_SUCCESS;
+    }
+    sink_set_release();
+    return result;
+}
+
+
+u64 logger_read_memory_sink(const u32 sink_id, const u64 first_sequence, log_sink_callback callback, void* user_data) {
+
+    u64 next_sequence = first_sequence;
+    const log_sink_set* set = sink_set_acquire();
+    for (u32 x = 0; set && callback && x < set->sink_count; x++) {
+        if (set->sinks[x]->id == sink_id && set->sinks[x]->memory)
+            next_sequence = memory_ring_read(set->sinks[x]->memory, first_sequence, get_thread_label, callback, user_data);
+    }
+    sink_set_release();
+    return next_sequence;
+}
+
+
+void logger_set_flush_policy(const logger_flush_policy policy) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+    s_flush_policy = policy;
+    if (s_flush_policy.size_threshold > LOGGER_FILE_BUFFER_SIZE)
+        s_flush_policy.size_threshold = LOGGER_FILE_BUFFER_SIZE;
+
+    const log_sink_set* set = atomic_load(&s_sink_set);        // can not change while [s_sink_mutex] is held
+    for (u32 x = 0; set && x < set->sink_count; x++)
+        if (set->sinks[x]->file)
+            file_writer_set_policy(set->sinks[x]->file, s_flush_policy);
+    pthread_mutex_unlock(&s_sink_mutex);
+
+#if USE_MULTI_THREADING
+    pthread_mutex_lock(&s_staging.mutex);   // let the logger thread pick up the new interval
+    if (atomic_load(&s_staging.active))
+        pthread_cond_signal(&s_staging.contains);
+    pthread_mutex_unlock(&s_staging.mutex);
+#endif
+}
+
+
+void logger_set_overflow_policy(const logger_overflow_policy policy) {
+
+    u64 high_water = UINT64_MAX;            // never apply the policy
+#if USE_MULTI_THREADING
+    const u32 percent = (policy.high_water_percent == 0 || policy.high_water_percent > 100) ? 100 : policy.high_water_percent;
+    high_water = (policy.mode == LOGGER_OVERFLOW_BLOCK || policy.mode == LOGGER_OVERFLOW_DROP_NEWEST)
+        ? LOG_RING_CAPACITY                 // only full matters
+        : (u64)LOG_RING_CAPACITY * percent / 100;
+#endif
+
+    atomic_store(&s_overflow_mode, (u32)policy.mode);
+    atomic_store(&s_overflow_min_level, (u32)policy.min_level);
+    atomic_store(&s_high_water, high_water);
+}
+
+
+void logger_get_dropped_messages(u64* counts) {
+
+    for (u32 x = 0; x <= LOG_TYPE_FATAL; x++)
+        counts[x] = atomic_load_explicit(&s_dropped[x], memory_order_relaxed);
+}
+
+
+void logger_set_rotation_policy(const logger_rotation_policy policy) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+    s_rotation_policy = policy;
+    pthread_mutex_unlock(&s_sink_mutex);
+}
+
+
+void logger_set_crash_ring_size(const u32 size) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+    s_crash_ring_size = size;
+    pthread_mutex_unlock(&s_sink_mutex);
+}
+
+
+void logger_set_output_format(const log_output_format output) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+    s_output_format = (output <= LOG_OUTPUT_BINARY) ? output : LOG_OUTPUT_TEXT;
+    pthread_mutex_unlock(&s_sink_mutex);
+}
+
+
+b8 logger_load_settings(const char* config_dir, const char* file_name) {
+
+    char exec_path[PATH_MAX] = {0};
+    if (get_executable_path(exec_path, sizeof(exec_path))) return false;
+
+    char dir_path[PATH_MAX];
+    const int written = snprintf(dir_path, sizeof(dir_path), "%s/%s", exec_path, config_dir);
+    VALIDATE(written >= 0 && (size_t)written < sizeof(dir_path), return false, "", "Path too long: %s/%s", exec_path, config_dir)
+
+    logger_rotation_policy rotation = s_rotation_policy;
+    b32 compress = rotation.compress;
+    u32 crash_ring_size = s_crash_ring_size;
+
+    SY sy = {0};
+    VALIDATE(sy_init(&sy, dir_path, file_name, "logger_settings", SERIALIZER_OPTION_LOAD), return false, "", "Failed to load logger settings")
+    sy_entry(&sy, "max_file_size", &rotation.max_file_size, "%" SCNu64);
+    sy_entry(&sy, "rotation_interval_s", &rotation.interval_s, "%" SCNu32);
+    sy_entry(&sy, "max_files", &rotation.max_files, "%" SCNu32);
+    sy_entry_b32(&sy, "compress_rotated_files", &compress);
+    sy_entry(&sy, "crash_ring_size", &crash_ring_size, "%" SCNu32);
+    char output[16] = {0};
+    char level[16] = {0};
+    char module_levels[1024] = {0};
+    sy_entry_str(&sy, "output_format", output, sizeof(output));
+    sy_entry_str(&sy, "log_level", level, sizeof(level));
+    sy_entry_str(&sy, "module_levels", module_levels, sizeof(module_levels));
+    sy_shutdown(&sy);
+
+    rotation.compress = (compress != 0);
+    logger_set_rotation_policy(rotation);
+    logger_set_crash_ring_size(crash_ring_size);
+    if (output[0] != '\0') {
+        if (strcasecmp(output, "text") == 0)            logger_set_output_format(LOG_OUTPUT_TEXT);
+        else if (strcasecmp(output, "json") == 0)       logger_set_output_format(LOG_OUTPUT_JSON);
+        else if (strcasecmp(output, "binary") == 0)     logger_set_output_format(LOG_OUTPUT_BINARY);
+        else LOG(Warn, "Unknown output_format [%s] in logger settings", output)
+    }
+    apply_filter_settings(level, module_levels);
+    return true;
+}
+
+
+void logger_flush() {
+
+#if USE_MULTI_THREADING
+    // wait until the logger thread processed everything that was logged before this call
+    if (atomic_load(&s_staging.active) && !pthread_equal(pthread_self(), s_logger_thread)) {
+
+        log_ring* rings[LOG_MAX_STAGING_RINGS];
+        u64 heads[LOG_MAX_STAGING_RINGS];
+        pthread_mutex_lock(&s_staging.mutex);
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            rings[x] = atomic_load(&s_staging.rings[x]);
+            heads[x] = rings[x] ? atomic_load(&rings[x]->head) : 0;
+        }
+        pthread_mutex_unlock(&s_staging.mutex);
+
+        for (u32 x = 0; x < ring_count; x++) {
+            for (;;) {
+                pthread_mutex_lock(&s_staging.mutex);       // the consumer frees drained rings of exited threads under this mutex
+                const b8 done = (atomic_load(&s_staging.rings[x]) != rings[x] || !rings[x]
+                    || atomic_load(&rings[x]->tail) >= heads[x] || atomic_load(&s_staging.shutdown));
+                pthread_mutex_unlock(&s_staging.mutex);
+                if (done)
+                    break;
+                sched_yield();
+            }
+        }
+    }
+#endif
+
+    sinks_flush_all();
+}
+
+
+void logger_set_format(const char* new_format) {
+
+    pthread_mutex_lock(&s_sink_mutex);
+
+    char* previous = s_format;
+    s_format = strdup(new_format ? new_format : c_default_format);
+    ASSERT(s_format, "", "something went wrong when setting the log format")
+
+    // recompile every sink that uses the logger format
+    const log_sink_set* set = atomic_load(&s_sink_set);
+    log_sink* sinks[LOGGER_MAX_SINKS];
+    const u32 sink_count = set ? set->sink_count : 0;
+    if (set)
+        memcpy(sinks, set->sinks, sink_count * sizeof(log_sink*));
+
+    if (s_format && (sink_count == 0 || publish_sink_set(sinks, sink_count) == AT_SUCCESS))
+        free(previous);
+    else {                                  // keep the previous format if compilation failed
+        free(s_format);
+        s_format = previous;
+    }
+
+    pthread_mutex_unlock(&s_sink_mutex);
+}
+
+
+// ============================================================================================================================================
+// message formatter
+// ============================================================================================================================================
+
+// Rendered messages, one per format slot of the active [log_sink_set].
+// Only used by the logger thread, or while holding [s_process_mutex] when USE_MULTI_THREADING is off
+static format_buffer            s_outputs[LOGGER_MAX_SINKS];
+
+#if !USE_MULTI_THREADING
+static pthread_mutex_t          s_process_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+// main formatter - expects the message text to be already formatted, [fields] is the payload of a LOG_KV record or NULL
+// used by the logger thread for records inside the staging rings and directly by the calling thread when USE_MULTI_THREADING is off
+void process_log_message_v(const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns, const char* message, const u8* fields) {
+
+    if (!message || (message[0] == '\0' && !fields))        // skip empty messages
+        return;
+
+#if !USE_MULTI_THREADING
+    pthread_mutex_lock(&s_process_mutex);
+#endif
+
+    const log_sink_set* set = sink_set_acquire();
+    if (set) {
+        system_time st = {0};
+        if (set->uses_time)
+            st = system_time_from_ns(timestamp_ns);
+
+        // every format is rendered at most once, sinks with the same format share the result
+        b8 rendered[LOGGER_MAX_SINKS] = {0};
+        const char* label = get_thread_label(label_id);
+        const u32 message_len = (u32)strlen(message);
+        for (u32 x = 0; x < set->sink_count; x++) {
+            log_sink* sink = set->sinks[x];
+            if (site->type < atomic_load_explicit(&sink->min_level, memory_order_relaxed))
+                continue;
+
+#if USE_MULTI_THREADING
+            if (atomic_load(&s_crashed)) {                      // the crash path writes the remaining sinks (see logger_on_crash), the logger thread stops
+                s_crash_stopped_sink = x;
+                break;
+            }
+#endif
+
+            const u32 slot = set->sink_slots[x];
+            if (!rendered[slot]) {
+                render_message(set->programs[slot], &s_outputs[slot], site, thread_id, label, timestamp_ns, &st, message, message_len, fields);
+                rendered[slot] = true;
+            }
+            sink_write(sink, site, thread_id, label_id, timestamp_ns, &s_outputs[slot]);
+        }
+    }
+    sink_set_release();
+
+#if !USE_MULTI_THREADING
+    pthread_mutex_unlock(&s_process_mutex);
+#endif
+}
+
+
+// formats the message in the calling thread and hands it to the logger thread (or processes it directly without USE_MULTI_THREADING)
+static void log_message_va(const log_site* site, pthread_t thread_id, va_list ap) {
+
+    const char* message = site->format;
+    const u64 timestamp_ns = get_system_time_ns();
+
+#if USE_MULTI_THREADING                                     // write the record straight into the staging ring of this thread and let logger-thread perform processing
+
+    log_ring* ring = staging_ring_of_thread();
+    if (!ring) {                                            // logger not initialized (or already shut down)
+        if (atomic_load_explicit(&s_crashed, memory_order_relaxed))
+            crash_log_va(site, thread_id, timestamp_ns, message, ap);
+        return;
+    }
+
+    // Format once into a small stack buffer. Only messages that do not fit are formatted a second time, directly into the ring
+    char loc_message[INLINE_MSG_LEN];
+    va_list ap_copy;
+    va_copy(ap_copy, ap);
+    i32 message_len = vsnprintf(loc_message, sizeof(loc_message), message, ap);
+    if (message_len < 0) {
+        va_end(ap_copy);
+        return;
+    }
+    if (message_len > MSG_LEN - 1)
+        message_len = MSG_LEN - 1;
+
+    u64 position;
+    log_record* record = ring_reserve(ring, (u32)(sizeof(log_record) + message_len + 1), &position, site->type);
+    if (record) {
+        record->message_len = (u32)message_len;
+        record->site_id = site->id;
+        record->label_id = get_thread_label_id(thread_id);
+        record->deferred = false;
+        record->thread_id = thread_id;
+        record->timestamp_ns = timestamp_ns;
+
+        char* payload = (char*)(record + 1);
+        if ((size_t)message_len < sizeof(loc_message))
+            memcpy(payload, loc_message, message_len + 1);
+        else
+            vsnprintf(payload, message_len + 1, message, ap_copy);
+
+        ring_commit(record, position);
+    }
+    va_end(ap_copy);
+
+#else                                                       // direct processing in calling thread
+
+    if (atomic_load_explicit(&s_crashed, memory_order_relaxed)) {          // the crashed thread may hold [s_process_mutex]
+        crash_log_va(site, thread_id, timestamp_ns, message, ap);
+        return;
+    }
+
+    // use fixed size stack buffer (this forces a max log message length, but much faster than dynamic heap allocation)
+    char loc_message[MSG_LEN];
+    vsnprintf(loc_message, sizeof(loc_message), message, ap);
+    process_log_message_v(site, thread_id, get_thread_label_id(thread_id), timestamp_ns, loc_message, NULL);    // call the formatter that runs the compiled format
+
+#endif
+}
+
+
+void log_message(const log_site* site, pthread_t thread_id, ...) {
+
+    if (site->format[0] == '\0')
+        return;                                             // skip all empty log messages
+
+    va_list ap;
+    va_start(ap, thread_id);
+    log_message_va(site, thread_id, ap);
+    va_end(ap);
+}
+
+
+void log_message_deferred(const log_site* site, pthread_t thread_id, ...) {
+
+    if (site->format[0] == '\0')
+        return;                                             // skip all empty log messages
+
+    va_list ap;
+    va_start(ap, thread_id);
+
+#if USE_MULTI_THREADING                                     // copy the raw arguments into the ring, the logger-thread formats them
+
+    const struct log_parsed_format* parsed = site->parsed_format;
+    log_ring* ring = parsed ? staging_ring_of_thread() : NULL;
+    if (!ring) {                      // logger not initialized (or already shut down), or the site could not be parsed
+        log_message_va(site, thread_id, ap);
+        va_end(ap);
+        return;
+    }
+
+    const u64 timestamp_ns = get_system_time_ns();
+    log_arg_value values[LOG_MAX_ARGS];
+    u32 str_lengths[LOG_MAX_ARGS];
+    const u32 payload_size = capture_log_args(parsed, &ap, values, str_lengths);
+
+    u64 position;
+    log_record* record = ring_reserve(ring, (u32)sizeof(log_record) + payload_size, &position, site->type);
+    if (record) {
+        record->message_len = payload_size;
+        record->site_id = site->id;
+        record->label_id = get_thread_label_id(thread_id);
+        record->deferred = true;
+        record->thread_id = thread_id;
+        record->timestamp_ns = timestamp_ns;
+        write_log_args((u8*)(record + 1), parsed, values, str_lengths);
+        ring_commit(record, position);
+    }
+
+#else                                                       // nothing to defer to, format in calling thread
+
+    log_message_va(site, thread_id, ap);
+
+#endif
+
+    va_end(ap);
+}
+
+
+static void crash_log_fields(const log_site* site, const pthread_t thread_id, const u64 timestamp_ns, const struct log_parsed_format* parsed,
+    const log_arg_value* values, const u32* str_lengths);
+
+
+void log_message_kv(const log_site* site, pthread_t thread_id, ...) {
+
+    const struct log_parsed_format* parsed = site->parsed_format;
+    if (!parsed)
+        return;                                             // logger not initialized
+
+    const u64 timestamp_ns = get_system_time_ns();
+    log_arg_value values[LOG_MAX_ARGS];
+    u32 str_lengths[LOG_MAX_ARGS];
+    va_list ap;
+    va_start(ap, thread_id);
+    const u32 payload_size = capture_log_args(parsed, &ap, values, str_lengths);
+    va_end(ap);
+
+#if USE_MULTI_THREADING                                     // same as a deferred record, the logger-thread sees [site->field_names]
+
+    log_ring* ring = staging_ring_of_thread();
+    if (!ring) {                                            // logger not initialized (or already shut down)
+        if (atomic_load_explicit(&s_crashed, memory_order_relaxed))
+            crash_log_fields(site, thread_id, timestamp_ns, parsed, values, str_lengths);
+        return;
+    }
+
+    u64 position;
+    log_record* record = ring_reserve(ring, (u32)sizeof(log_record) + payload_size, &position, site->type);
+    if (record) {
+        record->message_len = payload_size;
+        record->site_id = site->id;
+        record->label_id = get_thread_label_id(thread_id);
+        record->deferred = true;
+        record->thread_id = thread_id;
+        record->timestamp_ns = timestamp_ns;
+        write_log_args((u8*)(record + 1), parsed, values, str_lengths);
+        ring_commit(record, position);
+    }
+
+#else                                                       // direct processing in calling thread
+
+    if (atomic_load_explicit(&s_crashed, memory_order_relaxed)) {          // the crashed thread may hold [s_process_mutex]
+        crash_log_fields(site, thread_id, timestamp_ns, parsed, values, str_lengths);
+        return;
+    }
+
+    u8 payload[MSG_LEN];                                    // capture_log_args() keeps the payload below MSG_LEN
+    (void)payload_size;
+    write_log_args(payload, parsed, values, str_lengths);
+    process_log_message_v(site, thread_id, get_thread_label_id(thread_id), timestamp_ns, site->format, payload);
+
+#endif
+}
+
+
+// ============================================================================================================================================
+// crash handling
+// ============================================================================================================================================
+
+// After logger_on_crash() messages bypass the staging rings and the locks of the sinks: the calling thread renders them into
+// static buffers and writes them with write() to the console, the log files and the crash ring. Memory and callback sinks are skipped.
+
+#define CRASH_WRITER_LOCK_ATTEMPTS          1000
+
+static atomic_flag              s_crash_lock = ATOMIC_FLAG_INIT;            // serializes threads that log after the crash
+static char                     s_crash_message[MSG_LEN];
+static format_buffer            s_crash_output;
+static u32                      s_crash_writer_lock_attempts = CRASH_WRITER_LOCK_ATTEMPTS;     // 1 if the logger thread did not stop in time
+
+
+// Label of [thread_id], the lookup does not lock so it cannot wait for a lock held by the crashed thread
+static inline u32 crash_thread_label_id(const pthread_t thread_id) {
+
+    return (pthread_equal(thread_id, pthread_self()) && t_label_epoch == atomic_load(&s_label_epoch)) ? t_label_id : find_thread_label(thread_id);
+}
+
+
+// Writes the message to the sinks starting at [first_sink]
+// CAUTION: caller needs to hold [s_crash_lock]
+static void crash_write_message_locked(const u32 first_sink, const log_site* site, const pthread_t thread_id, const u32 label_id, const u64 timestamp_ns,
+    const char* message, const u8* fields) {
+
+    const log_sink_set* set = atomic_load(&s_sink_set);
+    if (!set || (message[0] == '\0' && !fields))
+        return;
+
+    const system_time st = set->uses_time ? system_time_from_ns(timestamp_ns) : (system_time){0};
+    const char* label = get_thread_label(label_id);
+    const u32 message_len = (u32)strlen(message);
+    for (u32 x = first_sink; x < set->sink_count; x++) {
+        log_sink* sink = set->sinks[x];
+        if (site->type < atomic_load_explicit(&sink->min_level, memory_order_relaxed)
+            || sink->type == LOG_SINK_MEMORY || sink->type == LOG_SINK_CALLBACK)
+            continue;
+
+        render_message(set->programs[set->sink_slots[x]], &s_crash_output, site, thread_id, label, timestamp_ns, &st, message, message_len, fields);
+        if (sink->type == LOG_SINK_CONSOLE) {
+            struct iovec iov = { .iov_base = s_crash_output.data, .iov_len = s_crash_output.len };
+            write_all(((int)site->type < LOG_TYPE_WARN) ? STDOUT_FILENO : STDERR_FILENO, &iov, 1);
+        } else if (sink->file)
+            file_writer_crash_write(sink->file, s_crash_output.data, s_crash_output.len, s_crash_writer_lock_attempts);
+        else if (sink->crash)
+            crash_ring_write(sink->crash, s_crash_output.data, s_crash_output.len);
+    }
+}
+
+
+static void crash_log_va(const log_site* site, const pthread_t thread_id, const u64 timestamp_ns, const char* format, va_list ap) {
+
+    while (atomic_flag_test_and_set(&s_crash_lock))
+        sched_yield();
+
+    vsnprintf(s_crash_message, sizeof(s_crash_message), format, ap);
+    crash_write_message_locked(0, site, thread_id, crash_thread_label_id(thread_id), timestamp_ns, s_crash_message, NULL);
+    atomic_flag_clear(&s_crash_lock);
+}
+
+
+static void crash_log_fields(const log_site* site, const pthread_t thread_id, const u64 timestamp_ns, const struct log_parsed_format* parsed,
+    const log_arg_value* values, const u32* str_lengths) {
+
+    while (atomic_flag_test_and_set(&s_crash_lock))
+        sched_yield();
+
+    write_log_args((u8*)s_crash_message, parsed, values, str_lengths);         // capture_log_args() keeps the payload below MSG_LEN
+    crash_write_message_locked(0, site, thread_id, crash_thread_label_id(thread_id), timestamp_ns, site->format, (const u8*)s_crash_message);
+    atomic_flag_clear(&s_crash_lock);
+}
+
+
+#if USE_MULTI_THREADING
+
+    // Writes the committed records the logger thread did not get to, merged by timestamp like the logger thread does. [handed_off]: the
+    // logger thread stopped (s_crash_ack) or crashed itself, the rings start where it stopped and [s_logger_record] only goes to the
+    // sinks from [s_crash_stopped_sink] on. Otherwise the rings are only read while the logger thread may still be working on them.
+    // CAUTION: caller needs to hold [s_crash_lock]
+    static void crash_drain_staging_locked(const b8 handed_off) {
+
+        u64 positions[LOG_MAX_STAGING_RINGS];
+        const u32 ring_count = atomic_load(&s_staging.ring_count);
+        for (u32 x = 0; x < ring_count; x++) {
+            log_ring* r = atomic_load(&s_staging.rings[x]);
+            positions[x] = r ? atomic_load(&r->tail) : 0;
+        }
+
+        for (;;) {
+            log_record* next = NULL;
+            u32 next_ring = 0;
+            for (u32 x = 0; x < ring_count; x++) {
+                log_ring* r = atomic_load(&s_staging.rings[x]);
+                if (!r)
+                    continue;
+
+                log_record* record;
+                for (;;) {
+                    record = (log_record*)(r->data + (positions[x] & (r->capacity - 1)));
+                    if (atomic_load(&record->commit) != positions[x] + 1) {
+                        record = NULL;                                  // not committed (yet)
+                        break;
+                    }
+                    if (record->message_len != LOG_RECORD_PADDING)
+                        break;
+                    positions[x] += record->size;
+                }
+
+                if (record && (!next || record->timestamp_ns < next->timestamp_ns)) {
+                    next = record;
+                    next_ring = x;
+                }
+            }
+            if (!next)
+                return;
+
+            const u32 first_sink = (handed_off && next == s_logger_record) ? s_crash_stopped_sink : 0;
+            if (first_sink == UINT32_MAX) {                             // the logger thread crashed while processing it, do not repeat that
+                positions[next_ring] += next->size;
+                continue;
+            }
+
+            const log_site* site = __start_log_sites[next->site_id];
+            if (next->deferred && site->field_names)
+                crash_write_message_locked(first_sink, site, next->thread_id, next->label_id, next->timestamp_ns, site->format, (const u8*)(next + 1));
+            else {
+                if (next->deferred)
+                    render_log_args(site, (const u8*)(next + 1), s_crash_message, sizeof(s_crash_message));
+                crash_write_message_locked(first_sink, site, next->thread_id, next->label_id, next->timestamp_ns,
+                    next->deferred ? s_crash_message : log_record_message(next), NULL);
+            }
+            positions[next_ring] += next->size;
+        }
+    }
+
+#endif
+
+
+void logger_on_crash() {
+
+    if (atomic_exchange(&s_crashed, true))
+        return;
+
+    // held until the queued records are written, threads that log directly in the meantime wait so their messages stay in order
+    while (atomic_flag_test_and_set(&s_crash_lock))
+        sched_yield();
+
+#if USE_MULTI_THREADING
+    if (atomic_load(&s_staging.active)) {
+        atomic_store(&s_staging.active, false);                 // producers stop using their rings and write directly (see log_message_va)
+        atomic_fetch_add(&s_staging.generation, 1);
+
+        // wait for the logger thread to stop at its next record or sink write (see logger_thread_func). It may be stuck on a lock held by
+        // the crashed thread, then the rings and writers are shared with it: only free writers are used and records may be written twice.
+        // A crash of the logger thread itself stops it anyway. The record it was processing is skipped then: the sinks before the fault
+        // have it, and rendering it or writing it to the faulting sink again would most likely crash the handler as well
+        b8 handed_off = pthread_equal(pthread_self(), s_logger_thread);
+        if (!handed_off) {
+            if (pthread_mutex_trylock(&s_staging.mutex) == 0) {                 // wake it up if it sleeps
+                pthread_cond_signal(&s_staging.contains);
+                pthread_mutex_unlock(&s_staging.mutex);
+            }
+            for (u32 x = 0; x < 100 && !(handed_off = atomic_load(&s_crash_ack)); x++)
+                nanosleep(&(struct timespec){ .tv_sec = 0, .tv_nsec = 1000000 }, NULL);
+        }
+
+        if (!handed_off)
+            s_crash_writer_lock_attempts = 1;
+        crash_drain_staging_locked(handed_off);
+    }
+#endif
+
+    // write what the file sinks buffered, the crash ring needs nothing: its pages belong to the kernel
+    const log_sink_set* set = atomic_load(&s_sink_set);
+    for (u32 x = 0; set && x < set->sink_count; x++)
+        if (set->sinks[x]->file)
+            file_writer_crash_write(set->sinks[x]->file, NULL, 0, s_crash_writer_lock_attempts);
+    atomic_flag_clear(&s_crash_lock);
+}
+
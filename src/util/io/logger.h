@@ -2,6 +2,7 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "util/breakpoint.h"
 #include "util/core_config.h"
@@ -22,6 +23,28 @@ typedef enum {
 } log_type;
 
 
+// @brief Static descriptor of a single LOG_* call site, created once per call site by the LOG_MESSAGE macro.
+//        Pointers to all descriptors are collected by the linker in the [log_sites] section, so the logger can
+//        enumerate every call site of the program at runtime (see logger_get_site_count / logger_get_site).
+//        Records only carry the [id] of their site, everything else is resolved by the logger thread.
+typedef struct {
+    log_type                type;
+    int                     line;                   // as provided by __LINE__
+    const char*             file_name;              // as provided by __FILE__
+    const char*             function_name;          // as provided by __func__
+    const char*             format;                 // printf-style format literal
+    const u8*               arg_types;              // signature of the arguments (see LOG_ARG_TYPE), terminated by LOG_ARG_END
+    const char* const*      field_names;            // LOG_KV: key of every argument, NULL for all other call sites
+    _Atomic b8              enabled;                // checked before the arguments are evaluated, combines [disabled] and the runtime level filter
+    b8                      disabled;               // set by logger_set_site_enabled()
+
+    // filled in by logger_init()
+    u32                     id;                     // index into the [log_sites] section
+    const char*             short_file_name;        // file name without directories
+    const struct log_parsed_format* parsed_format;  // conversions of [format] and how each argument is stored
+} log_site;
+
+
 
 // @brief Initializes the logging system with specified configuration.
 //        Sets up log formatting, output destinations, and creates log file.
@@ -42,15 +65,277 @@ b8 logger_init(const char* log_msg_format, const b8 log_to_console, const char*
 void logger_shutdown();
 
 
+#define LOGGER_FILE_BUFFER_SIZE                 64000           // formatted messages are collected up to this size before being written to the log file
+
+// @brief Controls when buffered messages are written to the log file.
+//        Whatever triggers first causes a write of everything buffered so far.
+typedef struct {
+    u32                     size_threshold;         // write once this many bytes are buffered (at most LOGGER_FILE_BUFFER_SIZE)
+    u32                     interval_ms;            // write buffered messages at least this often, 0 disables the timer
+    log_type                flush_level;            // messages with this severity or higher are written immediately
+} logger_flush_policy;
+
+#define LOGGER_DEFAULT_FLUSH_POLICY             ((logger_flush_policy){ .size_threshold = LOGGER_FILE_BUFFER_SIZE, .interval_ms = 1000, .flush_level = LOG_TYPE_ERROR })
+
+
+// @brief Replaces the flush policy of every file sink (default: LOGGER_DEFAULT_FLUSH_POLICY).
+//        Also used for file sinks added later.
+void logger_set_flush_policy(const logger_flush_policy policy);
+
+
+// @brief What producers do when the log queue fills up faster than the logger thread can process it.
+//        Only used with USE_MULTI_THREADING, otherwise every message is written by the calling thread.
+typedef enum {
+    LOGGER_OVERFLOW_BLOCK = 0,                          // wait for space, nothing is lost but a slow disk can stall the caller
+    LOGGER_OVERFLOW_DROP_NEWEST,                        // drop the new message if the queue is full
+    LOGGER_OVERFLOW_DROP_OLDEST,                        // above the high-water mark the logger thread discards the oldest messages without formatting them,
+                                                        // if the queue is full nevertheless the new message is dropped
+    LOGGER_OVERFLOW_DROP_BELOW_LEVEL,                   // above the high-water mark messages below [min_level] are dropped, the others wait if the queue is full
+} logger_overflow_mode;
+
+typedef struct {
+    logger_overflow_mode    mode;
+    u32                     high_water_percent;     // fill level of the queue (1 - 100) above which DROP_OLDEST and DROP_BELOW_LEVEL start dropping
+    log_type                min_level;              // DROP_BELOW_LEVEL: messages with this severity or higher are never dropped
+} logger_overflow_policy;
+
+#define LOGGER_DEFAULT_OVERFLOW_POLICY          ((logger_overflow_policy){ .mode = LOGGER_OVERFLOW_DROP_BELOW_LEVEL, .high_water_percent = 75, .min_level = LOG_TYPE_WARN })
+
+
+// @brief Replaces the overflow policy of the log queue (default: LOGGER_DEFAULT_OVERFLOW_POLICY).
+void logger_set_overflow_policy(const logger_overflow_policy policy);
+
+
+// @brief Copies the number of dropped messages per severity since the start of the program into [counts] (LOG_TYPE_FATAL + 1 entries).
+//        New drops are also reported by a WARN message of the logger once the queue drained below half of the high-water mark.
+void logger_get_dropped_messages(u64* counts);
+
+
+// @brief Controls when a log file is moved aside and a new one is started.
+//        The active file keeps its name, rotated files are renamed to "<name>.<sequence><extension>" (e.g. application.12.log),
+//        so switching files is a single rename. With [compress] they are gzipped (".gz" appended) by a low-priority background thread.
+typedef struct {
+    u64                     max_file_size;          // start a new file once it would grow beyond this many bytes, 0 disables size based rotation
+    u32                     interval_s;             // start a new file whenever the local wall-clock time crosses a multiple of this interval
+                                                    // (e.g. 3600 = every full hour, 86400 = at midnight), 0 disables time based rotation
+    u32                     max_files;              // number of rotated files kept, older ones are deleted, 0 keeps all of them
+    b8                      compress;               // gzip rotated files
+} logger_rotation_policy;
+
+#define LOGGER_DEFAULT_ROTATION_POLICY          ((logger_rotation_policy){ .max_file_size = 0, .interval_s = 0, .max_files = 0, .compress = false })
+
+
+// @brief Replaces the rotation policy of the file created by logger_init() (default: LOGGER_DEFAULT_ROTATION_POLICY, never rotate).
+//        Needs to be called before logger_init() to take effect.
+void logger_set_rotation_policy(const logger_rotation_policy policy);
+
+
+// @brief Size of the crash ring (LOG_SINK_CRASH_RING) that logger_init() creates next to the log file as "<log_file_name>.crash",
+//        0 disables it (default). Needs to be called before logger_init() to take effect.
+void logger_set_crash_ring_size(const u32 size);
+
+
+// @brief Encoding of the messages a sink receives.
+typedef enum {
+    LOG_OUTPUT_TEXT = 0,                                // rendered with the format of the sink (see logger_set_format)
+    LOG_OUTPUT_JSON,                                    // one JSON object per line, the format of the sink is ignored:
+                                                        // {"ts_ns":..,"level":"INFO","thread_id":..,"thread":"main","file":"src/main.c","line":42,
+                                                        //  "function":"main","message":"..","fields":{"key":value,..}}
+                                                        // "thread" is only present if the thread has a label, "fields" only for LOG_KV messages
+    LOG_OUTPUT_BINARY,                                  // length-prefixed records (see LOG_BINARY_MAGIC), for file and callback sinks only
+} log_output_format;
+
+
+// Binary output: every file starts with LOG_BINARY_MAGIC followed by a u32 LOG_BINARY_VERSION, then records follow back to back.
+// All integers are little endian and unaligned, strings are not terminated.
+//      u32     size                            bytes of the record following this field
+//      u64     timestamp_ns                    nanoseconds since the epoch
+//      u64     thread_id
+//      u32     line
+//      u8      level                           log_type
+//      u8      field_count
+//      u16     label_length                    0 if the thread has no label
+//      u16     file_length
+//      u16     function_length
+//      u32     message_length
+//      label, file, function and message
+//      [field_count] times:
+//          u8  type                            log_arg_type, LOG_ARG_F128 is stored as LOG_ARG_F64
+//          u8  key_length
+//          key
+//          value                               LOG_ARG_I32/U32: 4 bytes, LOG_ARG_I64/U64/F64/PTR: 8 bytes,
+//                                              LOG_ARG_STR: u32 length (LOG_BINARY_NULL_STRING for NULL) followed by the characters
+// tools/log_decode.c converts such files back to text or JSON lines.
+#define LOG_BINARY_MAGIC                        "ATLOGBIN"      // 8 bytes, not terminated inside the file
+#define LOG_BINARY_VERSION                      1
+#define LOG_BINARY_RECORD_HEADER_SIZE           36              // fixed part of a record including [size]
+#define LOG_BINARY_NULL_STRING                  UINT32_MAX
+
+
+// @brief Output format of the file sink created by logger_init() (default: LOG_OUTPUT_TEXT). The file is named "<log_file_name>.log",
+//        ".jsonl" or ".logbin" accordingly. Needs to be called before logger_init() to take effect.
+void logger_set_output_format(const log_output_format output);
+
+
+// @brief Crash callback for crash_handler_subscribe_callback(), replaces logger_shutdown() there.
+//        Gives the logger thread a moment to write out queued messages, then writes buffered file data without taking locks.
+//        Messages logged afterwards (e.g. the crash report) are written directly by the calling thread.
+//        Does not allocate, but formatting is best effort: the crashed thread may have left the logger in any state.
+void logger_on_crash();
+
+
+// @brief Loads the [logger_settings] section of a YAML config file (see config/app_settings.yml) and applies it.
+//        The rotation and output settings need to be loaded before logger_init(), the level filter can be reloaded at any time.
+//        Missing keys keep their current value. Keys: max_file_size, rotation_interval_s, max_files, compress_rotated_files, crash_ring_size,
+//        output_format (text, json or binary), log_level (name or number) and module_levels (list of "<module>=<level>", e.g. "util/io/=info renderer.c=warn").
+// @param config_dir Directory of the config file, relative to the executable
+// @param file_name Name of the config file
+// @return True if the file could be read
+b8 logger_load_settings(const char* config_dir, const char* file_name);
+
+
+// @brief Writes all messages logged before this call to the console and the log files.
+//        For multi-threaded applications, waits until the logger thread processed them.
+void logger_flush();
+
+
+// @brief Destinations of formatted log messages. logger_init() adds a console sink (if requested) and a file sink,
+//        more can be added with logger_add_sink().
+typedef enum {
+    LOG_SINK_CONSOLE = 0,                               // stdout below WARN, stderr otherwise. stdout is flushed when the logger thread runs out of work
+    LOG_SINK_FILE,                                      // buffered log file, see logger_flush_policy
+    LOG_SINK_ROTATING_FILE,                             // like LOG_SINK_FILE, but starts a new file as described by [rotation]
+    LOG_SINK_MEMORY,                                    // keeps the most recent messages in memory, e.g. for a log window (see logger_read_memory_sink)
+    LOG_SINK_CALLBACK,                                  // calls a user function for every message
+    LOG_SINK_CRASH_RING,                                // keeps the most recent messages in a memory-mapped file that survives a crash of the process,
+                                                        // the next run copies them into its file sinks with the same output unless the logger was shut down cleanly.
+                                                        // Text and JSON output only
+} log_sink_type;
+
+#define LOGGER_MAX_SINKS                        16
+#define LOGGER_DEFAULT_MEMORY_SINK_SIZE         (1 << 20)       // bytes of formatted messages kept by a LOG_SINK_MEMORY sink
+#define LOGGER_DEFAULT_CRASH_RING_SIZE          (1 << 20)       // bytes of formatted messages kept by a LOG_SINK_CRASH_RING sink
+
+
+// @brief A formatted message as seen by a sink.
+typedef struct {
+    const log_site*         site;                   // severity, file, function, line and format of the call site
+    pthread_t               thread_id;
+    const char*             thread_label;           // label registered for the thread when the message was logged, NULL if none
+    u64                     timestamp_ns;           // nanoseconds since the epoch
+    u64                     sequence;               // LOG_SINK_MEMORY only: position of the message inside the sink, starts at 1
+    const char*             text;                   // message rendered with the format of the sink, ends with '\n' (a binary record for LOG_OUTPUT_BINARY)
+    u32                     length;                 // bytes of [text]
+} log_entry;
+
+// @brief Called for every message of a LOG_SINK_CALLBACK sink (on the logger thread if USE_MULTI_THREADING is on).
+//        Must not log and must not add or remove sinks.
+typedef void (*log_sink_callback)(const log_entry* entry, void* user_data);
+
+
+// @brief Describes a new sink, fields that do not apply to [type] are ignored.
+typedef struct {
+    log_sink_type           type;
+    log_type                min_level;              // messages below this severity are not passed to the sink
+    const char*             format;                 // NULL to use the logger format (see logger_set_format)
+    b8                      use_colors;             // keep the $B/$E colors. Console sinks only use colors if stdout and stderr are terminals
+    log_output_format       output;                 // LOG_OUTPUT_TEXT uses [format] and [use_colors]
+
+    const char*             file_path;              // LOG_SINK_FILE, LOG_SINK_ROTATING_FILE, LOG_SINK_CRASH_RING
+    b8                      use_append_mode;        // LOG_SINK_FILE, LOG_SINK_ROTATING_FILE
+    logger_rotation_policy  rotation;               // LOG_SINK_ROTATING_FILE
+    u32                     memory_size;            // LOG_SINK_MEMORY, LOG_SINK_CRASH_RING: bytes of formatted messages kept, 0 for the default size
+    log_sink_callback       callback;               // LOG_SINK_CALLBACK
+    void*                   user_data;              // LOG_SINK_CALLBACK
+} log_sink_config;
+
+
+// @brief Adds a sink. Every distinct format is rendered once per message and shared by all sinks using it.
+// @param sink_id Receives the ID of the new sink, can be NULL
+// @return AT_SUCCESS, AT_INVALID_ARGUMENT, AT_RANGE_ERROR if LOGGER_MAX_SINKS is reached, AT_IO_ERROR if the file could not be opened,
+//         AT_FORMAT_ERROR or AT_MEMORY_ERROR
+i32 logger_add_sink(const log_sink_config* config, u32* sink_id);
+
+
+// @brief Removes a sink, buffered data of file sinks is written first.
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT if there is no sink with [sink_id]
+i32 logger_remove_sink(const u32 sink_id);
+
+
+// @brief Changes the minimum severity of a sink.
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT
+i32 logger_set_sink_level(const u32 sink_id, const log_type min_level);
+
+
+// @brief Calls [callback] for every message of a LOG_SINK_MEMORY sink with a sequence >= [first_sequence], oldest first.
+//        The sink is locked during the calls, so the callback should only copy what it needs.
+// @return The sequence of the next message, pass it as [first_sequence] to only read new messages next time
+u64 logger_read_memory_sink(const u32 sink_id, const u64 first_sequence, log_sink_callback callback, void* user_data);
+
+
 // @brief Internal function to log a message with specified severity and context.
 //        Not intended for direct use - use the LOG_* macros instead.
-// @param type Severity level of the message
+// @param site Descriptor of the call site (severity, file, function, line, format)
+// @param thread_id ID of the thread generating the message
+// @param ... Arguments for the format of [site]
+void log_message(const log_site* site, pthread_t thread_id, ...);
+
+
+// @brief Internal function used by the LOG_KV macros. Captures the arguments as typed fields named by [site->field_names],
+//        the message of [site] is used as is (no conversions).
+// @param site Descriptor of the call site, provides the message, the field names and the signature of the arguments
 // @param thread_id ID of the thread generating the message
-// @param file_name Source file where the log call originated
-// @param function_name Function where the log call originated
-// @param line Line number in the source file
-// @param message Format string for the log message (with optional varargs)
-void log_message(log_type type, pthread_t thread_id, const char* file_name, const char* function_name, const int line, const char* message, ...);
+// @param ... One value per field
+void log_message_kv(const log_site* site, pthread_t thread_id, ...);
+
+
+// @brief Internal function used by the LOG_* macros when LOG_DEFERRED_FORMATTING is enabled.
+//        Only captures the raw bytes of the arguments (strings are copied),
+//        the actual formatting happens on the logger thread.
+// @param site Descriptor of the call site, provides the format and the signature of the arguments
+// @param thread_id ID of the thread generating the message
+// @param ... Arguments for the format of [site]
+void log_message_deferred(const log_site* site, pthread_t thread_id, ...);
+
+
+// @brief Returns the number of LOG_* call sites compiled into the program.
+//        Site IDs are in the range [0, logger_get_site_count()).
+u32 logger_get_site_count();
+
+
+// @brief Returns the descriptor of a call site, or NULL if [id] is out of range.
+const log_site* logger_get_site(const u32 id);
+
+
+// @brief Enables or disables a single call site at runtime. A disabled site does not evaluate its arguments.
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT if [id] is out of range
+i32 logger_set_site_enabled(const u32 id, const b8 enabled);
+
+
+// @brief Sets the minimum severity that is logged at runtime (default: LOG_TYPE_TRACE).
+//        A filtered call site costs a single branch, its arguments are not evaluated. LOG_LEVEL_ENABLED still removes levels at compile time.
+void logger_set_level(const log_type level);
+
+
+// @brief Returns the level set by logger_set_level().
+log_type logger_get_level();
+
+
+// @brief Overrides the runtime level for every call site whose file path contains [module], e.g. "util/io/" or "dashboard.c".
+//        If several modules match a call site, the longest one wins. Can be changed at any time.
+// @return AT_SUCCESS, AT_INVALID_ARGUMENT, AT_MEMORY_ERROR or AT_RANGE_ERROR if too many modules are registered
+i32 logger_set_module_level(const char* module, const log_type level);
+
+
+// @brief Removes the override of [module], its call sites use the level of logger_set_level() again.
+// @return AT_SUCCESS or AT_INVALID_ARGUMENT if [module] has no override
+i32 logger_remove_module_level(const char* module);
+
+
+// @brief Copies up to [max_count] module overrides into [modules] and [levels], e.g. to display them.
+//        The module strings stay valid until the override is removed.
+// @return The total number of module overrides
+u32 logger_get_module_levels(const char** modules, log_type* levels, const u32 max_count);
 
 
 // The format of log-messages can be customized with the following tags
@@ -85,6 +370,7 @@ void logger_set_format(const char* new_format);
 // @brief Associates a human-readable label with a thread ID.
 //        Registered labels will be used in log output instead of numeric thread IDs,
 //        making logs easier to read in multi-threaded applications.
+//        Registering the calling thread also creates its staging buffer, which otherwise happens on its first log message.
 // @param thread_id The thread ID to label (typically from pthread_self())
 // @param label Descriptive name for the thread
 void logger_register_thread_label(pthread_t thread_id, const char* label);
@@ -92,6 +378,7 @@ void logger_register_thread_label(pthread_t thread_id, const char* label);
 #define LOGGER_REGISTER_THREAD_LABEL(label)     logger_register_thread_label((u64)pthread_self(), label);
 
 
+// @brief Removes the label of a thread, messages it logged before keep the label.
 void logger_remove_thread_label_by_id(pthread_t thread_id);
 
 
@@ -107,30 +394,108 @@ void logger_remove_thread_label_by_label(const char* label);
 #define LOG_LEVEL_ENABLED           			4
 
 
-#define LOG_Fatal(message, ...)                                         { log_message(LOG_TYPE_FATAL, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
-#define LOG_Error(message, ...)                                         { log_message(LOG_TYPE_ERROR, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
+// Deferred (binary) logging: the calling thread only records the format pointer and the raw argument bytes,
+// all printf-style formatting is done by the logger thread. Requires a literal format string and at most LOG_MAX_ARGS arguments.
+//  0 = format on the calling thread (vsnprintf)
+//  1 = format on the logger thread
+#define LOG_DEFERRED_FORMATTING                 1
+
+
+// Type signature of a single log argument, the value is stored in its promoted form
+typedef enum {
+    LOG_ARG_END = 0,                                                    // terminates a signature
+    LOG_ARG_I32,                                                        // int and everything promoted to it
+    LOG_ARG_U32,
+    LOG_ARG_I64,
+    LOG_ARG_U64,
+    LOG_ARG_F64,                                                        // float and double
+    LOG_ARG_F128,                                                       // long double
+    LOG_ARG_STR,                                                        // char*, copied into the record when used by %s
+    LOG_ARG_PTR,                                                        // any other pointer
+} log_arg_type;
+
+#define LOG_MAX_ARGS                            16
+
+#define LOG_ARG_TYPE(x) _Generic((x),                                   \
+    _Bool: LOG_ARG_I32, char: LOG_ARG_I32, signed char: LOG_ARG_I32,    \
+    unsigned char: LOG_ARG_I32, short: LOG_ARG_I32,                     \
+    unsigned short: LOG_ARG_I32, int: LOG_ARG_I32,                      \
+    unsigned int: LOG_ARG_U32,                                          \
+    long: LOG_ARG_I64, long long: LOG_ARG_I64,                          \
+    unsigned long: LOG_ARG_U64, unsigned long long: LOG_ARG_U64,        \
+    float: LOG_ARG_F64, double: LOG_ARG_F64, long double: LOG_ARG_F128, \
+    char*: LOG_ARG_STR, const char*: LOG_ARG_STR,                       \
+    default: LOG_ARG_PTR                                                \
+)
+
+// expands to a comma separated list of LOG_ARG_TYPE() for up to LOG_MAX_ARGS arguments
+#define LOG_ARG_COUNT(...)                      LOG_ARG_COUNT_(_, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_ARG_COUNT_(_, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, N, ...)     N
+#define LOG_ARG_CONCAT(a, b)                    LOG_ARG_CONCAT_(a, b)
+#define LOG_ARG_CONCAT_(a, b)                   a##b
+#define LOG_ARG_TYPES(...)                      LOG_ARG_CONCAT(LOG_ARG_TYPES_, LOG_ARG_COUNT(__VA_ARGS__))(__VA_ARGS__)
+#define LOG_ARG_TYPES_0(...)
+#define LOG_ARG_TYPES_1(a)                      LOG_ARG_TYPE(a),
+#define LOG_ARG_TYPES_2(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_1(__VA_ARGS__)
+#define LOG_ARG_TYPES_3(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_2(__VA_ARGS__)
+#define LOG_ARG_TYPES_4(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_3(__VA_ARGS__)
+#define LOG_ARG_TYPES_5(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_4(__VA_ARGS__)
+#define LOG_ARG_TYPES_6(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_5(__VA_ARGS__)
+#define LOG_ARG_TYPES_7(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_6(__VA_ARGS__)
+#define LOG_ARG_TYPES_8(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_7(__VA_ARGS__)
+#define LOG_ARG_TYPES_9(a, ...)                 LOG_ARG_TYPE(a), LOG_ARG_TYPES_8(__VA_ARGS__)
+#define LOG_ARG_TYPES_10(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_9(__VA_ARGS__)
+#define LOG_ARG_TYPES_11(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_10(__VA_ARGS__)
+#define LOG_ARG_TYPES_12(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_11(__VA_ARGS__)
+#define LOG_ARG_TYPES_13(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_12(__VA_ARGS__)
+#define LOG_ARG_TYPES_14(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_13(__VA_ARGS__)
+#define LOG_ARG_TYPES_15(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_14(__VA_ARGS__)
+#define LOG_ARG_TYPES_16(a, ...)                LOG_ARG_TYPE(a), LOG_ARG_TYPES_15(__VA_ARGS__)
+
+
+#if LOG_DEFERRED_FORMATTING
+    #define LOG_MESSAGE_FUNCTION                                        log_message_deferred
+#else
+    #define LOG_MESSAGE_FUNCTION                                        log_message
+#endif
+
+// Creates the descriptor of the call site and registers it in the [log_sites] section
+#define LOG_MESSAGE(severity, message, ...) {                                                                                               \
+        static const u8 log_site_arg_types[] = { LOG_ARG_TYPES(__VA_ARGS__) LOG_ARG_END };                                                  \
+        static log_site log_site_descriptor = {                                                                                             \
+            .type = severity, .line = __LINE__, .file_name = __FILE__, .function_name = __func__,                                           \
+            .format = message, .arg_types = log_site_arg_types, .enabled = true,                                                            \
+        };                                                                                                                                  \
+        static log_site* const log_site_slot __attribute__((used, section("log_sites"))) = &log_site_descriptor;                            \
+        if (atomic_load_explicit(&log_site_descriptor.enabled, memory_order_relaxed))                                                       \
+            LOG_MESSAGE_FUNCTION(&log_site_descriptor, pthread_self(), ##__VA_ARGS__);                                                      \
+    }
+
+
+#define LOG_Fatal(message, ...)                                         LOG_MESSAGE(LOG_TYPE_FATAL, message, ##__VA_ARGS__)
+#define LOG_Error(message, ...)                                         LOG_MESSAGE(LOG_TYPE_ERROR, message, ##__VA_ARGS__)
 
 #if LOG_LEVEL_ENABLED > 0
-    #define LOG_Warn(message, ...)                                      { log_message(LOG_TYPE_WARN, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
+    #define LOG_Warn(message, ...)                                      LOG_MESSAGE(LOG_TYPE_WARN, message, ##__VA_ARGS__)
 #else
     #define LOG_Warn(message, ...)                                      { }
 #endif
 
 #if LOG_LEVEL_ENABLED > 1
-    #define LOG_Info(message, ...)                                      { log_message(LOG_TYPE_INFO, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
+    #define LOG_Info(message, ...)                                      LOG_MESSAGE(LOG_TYPE_INFO, message, ##__VA_ARGS__)
 #else
     #define LOG_Info(message, ...)                                      { }
 #endif
 
 #if LOG_LEVEL_ENABLED > 2
-    #define LOG_Debug(message, ...)                                     { log_message(LOG_TYPE_DEBUG, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
+    #define LOG_Debug(message, ...)                                     LOG_MESSAGE(LOG_TYPE_DEBUG, message, ##__VA_ARGS__)
 #else
     #define LOG_Debug(message, ...)                                     { }
 #endif
 
 
 #if LOG_LEVEL_ENABLED > 3
-    #define LOG_Trace(message, ...)                                     { log_message(LOG_TYPE_TRACE, pthread_self(), __FILE__, __func__, __LINE__, message, ##__VA_ARGS__); }
+    #define LOG_Trace(message, ...)                                     LOG_MESSAGE(LOG_TYPE_TRACE, message, ##__VA_ARGS__)
     #define LOG_INIT                                                    LOG(Trace, "init")
     #define LOG_SHUTDOWN                                                LOG(Trace, "shutdown")
 #else
@@ -142,6 +507,79 @@ void logger_remove_thread_label_by_label(const char* label);
 #define LOG(severity, message, ...)                                     LOG_##severity(message, ##__VA_ARGS__)
 
 
+// Structured messages: every field is a ("key", value) pair, the value is kept with its type (see LOG_ARG_TYPE) instead of being formatted.
+// Text sinks append the fields as " key=value" to the message, JSON and binary sinks store them separately.
+// The message is used literally, at least one and at most LOG_MAX_ARGS fields. Keys are truncated to LOG_KV_MAX_KEY_LENGTH characters.
+//      LOG_KV(Info, "request finished", ("path", path), ("status", status), ("duration_ms", elapsed_ms))
+#define LOG_KV_MAX_KEY_LENGTH                   64
+
+#define LOG_KV_KEY(key, value)                  key
+#define LOG_KV_VALUE(key, value)                value
+#define LOG_KV_KEY_OF(field)                    LOG_KV_KEY field
+#define LOG_KV_VALUE_OF(field)                  LOG_KV_VALUE field
+#define LOG_KV_TYPE_OF(field)                   LOG_ARG_TYPE(LOG_KV_VALUE field)
+
+// applies [f] to every field, comma separated
+#define LOG_KV_LIST(f, ...)                     LOG_ARG_CONCAT(LOG_KV_LIST_, LOG_ARG_COUNT(__VA_ARGS__))(f, __VA_ARGS__)
+#define LOG_KV_LIST_1(f, a)                     f(a)
+#define LOG_KV_LIST_2(f, a, ...)                f(a), LOG_KV_LIST_1(f, __VA_ARGS__)
+#define LOG_KV_LIST_3(f, a, ...)                f(a), LOG_KV_LIST_2(f, __VA_ARGS__)
+#define LOG_KV_LIST_4(f, a, ...)                f(a), LOG_KV_LIST_3(f, __VA_ARGS__)
+#define LOG_KV_LIST_5(f, a, ...)                f(a), LOG_KV_LIST_4(f, __VA_ARGS__)
+#define LOG_KV_LIST_6(f, a, ...)                f(a), LOG_KV_LIST_5(f, __VA_ARGS__)
+#define LOG_KV_LIST_7(f, a, ...)                f(a), LOG_KV_LIST_6(f, __VA_ARGS__)
+#define LOG_KV_LIST_8(f, a, ...)                f(a), LOG_KV_LIST_7(f, __VA_ARGS__)
+#define LOG_KV_LIST_9(f, a, ...)                f(a), LOG_KV_LIST_8(f, __VA_ARGS__)
+#define LOG_KV_LIST_10(f, a, ...)               f(a), LOG_KV_LIST_9(f, __VA_ARGS__)
+#define LOG_KV_LIST_11(f, a, ...)               f(a), LOG_KV_LIST_10(f, __VA_ARGS__)
+#define LOG_KV_LIST_12(f, a, ...)               f(a), LOG_KV_LIST_11(f, __VA_ARGS__)
+#define LOG_KV_LIST_13(f, a, ...)               f(a), LOG_KV_LIST_12(f, __VA_ARGS__)
+#define LOG_KV_LIST_14(f, a, ...)               f(a), LOG_KV_LIST_13(f, __VA_ARGS__)
+#define LOG_KV_LIST_15(f, a, ...)               f(a), LOG_KV_LIST_14(f, __VA_ARGS__)
+#define LOG_KV_LIST_16(f, a, ...)               f(a), LOG_KV_LIST_15(f, __VA_ARGS__)
+
+#define LOG_KV_MESSAGE(severity, message, ...) {                                                                                            \
+        static const u8 log_site_arg_types[] = { LOG_KV_LIST(LOG_KV_TYPE_OF, __VA_ARGS__), LOG_ARG_END };                                  \
+        static const char* const log_site_field_names[] = { LOG_KV_LIST(LOG_KV_KEY_OF, __VA_ARGS__), NULL };                                \
+        static log_site log_site_descriptor = {                                                                                             \
+            .type = severity, .line = __LINE__, .file_name = __FILE__, .function_name = __func__,                                           \
+            .format = message, .arg_types = log_site_arg_types, .field_names = log_site_field_names, .enabled = true,                       \
+        };                                                                                                                                  \
+        static log_site* const log_site_slot __attribute__((used, section("log_sites"))) = &log_site_descriptor;                            \
+        if (atomic_load_explicit(&log_site_descriptor.enabled, memory_order_relaxed))                                                       \
+            log_message_kv(&log_site_descriptor, pthread_self(), LOG_KV_LIST(LOG_KV_VALUE_OF, __VA_ARGS__));                                \
+    }
+
+#define LOG_KV_Fatal(message, ...)                                      LOG_KV_MESSAGE(LOG_TYPE_FATAL, message, __VA_ARGS__)
+#define LOG_KV_Error(message, ...)                                      LOG_KV_MESSAGE(LOG_TYPE_ERROR, message, __VA_ARGS__)
+
+#if LOG_LEVEL_ENABLED > 0
+    #define LOG_KV_Warn(message, ...)                                   LOG_KV_MESSAGE(LOG_TYPE_WARN, message, __VA_ARGS__)
+#else
+    #define LOG_KV_Warn(message, ...)                                   { }
+#endif
+
+#if LOG_LEVEL_ENABLED > 1
+    #define LOG_KV_Info(message, ...)                                   LOG_KV_MESSAGE(LOG_TYPE_INFO, message, __VA_ARGS__)
+#else
+    #define LOG_KV_Info(message, ...)                                   { }
+#endif
+
+#if LOG_LEVEL_ENABLED > 2
+    #define LOG_KV_Debug(message, ...)                                  LOG_KV_MESSAGE(LOG_TYPE_DEBUG, message, __VA_ARGS__)
+#else
+    #define LOG_KV_Debug(message, ...)                                  { }
+#endif
+
+#if LOG_LEVEL_ENABLED > 3
+    #define LOG_KV_Trace(message, ...)                                  LOG_KV_MESSAGE(LOG_TYPE_TRACE, message, __VA_ARGS__)
+#else
+    #define LOG_KV_Trace(message, ...)                                  { }
+#endif
+
+#define LOG_KV(severity, message, ...)                                  LOG_KV_##severity(message, __VA_ARGS__)
+
+
 
 #if ENABLE_LOGGING_FOR_VALIDATION
     #define VALIDATE(expr, return_cmd, success_msg, failure_msg, ...)   \
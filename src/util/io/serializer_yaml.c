@@ -100,9 +100,8 @@ const char* skip_indentation(const char* line) {
 // lines inside [serializer->section_content] are "\n" terminated
 b8 get_content_of_section(SY* serializer) {
 
-    // reset string
-    ds_free(&serializer->section_content);
-    ds_init(&serializer->section_content);
+    // reset string, keeps its memory
+    ds_clear(&serializer->section_content);
     rewind(serializer->fp);
 
     // search for header while respecting the hierarchy in [serializer->section_headers]
@@ -550,7 +549,7 @@ b8 sy_init(SY* serializer, const char* dir_path, const char* file_name, const ch
     if (result)
         LOG(Error, "result: %s", strerror(result));
 
-    ds_init(&serializer->section_content);                                                                      // Initialize dynamic string buffer and parse initial section
+    ds_init_buffer(&serializer->section_content, serializer->section_buffer, sizeof(serializer->section_buffer), true);   // Initialize dynamic string buffer and parse initial section
     get_content_of_section(serializer);
 
     return true;
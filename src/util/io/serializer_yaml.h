@@ -16,14 +16,16 @@ typedef enum {
 
 
 #define STR_SEC_LEN     128
+#define STR_SECTION_INLINE_LEN      1024                // sections up to this size are kept in [SY] without allocating
 
 typedef struct {
 
     FILE*               fp;
     serializer_option   option;
     u32                 current_indentation;
-    dyn_str             section_content;
+    dyn_str             section_content;        // uses [section_buffer] until a section outgrows it
     stack               section_headers;
+    char                section_buffer[STR_SECTION_INLINE_LEN];
 } SY;
 
 
@@ -10,6 +10,8 @@
 #include <stdint.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdatomic.h>
+#include <threads.h>
 
 #include "util/io/logger.h"
 #include "system.h"
@@ -73,26 +75,61 @@ void precise_sleep(const f64 seconds) {
 }
 
 
-system_time get_system_time() {
+#define NS_PER_SEC                  1000000000LL
+
+static _Atomic i64                  s_realtime_offset_ns = 0;       // CLOCK_REALTIME - CLOCK_MONOTONIC
+static _Atomic i64                  s_offset_refresh_ns = 0;        // monotonic time at which [s_realtime_offset_ns] is refreshed next
+
+
+u64 get_system_time_ns() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const i64 monotonic_ns = (i64)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+
+    if (monotonic_ns >= atomic_load_explicit(&s_offset_refresh_ns, memory_order_relaxed)) {         // concurrent refreshes are harmless
+        struct timespec realtime;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        atomic_store_explicit(&s_realtime_offset_ns, (i64)realtime.tv_sec * NS_PER_SEC + realtime.tv_nsec - monotonic_ns, memory_order_relaxed);
+        atomic_store_explicit(&s_offset_refresh_ns, monotonic_ns + NS_PER_SEC, memory_order_relaxed);
+    }
+
+    return (u64)(monotonic_ns + atomic_load_explicit(&s_realtime_offset_ns, memory_order_relaxed));
+}
+
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    time_t t = tv.tv_sec;
-    struct tm tm_local;
-    localtime_r(&t, &tm_local);
-
-    system_time out;
-    out.year = tm_local.tm_year + 1900;
-    out.month = tm_local.tm_mon + 1;
-    out.day = tm_local.tm_mday;
-    out.hour = tm_local.tm_hour;
-    out.minute = tm_local.tm_min;
-    out.second = tm_local.tm_sec;
-    out.millisec = (int)(tv.tv_usec / 1000);
+system_time system_time_from_ns(const u64 timestamp_ns) {
+
+    static thread_local i64 cached_second = -1;
+    static thread_local system_time cached_time;
+
+    const i64 second = (i64)(timestamp_ns / NS_PER_SEC);
+    if (second != cached_second) {                      // localtime_r can take the tz lock and stat /etc/localtime, only do it once per second
+        const time_t t = (time_t)second;
+        struct tm tm_local;
+        localtime_r(&t, &tm_local);
+
+        cached_time.year = tm_local.tm_year + 1900;
+        cached_time.month = tm_local.tm_mon + 1;
+        cached_time.day = tm_local.tm_mday;
+        cached_time.hour = tm_local.tm_hour;
+        cached_time.minute = tm_local.tm_min;
+        cached_time.second = tm_local.tm_sec;
+        cached_second = second;
+    }
+
+    system_time out = cached_time;
+    out.millisec = (i16)((timestamp_ns % NS_PER_SEC) / 1000000);
     return out;
 }
 
 
+system_time get_system_time() {
+
+    return system_time_from_ns(get_system_time_ns());
+}
+
+
 // ------------------------------------------------------------------------------------------------------------------
 // executable path
 // ------------------------------------------------------------------------------------------------------------------
@@ -29,17 +29,33 @@ f64 get_precise_time();
 void precise_sleep(const f64 seconds);
 
 
-// ------------------------------------------------------------------------------------------------------------------
-// executable path
-// ------------------------------------------------------------------------------------------------------------------
+// @brief Retrieves the current wall-clock time in nanoseconds since the Unix epoch.
+//        Derived from CLOCK_MONOTONIC plus an offset to CLOCK_REALTIME that is refreshed once per second,
+//        so clock adjustments are picked up without reading both clocks for every timestamp.
+// @return Returns the current wall-clock time in nanoseconds.
+u64 get_system_time_ns();
+
+
+// @brief Converts a wall-clock timestamp (see get_system_time_ns) into the local date and time.
+//        The date/time part is cached per thread and only recomputed (localtime_r) when the second changes,
+//        the milliseconds are taken directly from the timestamp.
+// @param timestamp_ns Wall-clock time in nanoseconds since the Unix epoch
+// @return Returns a `system_time` struct containing the local time of [timestamp_ns].
+system_time system_time_from_ns(const u64 timestamp_ns);
+
 
 // @brief Retrieves the current local system time, including year, month, day,
 //        hour, minute, second, and millisecond.
-//        Uses `gettimeofday` and `localtime_r` for thread-safe access.
+//        Same as system_time_from_ns(get_system_time_ns()).
 // @return Returns a `system_time` struct containing the current local time.
 system_time get_system_time();
 
 
+// ------------------------------------------------------------------------------------------------------------------
+// executable path
+// ------------------------------------------------------------------------------------------------------------------
+
+
 // @brief Retrieves the absolute path to the directory where the current executable resides.
 //        Uses `/proc/self/exe` on Linux to resolve the executable path and extracts its directory.
 int get_executable_path(char *out, size_t outlen);
@@ -0,0 +1,294 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "util/io/logger.h"
+
+
+// Converts log files written with LOG_OUTPUT_BINARY back to text or JSON lines (the same layout LOG_OUTPUT_JSON produces).
+// Records are streamed through a fixed buffer, so files of any size are decoded at roughly the speed they can be read.
+//
+//      log_decode [--json] [file ...]          reads stdin if no file (or "-") is given
+
+#define READ_BUFFER_SIZE        (4 * 1024 * 1024)
+#define MAX_RECORD_SIZE         (READ_BUFFER_SIZE / 2)          // the logger never writes records close to this size
+
+static const char* c_level_names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+
+
+// ============================================================================================================================================
+// reading
+// ============================================================================================================================================
+
+typedef struct {
+    const u8*           data;
+    const u8*           end;
+    b8                  valid;              // false once a read went past [end]
+} record_reader;
+
+
+static inline const u8* reader_take(record_reader* reader, const size_t size) {
+
+    if (!reader->valid || (size_t)(reader->end - reader->data) < size) {
+        reader->valid = false;
+        return NULL;
+    }
+    const u8* data = reader->data;
+    reader->data += size;
+    return data;
+}
+
+#define READER_GET(reader, value)       { const u8* bytes = reader_take(reader, sizeof(value)); if (bytes) memcpy(&(value), bytes, sizeof(value)); }
+
+
+// ============================================================================================================================================
+// output
+// ============================================================================================================================================
+
+static void print_json_string(FILE* out, const char* text, const size_t length) {
+
+    fputc('"', out);
+    for (size_t x = 0; x < length; x++) {
+        const unsigned char c = (unsigned char)text[x];
+        if (c == '"' || c == '\\')      { fputc('\\', out); fputc(c, out); }
+        else if (c >= 0x20)             fputc(c, out);
+        else if (c == '\n')             fputs("\\n", out);
+        else if (c == '\t')             fputs("\\t", out);
+        else if (c == '\r')             fputs("\\r", out);
+        else                            fprintf(out, "\\u%04x", c);
+    }
+    fputc('"', out);
+}
+
+
+// Prints the value of one field and advances [reader], returns false for an unknown type
+static b8 print_field_value(FILE* out, record_reader* reader, const u8 type, const b8 json) {
+
+    switch (type) {
+        case LOG_ARG_I32: { i32 value = 0; READER_GET(reader, value) fprintf(out, "%d", value); } break;
+        case LOG_ARG_U32: { u32 value = 0; READER_GET(reader, value) fprintf(out, "%u", value); } break;
+        case LOG_ARG_I64: { i64 value = 0; READER_GET(reader, value) fprintf(out, "%lld", (long long)value); } break;
+        case LOG_ARG_U64: { u64 value = 0; READER_GET(reader, value) fprintf(out, "%llu", (unsigned long long)value); } break;
+        case LOG_ARG_PTR: { u64 value = 0; READER_GET(reader, value) fprintf(out, json ? "\"0x%llx\"" : "0x%llx", (unsigned long long)value); } break;
+        case LOG_ARG_F64: {
+            f64 value = 0;
+            READER_GET(reader, value)
+            if (json && !isfinite(value))   fputs("null", out);
+            else                            fprintf(out, json ? "%.17g" : "%g", value);
+        } break;
+        case LOG_ARG_STR: {
+            u32 length = 0;
+            READER_GET(reader, length)
+            if (length == LOG_BINARY_NULL_STRING) {
+                fputs(json ? "null" : "(null)", out);
+                break;
+            }
+            const char* text = (const char*)reader_take(reader, length);
+            if (!text)
+                return false;
+            if (json)
+                print_json_string(out, text, length);
+            else
+                fprintf(out, "\"%.*s\"", (int)length, text);
+        } break;
+        default:
+            return false;
+    }
+    return reader->valid;
+}
+
+
+// Prints a single record (everything after its [size] field), returns false if it is malformed
+static b8 print_record(FILE* out, const u8* data, const u32 size, const b8 json) {
+
+    record_reader reader = { .data = data, .end = data + size, .valid = true };
+    u64 timestamp_ns = 0, thread_id = 0;
+    u32 line = 0, message_length = 0;
+    u8 level = 0, field_count = 0;
+    u16 label_length = 0, file_length = 0, function_length = 0;
+    READER_GET(&reader, timestamp_ns)
+    READER_GET(&reader, thread_id)
+    READER_GET(&reader, line)
+    READER_GET(&reader, level)
+    READER_GET(&reader, field_count)
+    READER_GET(&reader, label_length)
+    READER_GET(&reader, file_length)
+    READER_GET(&reader, function_length)
+    READER_GET(&reader, message_length)
+    const char* label = (const char*)reader_take(&reader, label_length);
+    const char* file = (const char*)reader_take(&reader, file_length);
+    const char* function = (const char*)reader_take(&reader, function_length);
+    const char* message = (const char*)reader_take(&reader, message_length);
+    if (!reader.valid || level > LOG_TYPE_FATAL)
+        return false;
+
+    if (json) {
+        fprintf(out, "{\"ts_ns\":%llu,\"level\":\"%s\",\"thread_id\":%llu", (unsigned long long)timestamp_ns, c_level_names[level], (unsigned long long)thread_id);
+        if (label_length) {
+            fputs(",\"thread\":", out);
+            print_json_string(out, label, label_length);
+        }
+        fputs(",\"file\":", out);
+        print_json_string(out, file, file_length);
+        fprintf(out, ",\"line\":%u,\"function\":", line);
+        print_json_string(out, function, function_length);
+        fputs(",\"message\":", out);
+        print_json_string(out, message, message_length);
+
+    } else {
+        const time_t seconds = (time_t)(timestamp_ns / 1000000000ULL);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        fprintf(out, "%04d/%02d/%02d %02d:%02d:%02d.%09llu %-5s ", local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+            local.tm_hour, local.tm_min, local.tm_sec, (unsigned long long)(timestamp_ns % 1000000000ULL), c_level_names[level]);
+        if (label_length)   fprintf(out, "[%.*s] ", (int)label_length, label);
+        else                fprintf(out, "[%llu] ", (unsigned long long)thread_id);
+        fprintf(out, "%.*s:%u %.*s: %.*s", (int)file_length, file, line, (int)function_length, function, (int)message_length, message);
+    }
+
+    for (u32 x = 0; x < field_count; x++) {
+        u8 type = 0, key_length = 0;
+        READER_GET(&reader, type)
+        READER_GET(&reader, key_length)
+        const char* key = (const char*)reader_take(&reader, key_length);
+        if (!reader.valid)
+            return false;
+
+        if (json) {
+            fputs((x == 0) ? ",\"fields\":{" : ",", out);
+            print_json_string(out, key, key_length);
+            fputc(':', out);
+        } else
+            fprintf(out, " %.*s=", (int)key_length, key);
+
+        if (!print_field_value(out, &reader, type, json))
+            return false;
+    }
+
+    if (json)
+        fputs(field_count ? "}}\n" : "}\n", out);
+    else
+        fputc('\n', out);
+    return true;
+}
+
+
+// ============================================================================================================================================
+// main
+// ============================================================================================================================================
+
+// Decodes one file, returns false if it is not a binary log or ends in a malformed record
+static b8 decode_file(FILE* in, const char* name, u8* buffer, FILE* out, const b8 json) {
+
+    const size_t header_size = 8 + sizeof(u32);
+    size_t fill = 0;
+    size_t position = 0;
+    b8 end_of_file = false;
+    b8 seen_header = false;
+    u64 records = 0;
+
+    while (1) {
+        if (!end_of_file && fill - position < MAX_RECORD_SIZE) {                // keep at least one record of the maximum size in the buffer
+            memmove(buffer, buffer + position, fill - position);
+            fill -= position;
+            position = 0;
+            const size_t read = fread(buffer + fill, 1, READ_BUFFER_SIZE - fill, in);
+            fill += read;
+            end_of_file = (read == 0);
+            if (!end_of_file)
+                continue;
+        }
+
+        const size_t available = fill - position;
+        if (available == 0)
+            break;
+
+        if (available >= 8 && memcmp(buffer + position, LOG_BINARY_MAGIC, 8) == 0) {     // file header, also accepted between records (concatenated files)
+            u32 version = 0;
+            if (available < header_size)
+                break;
+            memcpy(&version, buffer + position + 8, sizeof(version));
+            if (version != LOG_BINARY_VERSION) {
+                fprintf(stderr, "%s: unsupported version %u\n", name, version);
+                return false;
+            }
+            position += header_size;
+            seen_header = true;
+            continue;
+        }
+
+        if (!seen_header) {
+            fprintf(stderr, "%s: not a binary log file\n", name);
+            return false;
+        }
+
+        u32 size = 0;
+        if (available < sizeof(size))
+            break;
+        memcpy(&size, buffer + position, sizeof(size));
+        if (size < LOG_BINARY_RECORD_HEADER_SIZE - sizeof(u32) || size > MAX_RECORD_SIZE) {
+            fprintf(stderr, "%s: invalid record size %u after %llu records\n", name, size, (unsigned long long)records);
+            return false;
+        }
+        if (available < sizeof(size) + size)
+            break;
+
+        if (!print_record(out, buffer + position + sizeof(size), size, json)) {
+            fprintf(stderr, "%s: malformed record after %llu records\n", name, (unsigned long long)records);
+            return false;
+        }
+        position += sizeof(size) + size;
+        records++;
+    }
+
+    if (fill - position > 0) {
+        fprintf(stderr, "%s: truncated record at the end of the file (%zu bytes)\n", name, fill - position);
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+
+    b8 json = false;
+    int first_file = 1;
+    if (argc > 1 && strcmp(argv[1], "--json") == 0) {
+        json = true;
+        first_file = 2;
+    } else if (argc > 1 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
+        printf("usage: %s [--json] [file ...]\n       converts binary log files (LOG_OUTPUT_BINARY) to text or JSON lines, reads stdin without files\n", argv[0]);
+        return 0;
+    }
+
+    u8* buffer = malloc(READ_BUFFER_SIZE);
+    if (!buffer)
+        return 1;
+
+    static char output_buffer[1 << 16];
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    b8 success = true;
+    if (first_file >= argc)
+        success = decode_file(stdin, "<stdin>", buffer, stdout, json);
+
+    for (int x = first_file; x < argc; x++) {
+        const b8 use_stdin = (strcmp(argv[x], "-") == 0);
+        FILE* in = use_stdin ? stdin : fopen(argv[x], "rb");
+        if (!in) {
+            fprintf(stderr, "%s: can not open file\n", argv[x]);
+            success = false;
+            continue;
+        }
+        success &= decode_file(in, argv[x], buffer, stdout, json);
+        if (!use_stdin)
+            fclose(in);
+    }
+
+    fflush(stdout);
+    free(buffer);
+    return success ? 0 : 1;
+}